@@ -0,0 +1,476 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*----------------------------------------------------------------------------.
+ | BENCHMARKS                                                                 |
+ | -------------------------------------------------------------------------- |
+ |                                                                            |
+ | This program measures how fast WPI files are parsed, optimized and        |
+ | converted. It runs on generated drawings and on the WPI files given on    |
+ | the command line, and writes the results as JSON so that they can be     |
+ | compared between releases. Run it with "make bench".                      |
+ '----------------------------------------------------------------------------*/
+
+#include "synthetic.h"
+#include "../src/datatypes/configuration.h"
+#include "../src/datatypes/element.h"
+#include "../src/datatypes/clock.h"
+#include "../src/parsers/wpi.h"
+#include "../src/optimizers/point-reduction.h"
+#include "../src/converters/svg.h"
+#include "../src/converters/json.h"
+#include "../src/converters/csv.h"
+#include "../src/converters/wpi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "unknown"
+#endif
+
+/* Each benchmark is repeated until it took at least this long in total, or
+ * at least MIN_ITERATIONS times when that is quicker. */
+#define MIN_TIME 0.5
+#define MIN_ITERATIONS 3
+#define MAX_ITERATIONS 10000
+
+/* The converters read some of their settings from here. */
+dt_configuration settings;
+
+/*----------------------------------------------------------------------------.
+ | ALLOCATIONS                                                                |
+ | With the GNU C library, the allocation functions are replaced by ones     |
+ | that count the calls. This also counts the allocations made inside GLib.  |
+ '----------------------------------------------------------------------------*/
+
+#ifdef __GLIBC__
+
+#define COUNTS_ALLOCATIONS 1
+
+extern void* __libc_malloc (size_t size);
+extern void* __libc_calloc (size_t count, size_t size);
+extern void* __libc_realloc (void* pointer, size_t size);
+
+static guint64 allocations = 0;
+static guint64 allocated_bytes = 0;
+
+void*
+malloc (size_t size)
+{
+  allocations++;
+  allocated_bytes += size;
+  return __libc_malloc (size);
+}
+
+void*
+calloc (size_t count, size_t size)
+{
+  allocations++;
+  allocated_bytes += count * size;
+  return __libc_calloc (count, size);
+}
+
+void*
+realloc (void* pointer, size_t size)
+{
+  allocations++;
+  allocated_bytes += size;
+  return __libc_realloc (pointer, size);
+}
+
+#else
+
+#define COUNTS_ALLOCATIONS 0
+
+static guint64 allocations = 0;
+static guint64 allocated_bytes = 0;
+
+#endif
+
+/*----------------------------------------------------------------------------.
+ | INPUTS AND BENCHMARKS                                                      |
+ '----------------------------------------------------------------------------*/
+
+typedef struct
+{
+  char* name;
+  char* filename;
+
+  /* The size of the file, and the number of points in it. */
+  size_t bytes;
+  unsigned int points;
+
+  /* The parsed file, shared by the benchmarks that don't change it. */
+  GSList* data;
+  unsigned short seconds;
+} bench_input;
+
+typedef struct
+{
+  const char* name;
+
+  /* Prepares an iteration without being measured. May be NULL. */
+  gpointer (*prepare) (const bench_input* input);
+
+  /* Runs one measured iteration, and returns what should be freed. */
+  gpointer (*run) (const bench_input* input, gpointer prepared);
+
+  /* Frees what an iteration left behind without being measured. */
+  void (*finish) (gpointer prepared, gpointer result);
+} bench_case;
+
+/*----------------------------------------------------------------------------.
+ | PREPARE_COPY                                                               |
+ | opt_point_reduction_apply() removes points from the list it's given, so   |
+ | it gets a copy of the parsed file each time. The removed list items are   |
+ | freed by GLib, while the elements are kept in 'elements'.                 |
+ '----------------------------------------------------------------------------*/
+typedef struct
+{
+  GSList* list;
+  GSList* elements;
+} bench_copy;
+
+static gpointer
+prepare_copy (const bench_input* input)
+{
+  bench_copy* copy = g_new0 (bench_copy, 1);
+  GSList* iterator;
+
+  for (iterator = input->data; iterator != NULL; iterator = iterator->next)
+    {
+      size_t size = 0;
+      switch (((dt_element*)iterator->data)->type)
+	{
+	case TYPE_STROKE:     size = sizeof (dt_stroke);     break;
+	case TYPE_COORDINATE: size = sizeof (dt_coordinate); break;
+	case TYPE_TILT:       size = sizeof (dt_tilt);       break;
+	case TYPE_PRESSURE:   size = sizeof (dt_pressure);   break;
+	case TYPE_CLOCK:      size = sizeof (dt_clock);      break;
+	default:              continue;
+	}
+
+      void* element = malloc (size);
+      if (element == NULL) continue;
+
+      memcpy (element, iterator->data, size);
+      copy->elements = g_slist_prepend (copy->elements, element);
+    }
+
+  copy->elements = g_slist_reverse (copy->elements);
+  copy->list = g_slist_copy (copy->elements);
+  return copy;
+}
+
+static void
+finish_copy (gpointer prepared, gpointer result)
+{
+  bench_copy* copy = (bench_copy*)prepared;
+  (void)result;
+
+  g_slist_free (copy->list);
+  g_slist_free_full (copy->elements, free);
+  g_free (copy);
+}
+
+static gpointer
+run_parse (const bench_input* input, gpointer prepared)
+{
+  unsigned short seconds = 0;
+  (void)prepared;
+  return p_wpi_parse (input->filename, &seconds);
+}
+
+static void
+finish_parse (gpointer prepared, gpointer result)
+{
+  (void)prepared;
+  p_wpi_cleanup (result);
+}
+
+static gpointer
+run_metadata (const bench_input* input, gpointer prepared)
+{
+  (void)prepared;
+  return p_wpi_get_metadata (input->data);
+}
+
+static void
+finish_metadata (gpointer prepared, gpointer result)
+{
+  (void)prepared;
+  p_wpi_metadata_cleanup (result);
+}
+
+static gpointer
+run_point_reduction (const bench_input* input, gpointer prepared)
+{
+  bench_copy* copy = (bench_copy*)prepared;
+  (void)input;
+  opt_point_reduction_apply (copy->list);
+  return NULL;
+}
+
+static gpointer
+run_svg (const bench_input* input, gpointer prepared)
+{
+  (void)prepared;
+  settings.process_until = input->seconds;
+  return co_svg_create (input->data, "bench", &settings);
+}
+
+static gpointer
+run_json (const bench_input* input, gpointer prepared)
+{
+  (void)prepared;
+  return co_json_create (input->data);
+}
+
+static gpointer
+run_csv (const bench_input* input, gpointer prepared)
+{
+  (void)prepared;
+  return co_csv_create (input->data);
+}
+
+static gpointer
+run_wpi (const bench_input* input, gpointer prepared)
+{
+  size_t length = 0;
+  (void)prepared;
+  return co_wpi_create (input->data, &length);
+}
+
+static void
+finish_free (gpointer prepared, gpointer result)
+{
+  (void)prepared;
+  free (result);
+}
+
+static const bench_case cases[] = {
+  { "p_wpi_parse",               NULL,         run_parse,           finish_parse },
+  { "p_wpi_get_metadata",        NULL,         run_metadata,        finish_metadata },
+  { "opt_point_reduction_apply", prepare_copy, run_point_reduction, finish_copy },
+  { "co_svg_create",             NULL,         run_svg,             finish_free },
+  { "co_json_create",            NULL,         run_json,            finish_free },
+  { "co_csv_create",             NULL,         run_csv,             finish_free },
+  { "co_wpi_create",             NULL,         run_wpi,             finish_free }
+};
+
+/* The generated drawings. The seeds are fixed so that every run measures
+ * the same drawings. */
+static const struct
+{
+  const char* name;
+  bench_synthetic_options options;
+} synthetic_inputs[] = {
+  { "synthetic-small", { 1, 60,   1,  20, 100 } },
+  { "synthetic-large", { 2, 1800, 2, 250, 200 } }
+};
+
+/*----------------------------------------------------------------------------.
+ | PEAK_RSS                                                                   |
+ | This function returns the largest amount of memory the program used so    |
+ | far, in kilobytes.                                                         |
+ '----------------------------------------------------------------------------*/
+static long
+peak_rss ()
+{
+  struct rusage usage;
+  if (getrusage (RUSAGE_SELF, &usage) != 0) return 0;
+
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+/*----------------------------------------------------------------------------.
+ | LOAD_INPUT                                                                 |
+ | This function parses a WPI file once, to count its points and to share    |
+ | the result with the benchmarks that only read it.                          |
+ '----------------------------------------------------------------------------*/
+static int
+load_input (bench_input* input)
+{
+  struct stat info;
+  if (g_stat (input->filename, &info) != 0)
+    {
+      fprintf (stderr, "Cannot read '%s'.\n", input->filename);
+      return 1;
+    }
+
+  input->bytes = info.st_size;
+  input->data = p_wpi_parse (input->filename, &input->seconds);
+  if (input->data == NULL) return 1;
+
+  GSList* iterator;
+  for (iterator = input->data; iterator != NULL; iterator = iterator->next)
+    if (((dt_element*)iterator->data)->type == TYPE_COORDINATE)
+      input->points++;
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | RUN_CASE                                                                   |
+ | This function repeats a benchmark and writes the fastest iteration as a   |
+ | line of JSON.                                                              |
+ '----------------------------------------------------------------------------*/
+static void
+run_case (const bench_case* benchmark, const bench_input* input, int last)
+{
+  double best = 0;
+  double total = 0;
+  guint64 iteration_allocations = 0;
+  guint64 iteration_bytes = 0;
+  int iterations = 0;
+
+  while (iterations == 0
+	 || (total < MIN_TIME && iterations < MAX_ITERATIONS)
+	 || (iterations < MIN_ITERATIONS && total < MIN_TIME * MIN_ITERATIONS))
+    {
+      gpointer prepared = NULL;
+      if (benchmark->prepare != NULL)
+	prepared = benchmark->prepare (input);
+
+      guint64 allocations_before = allocations;
+      guint64 bytes_before = allocated_bytes;
+      gint64 start = g_get_monotonic_time ();
+
+      gpointer result = benchmark->run (input, prepared);
+
+      double elapsed = (g_get_monotonic_time () - start) / (double)G_USEC_PER_SEC;
+      iteration_allocations = allocations - allocations_before;
+      iteration_bytes = allocated_bytes - bytes_before;
+
+      benchmark->finish (prepared, result);
+
+      if (iterations == 0 || elapsed < best) best = elapsed;
+      total += elapsed;
+      iterations++;
+    }
+
+  /* Very fast benchmarks can finish within the resolution of the clock. */
+  if (best <= 0) best = 1.0 / G_USEC_PER_SEC;
+
+  printf ("    { \"benchmark\": \"%s\", \"input\": \"%s\", \"bytes\": %lu, "
+	  "\"points\": %u, \"iterations\": %d, \"seconds\": %.6f, "
+	  "\"mb_per_s\": %.3f, \"points_per_s\": %.0f, ",
+	  benchmark->name, input->name, (unsigned long)input->bytes,
+	  input->points, iterations, best, input->bytes / best / 1000000,
+	  input->points / best);
+
+  if (COUNTS_ALLOCATIONS)
+    printf ("\"allocations\": %llu, \"allocated_bytes\": %llu, ",
+	    (unsigned long long)iteration_allocations,
+	    (unsigned long long)iteration_bytes);
+  else
+    printf ("\"allocations\": null, \"allocated_bytes\": null, ");
+
+  printf ("\"peak_rss_kb\": %ld }%s\n", peak_rss (), last ? "" : ",");
+}
+
+/*----------------------------------------------------------------------------.
+ | MAIN                                                                       |
+ '----------------------------------------------------------------------------*/
+int
+main (int argc, char** argv)
+{
+  /* Older versions of GLib keep their own pools of memory, which would hide
+   * the allocations of the list items. */
+  g_setenv ("G_SLICE", "always-malloc", TRUE);
+
+  dt_configuration_parse_preset_dimensions ("A4", &settings);
+  settings.pressure_factor = 1.0;
+
+  size_t num_synthetic = G_N_ELEMENTS (synthetic_inputs);
+  size_t num_inputs = num_synthetic + (argc - 1);
+  bench_input* inputs = g_new0 (bench_input, num_inputs);
+  size_t index;
+  int status = 0;
+
+  /* The generated drawings are written to temporary WPI files, so that they
+   * go through the same steps as the files of the device. */
+  for (index = 0; index < num_synthetic; index++)
+    {
+      bench_input* input = &inputs[index];
+
+      int fd = g_file_open_tmp ("inklingreader-bench-XXXXXX.wpi",
+				&input->filename, NULL);
+      if (fd >= 0) close (fd);
+
+      input->name = g_strdup (synthetic_inputs[index].name);
+      if (fd < 0 || bench_synthetic_write_file (&synthetic_inputs[index].options,
+						input->filename, NULL) != 0)
+	{
+	  fprintf (stderr, "Cannot write the '%s' drawing.\n", input->name);
+	  status = 1;
+	}
+    }
+
+  for (index = num_synthetic; index < num_inputs; index++)
+    {
+      inputs[index].filename = g_strdup (argv[index - num_synthetic + 1]);
+      inputs[index].name = g_path_get_basename (inputs[index].filename);
+    }
+
+  for (index = 0; index < num_inputs && status == 0; index++)
+    status = load_input (&inputs[index]);
+
+  if (status == 0)
+    {
+      printf ("{\n  \"program\": \"inklingreader-bench\",\n"
+	      "  \"version\": \"%s\",\n  \"results\": [\n", PACKAGE_VERSION);
+
+      size_t number;
+      for (index = 0; index < num_inputs; index++)
+	for (number = 0; number < G_N_ELEMENTS (cases); number++)
+	  run_case (&cases[number], &inputs[index],
+		    index == num_inputs - 1 && number == G_N_ELEMENTS (cases) - 1);
+
+      printf ("  ]\n}\n");
+    }
+
+  for (index = 0; index < num_inputs; index++)
+    {
+      if (index < num_synthetic && inputs[index].filename != NULL)
+	g_unlink (inputs[index].filename);
+
+      p_wpi_cleanup (inputs[index].data);
+      g_free (inputs[index].filename);
+      g_free (inputs[index].name);
+    }
+
+  g_free (inputs);
+  dt_configuration_cleanup (&settings);
+
+  return status;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*----------------------------------------------------------------------------.
+ | GENERATOR                                                                  |
+ | -------------------------------------------------------------------------- |
+ |                                                                            |
+ | This program writes made-up WPI files of any size, to test how the other  |
+ | parts of InklingReader cope with large drawings. The same options always   |
+ | give the same file. Build it with "make inklingreader-generate".           |
+ '----------------------------------------------------------------------------*/
+
+#include "synthetic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <glib.h>
+
+/* The number of bytes a point takes in a WPI file: a coordinate, pressure
+ * and tilt block. A stroke adds a block to begin and one to end it. */
+#define POINT_LEN  18
+#define STROKE_LEN 6
+
+/*----------------------------------------------------------------------------.
+ | SHOW_HELP                                                                  |
+ '----------------------------------------------------------------------------*/
+static void
+show_help ()
+{
+  puts ("\nUsage: inklingreader-generate [OPTION]... --to FILE\n\n"
+	"Available options:\n"
+	"  --seed,     -s  The seed for the random numbers (default 1).\n"
+	"  --duration, -d  The number of seconds to spread the strokes over\n"
+	"                  (default 60, at most 65535).\n"
+	"  --strokes,  -n  The number of strokes (default 100).\n"
+	"  --points,   -p  The number of points in each stroke (default 100).\n"
+	"  --layers,   -l  The number of layers (default 1).\n"
+	"  --size,     -S  Choose the number of strokes to make a file of about\n"
+	"                  this size. Use K, M or G for kilo-, mega- or gigabytes.\n"
+	"  --to,       -t  The file to write to (or '-' for stdout).\n"
+	"  --help,     -h  Show this message.\n");
+}
+
+/*----------------------------------------------------------------------------.
+ | PARSE_SIZE                                                                 |
+ | This function reads a size like "512K" or "2G". It returns 0 for sizes it  |
+ | doesn't understand.                                                        |
+ '----------------------------------------------------------------------------*/
+static guint64
+parse_size (const char* text)
+{
+  char* end = NULL;
+  guint64 size = strtoull (text, &end, 10);
+
+  if (end == text) return 0;
+
+  switch (*end)
+    {
+    case 'k': case 'K': size <<= 10; end++; break;
+    case 'm': case 'M': size <<= 20; end++; break;
+    case 'g': case 'G': size <<= 30; end++; break;
+    }
+
+  return (*end == '\0') ? size : 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | MAIN                                                                       |
+ '----------------------------------------------------------------------------*/
+int
+main (int argc, char** argv)
+{
+  bench_synthetic_options options = { 1, 60, 1, 100, 100 };
+  const char* output = NULL;
+  guint64 size = 0;
+
+  static struct option long_options[] =
+    {
+      { "seed",     required_argument, 0, 's' },
+      { "duration", required_argument, 0, 'd' },
+      { "strokes",  required_argument, 0, 'n' },
+      { "points",   required_argument, 0, 'p' },
+      { "layers",   required_argument, 0, 'l' },
+      { "size",     required_argument, 0, 'S' },
+      { "to",       required_argument, 0, 't' },
+      { "help",     no_argument,       0, 'h' },
+      { 0,          0,                 0, 0   }
+    };
+
+  int arg, index = 0;
+  while ((arg = getopt_long (argc, argv, "s:d:n:p:l:S:t:h",
+			     long_options, &index)) != -1)
+    {
+      switch (arg)
+	{
+	case 's': options.seed = strtoul (optarg, NULL, 10); break;
+	case 'd': options.duration = atoi (optarg); break;
+	case 'n': options.strokes = strtoull (optarg, NULL, 10); break;
+	case 'p': options.points = atoi (optarg); break;
+	case 'l': options.layers = atoi (optarg); break;
+	case 't': output = optarg; break;
+	case 'S':
+	  size = parse_size (optarg);
+	  if (size == 0)
+	    {
+	      printf ("'%s' is not a size.\n", optarg);
+	      return 1;
+	    }
+	  break;
+	case 'h':
+	  show_help ();
+	  return 0;
+	default:
+	  return 1;
+	}
+    }
+
+  if (output == NULL)
+    {
+      puts ("Please specify the file to write to with --to.");
+      return 1;
+    }
+
+  if (options.points == 0 || options.layers == 0)
+    {
+      puts ("Each stroke needs a point and the drawing needs a layer.");
+      return 1;
+    }
+
+  if (size > 0)
+    {
+      guint64 stroke_length = (guint64)options.points * POINT_LEN + STROKE_LEN;
+      options.strokes = MAX (1, size / stroke_length);
+    }
+
+  if (options.layers > options.strokes)
+    options.layers = options.strokes;
+
+  guint64 length;
+  if (bench_synthetic_write_file (&options, output, &length) != 0)
+    {
+      fprintf (stderr, "Couldn't generate '%s'.\n", output);
+      return 1;
+    }
+
+  /* Don't mix the summary into the WPI data on stdout. */
+  fprintf ((strcmp (output, "-")) ? stdout : stderr,
+	   "Wrote %" G_GUINT64_FORMAT " strokes of %u points (%" G_GUINT64_FORMAT
+	   " bytes) to '%s'.\n", options.strokes, options.points, length, output);
+
+  return 0;
+}
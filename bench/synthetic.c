@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "synthetic.h"
+#include "../src/datatypes/clock.h"
+#include "../src/converters/wpi.h"
+#include "../src/parsers/wpi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* The area of the page the strokes are drawn in, in the units of the
+ * device. */
+#define PAGE_LEFT   -6000
+#define PAGE_RIGHT   6000
+#define PAGE_TOP      500
+#define PAGE_BOTTOM 17000
+
+/* The distance between two points of a stroke. */
+#define STEP 12.0
+
+/* The clock block stores the seconds in 16 bits. */
+#define MAX_DURATION 65535
+
+/* The number of bytes written to a file at once. */
+#define WRITE_BUFFER_LEN 65536
+
+/*----------------------------------------------------------------------------.
+ | BENCH_SYNTHETIC_STROKE                                                     |
+ '----------------------------------------------------------------------------*/
+static void
+bench_synthetic_stroke (unsigned char value, bench_synthetic_callback callback,
+			void* user_data)
+{
+  dt_stroke stroke;
+  stroke.type = TYPE_STROKE;
+  stroke.value = value;
+  callback ((dt_element*)&stroke, user_data);
+}
+
+/*----------------------------------------------------------------------------.
+ | BENCH_SYNTHETIC_GENERATE                                                   |
+ '----------------------------------------------------------------------------*/
+unsigned short
+bench_synthetic_generate (const bench_synthetic_options* options,
+			  bench_synthetic_callback callback, void* user_data)
+{
+  GRand* random = g_rand_new_with_seed (options->seed);
+
+  guint64 total = options->strokes * options->points;
+  unsigned int duration = MIN (options->duration, MAX_DURATION);
+  double interval = (total > 0) ? (double)duration / total : 0;
+  guint64 point_number = 0;
+  unsigned int layer = 0;
+  int clock = -1;
+
+  guint64 stroke;
+  unsigned int point;
+  for (stroke = 0; stroke < options->strokes; stroke++)
+    {
+      /* Spread the strokes evenly over the layers. */
+      if (options->layers > 1
+	  && stroke * options->layers / options->strokes != layer)
+	{
+	  bench_synthetic_stroke (NEW_LAYER, callback, user_data);
+	  layer++;
+	}
+
+      double x = g_rand_double_range (random, PAGE_LEFT, PAGE_RIGHT);
+      double y = g_rand_double_range (random, PAGE_TOP, PAGE_BOTTOM);
+      double angle = g_rand_double_range (random, 0, 2 * G_PI);
+      int tilt_x = g_rand_int_range (random, 20, 60);
+      int tilt_y = g_rand_int_range (random, 20, 60);
+
+      bench_synthetic_stroke (BEGIN_STROKE, callback, user_data);
+
+      for (point = 0; point < options->points; point++, point_number++)
+	{
+	  double time = point_number * interval;
+
+	  /* Add a clock block for each second that passed, like the device
+	   * does. */
+	  if ((int)time != clock)
+	    {
+	      dt_clock element;
+	      element.type = TYPE_CLOCK;
+	      element.counter = (unsigned short)time;
+	      callback ((dt_element*)&element, user_data);
+	      clock = (int)time;
+	    }
+
+	  /* Turn a little, and turn around at the edges of the page. */
+	  angle += g_rand_double_range (random, -0.3, 0.3);
+	  x += STEP * cos (angle);
+	  y += STEP * sin (angle);
+	  if (x < PAGE_LEFT || x > PAGE_RIGHT || y < PAGE_TOP || y > PAGE_BOTTOM)
+	    {
+	      angle += G_PI;
+	      x = CLAMP (x, PAGE_LEFT, PAGE_RIGHT);
+	      y = CLAMP (y, PAGE_TOP, PAGE_BOTTOM);
+	    }
+
+	  /* Only use positions the WPI format can store exactly. */
+	  dt_coordinate coordinate;
+	  memset (&coordinate, 0, sizeof (dt_coordinate));
+	  coordinate.type = TYPE_COORDINATE;
+	  coordinate.x = (int)x;
+	  coordinate.y = ((int)y & ~1) + 5;
+	  coordinate.time = time;
+	  callback ((dt_element*)&coordinate, user_data);
+
+	  /* The pressure rises at the start and falls at the end. */
+	  double position = (point + 0.5) / options->points;
+	  dt_pressure pressure;
+	  pressure.type = TYPE_PRESSURE;
+	  pressure.pressure = 200 + (int)(800 * sin (G_PI * position))
+	    + g_rand_int_range (random, -20, 20);
+	  callback ((dt_element*)&pressure, user_data);
+
+	  tilt_x = CLAMP (tilt_x + g_rand_int_range (random, -1, 2), 0, 90);
+	  tilt_y = CLAMP (tilt_y + g_rand_int_range (random, -1, 2), 0, 90);
+
+	  dt_tilt tilt;
+	  tilt.type = TYPE_TILT;
+	  tilt.x = tilt_x;
+	  tilt.y = tilt_y;
+	  callback ((dt_element*)&tilt, user_data);
+	}
+
+      bench_synthetic_stroke (END_STROKE, callback, user_data);
+    }
+
+  g_rand_free (random);
+  return (clock < 0) ? 0 : (unsigned short)clock;
+}
+
+/*----------------------------------------------------------------------------.
+ | WRITING FILES                                                              |
+ | The blocks are collected in a buffer that is written when it's full.      |
+ '----------------------------------------------------------------------------*/
+
+typedef struct
+{
+  FILE* file;
+  unsigned char buffer[WRITE_BUFFER_LEN];
+  size_t used;
+  guint64 length;
+  int failed;
+} bench_synthetic_writer;
+
+static void
+bench_synthetic_flush (bench_synthetic_writer* writer)
+{
+  if (writer->used > 0
+      && fwrite (writer->buffer, 1, writer->used, writer->file) != writer->used)
+    writer->failed = 1;
+
+  writer->length += writer->used;
+  writer->used = 0;
+}
+
+static void
+bench_synthetic_write_element (const dt_element* element, void* user_data)
+{
+  bench_synthetic_writer* writer = (bench_synthetic_writer*)user_data;
+
+  if (writer->used + CO_WPI_MAX_BLOCK_LEN > WRITE_BUFFER_LEN)
+    bench_synthetic_flush (writer);
+
+  writer->used += co_wpi_encode_element (element, writer->buffer + writer->used);
+}
+
+/*----------------------------------------------------------------------------.
+ | BENCH_SYNTHETIC_WRITE_FILE                                                 |
+ '----------------------------------------------------------------------------*/
+int
+bench_synthetic_write_file (const bench_synthetic_options* options,
+			    const char* filename, guint64* length)
+{
+  bench_synthetic_writer* writer = calloc (1, sizeof (bench_synthetic_writer));
+  if (writer == NULL) return 1;
+
+  if (!strcmp (filename, "-"))
+    writer->file = stdout;
+  else
+    writer->file = fopen (filename, "wb");
+
+  if (writer->file == NULL)
+    {
+      fprintf (stderr, "Couldn't write to '%s'.\n", filename);
+      free (writer);
+      return 1;
+    }
+
+  int status = co_wpi_write_preamble (writer->buffer);
+  writer->used = WPI_PREAMBLE_LEN;
+
+  if (status == 0)
+    {
+      bench_synthetic_generate (options, bench_synthetic_write_element, writer);
+      bench_synthetic_flush (writer);
+      status = writer->failed;
+    }
+
+  if (writer->file == stdout)
+    {
+      if (fflush (stdout) != 0) status = 1;
+    }
+  else if (fclose (writer->file) != 0)
+    status = 1;
+
+  if (length != NULL) *length = writer->length;
+
+  free (writer);
+  return status;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file   bench/synthetic.h
+ * @brief  Generate drawings to measure the parser and converters with.
+ * @author Roel Janssen
+ */
+
+#ifndef BENCH_SYNTHETIC_H
+#define BENCH_SYNTHETIC_H
+
+#include <glib.h>
+#include "../src/datatypes/element.h"
+
+/**
+ * This struct describes the drawing to generate. The same options and seed
+ * always give the same drawing.
+ */
+typedef struct
+{
+  guint32 seed;
+
+  /* The number of seconds the strokes are spread over, at most 65535. */
+  unsigned int duration;
+
+  unsigned int layers;
+
+  /* The number of strokes in the whole drawing, spread over the layers. */
+  guint64 strokes;
+
+  /* The number of points in each stroke. */
+  unsigned int points;
+} bench_synthetic_options;
+
+/**
+ * The function bench_synthetic_generate() calls for each element.
+ * @param element   The element. It's only valid during the call.
+ * @param user_data The data given to bench_synthetic_generate().
+ */
+typedef void (*bench_synthetic_callback) (const dt_element* element,
+					  void* user_data);
+
+/**
+ * This function generates a drawing one element at a time, in the order
+ * p_wpi_parse() would return them. Each stroke wanders across the page with
+ * a pressure that rises and falls, like a real pen would. Nothing is kept
+ * in memory, so drawings of any size can be generated.
+ * @param options   The drawing to generate.
+ * @param callback  The function to call for each element.
+ * @param user_data Passed along to 'callback'.
+ * @return The last clock value in the drawing.
+ */
+unsigned short bench_synthetic_generate (const bench_synthetic_options* options,
+					 bench_synthetic_callback callback,
+					 void* user_data);
+
+/**
+ * This function writes a generated drawing to a WPI file.
+ * @param options  The drawing to generate.
+ * @param filename The file to write to, or "-" for the standard output.
+ * @param length   Is set to the number of bytes written. May be NULL.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int bench_synthetic_write_file (const bench_synthetic_options* options,
+				const char* filename, guint64* length);
+
+#endif//BENCH_SYNTHETIC_H
@@ -22,10 +22,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <locale.h>
+#include "numeric-locale.h"
 #include "../datatypes/configuration.h"
 #include "../datatypes/element.h"
-#include "../datatypes/clock.h"
 
 extern dt_configuration settings;
 
@@ -68,12 +67,13 @@ co_csv_create (GSList* data)
 {
   /* Floating-point numbers should be written with a dot instead of a comma.
    * To ensure that this happens, (temporarily) set the locale to the "C"
-   * locale for this program. */
-  setlocale (LC_NUMERIC, "C");
+   * locale for this thread. */
+  co_numeric_locale previous_locale = co_numeric_locale_begin ();
 
   if (g_slist_length (data) == 0)
     {
       printf ("%s: No useful data was found in the file.\r\n", __func__);
+      co_numeric_locale_end (previous_locale);
       return NULL;
     }
 
@@ -88,6 +88,7 @@ co_csv_create (GSList* data)
   if (output == NULL)
     {
       printf ("%s: Couldn't allocate enough memory.\r\n", __func__);
+      co_numeric_locale_end (previous_locale);
       return NULL;
     }
 
@@ -99,9 +100,7 @@ co_csv_create (GSList* data)
   /*--------------------------------------------------------------------------.
    | COUNTING VARIABLES                                                       |
    '--------------------------------------------------------------------------*/
-  unsigned short time = 0;
-  double subtime = 0;
-  dt_coordinate prev = { TYPE_COORDINATE, 0, 0, 0 };
+  dt_coordinate prev = { TYPE_COORDINATE, 0, 0, 0, 0 };
 
   GSList* stroke_data = NULL; 
 
@@ -168,21 +167,9 @@ co_csv_create (GSList* data)
 		written += sprintf (output + written, ",,");
 	      }
 	    
-	    written += sprintf (output + written, ", %f\n", time + subtime);
+	    written += sprintf (output + written, ", %f\n", c->time);
 
 	    prev.x = x, prev.y = y;
-	    subtime += CLOCK_FREQUENCY;
-	  }
-	  break;
-
-	  /*------------------------------------------------------------------.
-	   | CLOCK DESCRIPTOR                                                 |
-	   '------------------------------------------------------------------*/
-	case TYPE_CLOCK:
-	  {
-	    dt_clock* c = (dt_clock *)e;
-	    time = c->counter;
-	    subtime = 0;
 	  }
 	  break;
 
@@ -198,8 +185,8 @@ co_csv_create (GSList* data)
   g_slist_free (data);
   data = NULL;
 
-  /* Reset to default locale settings. */
-  setlocale (LC_NUMERIC, "");
+  /* Reset to the previous locale settings. */
+  co_numeric_locale_end (previous_locale);
 
   return output;
 }
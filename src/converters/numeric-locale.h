@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   converters/numeric-locale.h
+ * @brief  Helpers to write floating-point numbers with a dot, even when
+ *         several conversions run at the same time.
+ * @author Roel Janssen
+ */
+
+#ifndef CONVERTERS_NUMERIC_LOCALE_H
+#define CONVERTERS_NUMERIC_LOCALE_H
+
+#include <glib.h>
+#include <locale.h>
+
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+/*----------------------------------------------------------------------------.
+ | The converters must write floating-point numbers with a dot instead of a   |
+ | comma. setlocale() changes the locale of the whole process, which breaks   |
+ | when conversions run in worker threads. Where available, uselocale() is    |
+ | used to only change the locale of the calling thread.                      |
+ '----------------------------------------------------------------------------*/
+
+#ifndef _WIN32
+
+typedef locale_t co_numeric_locale;
+
+/**
+ * This function switches the calling thread to the "C" numeric locale.
+ * @return The previous locale, to be passed to co_numeric_locale_end().
+ */
+static inline co_numeric_locale
+co_numeric_locale_begin ()
+{
+  /* Only LC_NUMERIC changes; the other categories are copied from the
+   * global locale. */
+  static gsize c_locale = 0;
+  if (g_once_init_enter (&c_locale))
+    g_once_init_leave (&c_locale,
+		       (gsize)newlocale (LC_NUMERIC_MASK, "C",
+					 duplocale (LC_GLOBAL_LOCALE)));
+
+  return uselocale ((locale_t)c_locale);
+}
+
+/**
+ * This function restores the locale that was active before calling
+ * co_numeric_locale_begin().
+ * @param previous The value returned by co_numeric_locale_begin().
+ */
+static inline void
+co_numeric_locale_end (co_numeric_locale previous)
+{
+  uselocale (previous);
+}
+
+#else
+
+typedef int co_numeric_locale;
+
+static inline co_numeric_locale
+co_numeric_locale_begin ()
+{
+  setlocale (LC_NUMERIC, "C");
+  return 0;
+}
+
+static inline void
+co_numeric_locale_end (co_numeric_locale previous)
+{
+  (void)previous;
+  setlocale (LC_NUMERIC, "");
+}
+
+#endif
+
+#endif//CONVERTERS_NUMERIC_LOCALE_H
@@ -21,8 +21,10 @@
 #include <librsvg/rsvg.h>
 #include <cairo.h>
 #include <cairo-pdf.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../datatypes/configuration.h"
+#include "render.h"
 
 #define PT_TO_MM 2.8333
 
@@ -36,12 +38,38 @@ extern dt_configuration settings;
 int
 co_pdf_export_to_file (const char* filename, const char* svg_data)
 {
+  dt_stats_mark mark;
+  dt_stats_start (settings.stats, &mark);
   RsvgHandle* handle = rsvg_handle_new_from_data ((unsigned char*)svg_data, 
 						  strlen (svg_data), NULL);
+  dt_stats_stop (settings.stats, "rsvg", &mark, 0, 0);
 
   return co_pdf_export_to_file_from_handle (filename, handle);
 }
 
+/*----------------------------------------------------------------------------.
+ | CO_PDF_RENDER                                                              |
+ | This function renders an RsvgHandle on a single page of a PDF surface.     |
+ | Cairo writes the PDF data while rendering, so that is measured as a whole. |
+ '----------------------------------------------------------------------------*/
+static int
+co_pdf_render (cairo_surface_t* surface, RsvgHandle* handle, dt_stats* stats,
+	       const dt_stats_mark* mark)
+{
+  cairo_t* cr = cairo_create (surface);
+  rsvg_handle_render_cairo (handle, cr);
+  cairo_surface_show_page (surface);
+  cairo_surface_finish (surface);
+
+  int status = (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS);
+
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
+
+  dt_stats_stop (stats, "pdf", mark, 0, 0);
+  return status;
+}
+
 /*----------------------------------------------------------------------------.
  | CO_PDF_EXPORT_TO_FILE_FROM_HANDLE                                          |
  | This function handles the exporting to PDF using Cairo. Returns 0 when     |
@@ -50,19 +78,113 @@ co_pdf_export_to_file (const char* filename, const char* svg_data)
 int
 co_pdf_export_to_file_from_handle (const char* filename, RsvgHandle* handle)
 {
-  int status = 0;
+  dt_stats_mark mark;
+  dt_stats_start (settings.stats, &mark);
 
   cairo_surface_t* surface = NULL;
   surface = cairo_pdf_surface_create (filename, settings.page.width * PT_TO_MM * 1.25, 
 				      settings.page.height * PT_TO_MM * 1.25);
 
-  cairo_t* cr = cairo_create (surface);
-  rsvg_handle_render_cairo (handle, cr);
-  cairo_surface_show_page (surface);
-  cairo_surface_finish (surface);
+  return co_pdf_render (surface, handle, settings.stats, &mark);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PDF_EXPORT_TO_STREAM                                                    |
+ | This function does the same as co_pdf_export_to_file_from_handle(), but    |
+ | passes the PDF data to 'write_func' instead of writing it to a file.       |
+ '----------------------------------------------------------------------------*/
+int
+co_pdf_export_to_stream (cairo_write_func_t write_func, void* closure,
+			 RsvgHandle* handle, dt_configuration* config)
+{
+  dt_stats_mark mark;
+  dt_stats_start (config->stats, &mark);
+
+  cairo_surface_t* surface = NULL;
+  surface = cairo_pdf_surface_create_for_stream (write_func, closure,
+						 config->page.width * PT_TO_MM * 1.25,
+						 config->page.height * PT_TO_MM * 1.25);
+
+  return co_pdf_render (surface, handle, config->stats, &mark);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PDF_BOOK_NEW                                                            |
+ '----------------------------------------------------------------------------*/
+co_pdf_book*
+co_pdf_book_new (const char* filename, dt_stats* stats)
+{
+  co_pdf_book* book = calloc (1, sizeof (co_pdf_book));
+  if (book == NULL) return NULL;
+
+  book->filename = g_strdup (filename);
+  book->stats = stats;
+
+  return book;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PDF_BOOK_ADD_PAGE                                                       |
+ | Cairo writes the drawing commands of a page to the file when the page is   |
+ | shown, so only the page that is being drawn is kept in memory.             |
+ '----------------------------------------------------------------------------*/
+int
+co_pdf_book_add_page (co_pdf_book* book, const dt_document* document,
+		      const dt_configuration* config, int layer)
+{
+  double width = config->page.width * PT_TO_MM * 1.25;
+  double height = config->page.height * PT_TO_MM * 1.25;
+
+  dt_stats_mark mark;
+  dt_stats_start (book->stats, &mark);
 
+  /* The size of the first page is passed when creating the surface. The
+   * size of the pages after it has to be set before drawing on them. */
+  if (book->surface == NULL)
+    book->surface = cairo_pdf_surface_create (book->filename, width, height);
+  else
+    cairo_pdf_surface_set_size (book->surface, width, height);
+
+  /* One unit of the SVG document takes up one point, like when rendering
+   * the SVG data with librsvg. */
+  cairo_t* cr = cairo_create (book->surface);
+  if (layer < 0)
+    co_render_document (cr, document, config, 1.0);
+  else
+    co_render_layer (cr, document, config, 1.0, layer);
+
+  cairo_show_page (cr);
   cairo_destroy (cr);
-  cairo_surface_destroy (surface);
+
+  int status = (cairo_surface_status (book->surface) != CAIRO_STATUS_SUCCESS);
+  if (status == 0)
+    book->num_pages++;
+
+  dt_stats_stop (book->stats, "pdf", &mark,
+		 (document != NULL) ? document->num_strokes : 0,
+		 (document != NULL) ? document->num_points : 0);
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PDF_BOOK_CLOSE                                                          |
+ '----------------------------------------------------------------------------*/
+int
+co_pdf_book_close (co_pdf_book* book)
+{
+  if (book == NULL) return 1;
+
+  int status = 1;
+  if (book->surface != NULL)
+    {
+      cairo_surface_finish (book->surface);
+      status = (cairo_surface_status (book->surface) != CAIRO_STATUS_SUCCESS
+		|| book->num_pages == 0);
+      cairo_surface_destroy (book->surface);
+    }
+
+  g_free (book->filename);
+  free (book);
 
   return status;
 }
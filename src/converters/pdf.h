@@ -28,6 +28,9 @@
 
 #include <glib.h>
 #include <librsvg/rsvg.h>
+#include <cairo.h>
+#include "../datatypes/configuration.h"
+#include "../datatypes/document.h"
 
 /**
  * This function converts SVG data to a PDF document.
@@ -46,4 +49,59 @@ int co_pdf_export_to_file (const char* filename, const char* svg_data);
  */
 int co_pdf_export_to_file_from_handle (const char* filename, RsvgHandle* handle);
 
+/**
+ * This function converts an RsvgHandle to a PDF document and passes the
+ * result to a cairo write function, so it can be written anywhere.
+ * @param write_func The function that receives the PDF data.
+ * @param closure    User data to pass to 'write_func'.
+ * @param handle     An existing RsvgHandle to use for exporting.
+ * @param config     The settings to take the page dimensions from.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int co_pdf_export_to_stream (cairo_write_func_t write_func, void* closure,
+                              RsvgHandle* handle, dt_configuration* config);
+
+/**
+ * This struct is a PDF document to which pages are added one by one. Each
+ * page is written out as soon as it has been drawn, so the memory usage does
+ * not depend on the number of pages.
+ */
+typedef struct
+{
+  char* filename;
+  cairo_surface_t* surface;
+  unsigned int num_pages;
+  dt_stats* stats;
+} co_pdf_book;
+
+/**
+ * This function prepares a PDF document with multiple pages. The file is
+ * created when the first page is added.
+ * @param filename The path of the file to write to.
+ * @param stats    The statistics to record each page in, or NULL.
+ * @return A newly allocated book, to be closed with co_pdf_book_close().
+ */
+co_pdf_book* co_pdf_book_new (const char* filename, dt_stats* stats);
+
+/**
+ * This function draws a document on a new page, without going through SVG
+ * (see co_render_document()). The page takes the dimensions of 'config'.
+ * @param book     The book to add the page to.
+ * @param document The document to draw.
+ * @param config   The colors, background, page size and pressure factor.
+ * @param layer    The 0-based index of the layer to draw, or -1 to draw all
+ *                 layers.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int co_pdf_book_add_page (co_pdf_book* book, const dt_document* document,
+			  const dt_configuration* config, int layer);
+
+/**
+ * This function finishes the PDF document and frees the book.
+ * @param book The book to close.
+ * @return 0 when the PDF document was written, 1 when something went wrong
+ *         or when no page was added.
+ */
+int co_pdf_book_close (co_pdf_book* book);
+
 #endif//CONVERTERS_PDF_H
@@ -20,10 +20,55 @@
 #include "png.h"
 #include <librsvg/rsvg.h>
 #include <cairo.h>
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../datatypes/configuration.h"
+#include "render.h"
 
 #define PT_TO_MM 2.8333
+#define MM_TO_PT 3.5433
+
+/* At this resolution, one unit of the SVG document takes up one pixel. This
+ * is what librsvg uses. */
+#define DEFAULT_DPI 90.0
+
+/* The number of rows that a thread draws at once. */
+#define BAND_HEIGHT 128
+
+/* A horizontal band of the image. 'surface' is set when it has been drawn. */
+typedef struct
+{
+  int top;
+  int rows;
+  cairo_surface_t* surface;
+} co_png_band;
+
+/* Where libpng passes the PNG data to. */
+typedef struct
+{
+  cairo_write_func_t write_func;
+  void* closure;
+} co_png_output;
+
+/* The state that is shared between the threads that draw the bands. */
+typedef struct
+{
+  const dt_document* document;
+  const dt_configuration* config;
+  const dt_rectangle* area;
+  double ratio;
+  int width;
+  int height;
+  double dpi;
+  co_png_band* bands;
+  unsigned int num_bands;
+  unsigned int num_threads;
+  GThreadPool* pool;
+  GMutex lock;
+  GCond drawn;
+} co_png_image;
 
 extern dt_configuration settings;
 
@@ -35,12 +80,38 @@ extern dt_configuration settings;
 int
 co_png_export_to_file (const char* filename, const char* svg_data)
 {
+  dt_stats_mark mark;
+  dt_stats_start (settings.stats, &mark);
   RsvgHandle* handle = rsvg_handle_new_from_data ((unsigned char*)svg_data, 
 						  strlen (svg_data), NULL);
+  dt_stats_stop (settings.stats, "rsvg", &mark, 0, 0);
 
   return co_png_export_to_file_from_handle (filename, handle);
 }
 
+/*----------------------------------------------------------------------------.
+ | CO_PNG_RENDER                                                              |
+ | This function renders an RsvgHandle to an image surface of the page size.  |
+ '----------------------------------------------------------------------------*/
+static cairo_surface_t*
+co_png_render (RsvgHandle* handle, dt_page_dimensions* page, dt_stats* stats)
+{
+  dt_stats_mark mark;
+  dt_stats_start (stats, &mark);
+
+  cairo_surface_t* surface = NULL;
+  surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, 
+					page->width * PT_TO_MM * 1.25, 
+					page->height * PT_TO_MM * 1.25);
+
+  cairo_t* cr = cairo_create (surface);
+  rsvg_handle_render_cairo (handle, cr);
+  cairo_destroy (cr);
+
+  dt_stats_stop (stats, "rasterize", &mark, 0, 0);
+  return surface;
+}
+
 /*----------------------------------------------------------------------------.
  | CO_PNG_EXPORT_TO_FILE_FROM_HANDLE                                          |
  | This function handles the exporting to PNG using Cairo. Returns 0 when     |
@@ -50,18 +121,303 @@ int
 co_png_export_to_file_from_handle (const char* filename, RsvgHandle* handle)
 {
   int status = 0;
+  dt_stats_mark mark;
 
-  cairo_surface_t* surface = NULL;
-  surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, 
-					settings.page.width * PT_TO_MM * 1.25, 
-					settings.page.height * PT_TO_MM * 1.25);
+  cairo_surface_t* surface = co_png_render (handle, &settings.page, settings.stats);
 
-  cairo_t* cr = cairo_create (surface);
-  rsvg_handle_render_cairo (handle, cr);
+  dt_stats_start (settings.stats, &mark);
   status = cairo_surface_write_to_png (surface, filename);
+  dt_stats_stop (settings.stats, "png-encode", &mark, 0, 0);
+
+  cairo_surface_destroy (surface);
+
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PNG_EXPORT_TO_STREAM                                                    |
+ | This function does the same as co_png_export_to_file_from_handle(), but    |
+ | passes the PNG data to 'write_func' instead of writing it to a file.       |
+ '----------------------------------------------------------------------------*/
+int
+co_png_export_to_stream (cairo_write_func_t write_func, void* closure,
+			 RsvgHandle* handle, dt_configuration* config)
+{
+  int status = 0;
+  dt_stats_mark mark;
+
+  cairo_surface_t* surface = co_png_render (handle, &config->page, config->stats);
+
+  dt_stats_start (config->stats, &mark);
+  status = cairo_surface_write_to_png_stream (surface, write_func, closure);
+  dt_stats_stop (config->stats, "png-encode", &mark, 0, 0);
 
-  cairo_destroy (cr);
   cairo_surface_destroy (surface);
 
+  return (status != CAIRO_STATUS_SUCCESS);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PNG_EXPORT_REGION_TO_FILE                                               |
+ '----------------------------------------------------------------------------*/
+int
+co_png_export_region_to_file (const char* filename, const dt_document* document,
+			      dt_configuration* config, const dt_rectangle* region)
+{
+  return co_png_export_document_to_file (filename, document, config, region);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PNG_DRAW_BAND                                                           |
+ | This function runs in a worker thread and draws one band of the image.     |
+ | co_render_document() only looks at the strokes whose bounds overlap the   |
+ | band.                                                                      |
+ '----------------------------------------------------------------------------*/
+static void
+co_png_draw_band (gpointer data, gpointer user_data)
+{
+  co_png_band* band = (co_png_band*)data;
+  co_png_image* image = (co_png_image*)user_data;
+
+  dt_stats_name_thread (image->config->stats, "png");
+
+  dt_stats_mark mark;
+  dt_stats_start (image->config->stats, &mark);
+
+  cairo_surface_t* surface = NULL;
+  surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, image->width, band->rows);
+
+  cairo_t* cr = cairo_create (surface);
+  cairo_translate (cr, 0, -band->top);
+  cairo_scale (cr, image->ratio, image->ratio);
+  cairo_translate (cr, -image->area->x1 * MM_TO_PT, -image->area->y1 * MM_TO_PT);
+  co_render_document (cr, image->document, image->config, image->ratio);
+  cairo_destroy (cr);
+
+  cairo_surface_flush (surface);
+
+  dt_stats_stop (image->config->stats, "rasterize", &mark, 0, 0);
+
+  g_mutex_lock (&image->lock);
+  band->surface = surface;
+  g_cond_broadcast (&image->drawn);
+  g_mutex_unlock (&image->lock);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PNG_WRITE_DATA                                                          |
+ | This function passes the data that libpng produces to the write function.  |
+ '----------------------------------------------------------------------------*/
+static void
+co_png_write_data (png_structp png, png_bytep data, png_size_t length)
+{
+  co_png_output* output = (co_png_output*)png_get_io_ptr (png);
+  if (output->write_func (output->closure, data, length) != CAIRO_STATUS_SUCCESS)
+    png_error (png, "Couldn't write the PNG data.");
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PNG_FLUSH_DATA                                                          |
+ '----------------------------------------------------------------------------*/
+static void
+co_png_flush_data (png_structp png)
+{
+  (void)png;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PNG_WRITE_BANDS                                                         |
+ | This function hands the bands over to the threads and compresses them in   |
+ | order. While a band is being compressed, the threads draw the bands after  |
+ | it. When libpng runs into an error, it jumps back to setjmp() and the      |
+ | bands that are still being drawn are left to the caller.                   |
+ '----------------------------------------------------------------------------*/
+static int
+co_png_write_bands (png_structp png, png_infop info, co_png_image* image,
+		    unsigned char* row)
+{
+  if (setjmp (png_jmpbuf (png)))
+    return 1;
+
+  png_set_IHDR (png, info, image->width, image->height, 8, PNG_COLOR_TYPE_RGB,
+		PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+		PNG_FILTER_TYPE_DEFAULT);
+
+  /* Let other programs know how large the image should be printed. */
+  png_uint_32 per_meter = image->dpi / 0.0254 + 0.5;
+  png_set_pHYs (png, info, per_meter, per_meter, PNG_RESOLUTION_METER);
+  png_write_info (png, info);
+
+  dt_stats* stats = image->config->stats;
+  unsigned int next = 0;
+  unsigned int index = 0;
+  for (; index < image->num_bands; index++)
+    {
+      /* Keep each thread busy with one band, next to the one that is being
+       * compressed. */
+      for (; next < image->num_bands && next <= index + image->num_threads; next++)
+	g_thread_pool_push (image->pool, &image->bands[next], NULL);
+
+      co_png_band* band = &image->bands[index];
+
+      g_mutex_lock (&image->lock);
+      while (band->surface == NULL)
+	g_cond_wait (&image->drawn, &image->lock);
+      g_mutex_unlock (&image->lock);
+
+      if (cairo_surface_status (band->surface) != CAIRO_STATUS_SUCCESS)
+	return 1;
+
+      dt_stats_mark mark;
+      dt_stats_start (stats, &mark);
+
+      /* Cairo keeps each pixel as a 32-bit number in native byte order. */
+      const unsigned char* data = cairo_image_surface_get_data (band->surface);
+      int stride = cairo_image_surface_get_stride (band->surface);
+      int y = 0;
+      for (; y < band->rows; y++)
+	{
+	  const guint32* pixels = (const guint32*)(data + y * stride);
+	  int x = 0;
+	  for (; x < image->width; x++)
+	    {
+	      row[x * 3]     = (pixels[x] >> 16) & 0xff;
+	      row[x * 3 + 1] = (pixels[x] >> 8) & 0xff;
+	      row[x * 3 + 2] = pixels[x] & 0xff;
+	    }
+
+	  png_write_row (png, row);
+	}
+
+      dt_stats_stop (stats, "png-encode", &mark, 0, 0);
+
+      cairo_surface_destroy (band->surface);
+      band->surface = NULL;
+    }
+
+  png_write_end (png, info);
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PNG_EXPORT_DOCUMENT_TO_STREAM                                           |
+ '----------------------------------------------------------------------------*/
+int
+co_png_export_document_to_stream (cairo_write_func_t write_func, void* closure,
+				  const dt_document* document, dt_configuration* config,
+				  const dt_rectangle* region)
+{
+  /* Make sure we have valid dimensions. */
+  if (config->page.measurement == NULL)
+    dt_configuration_parse_dimensions (NULL, config);
+
+  dt_rectangle page = { 0, 0, config->page.width, config->page.height };
+  co_png_image image;
+  memset (&image, 0, sizeof (co_png_image));
+
+  image.document = document;
+  image.config = config;
+  image.area = (region != NULL) ? region : &page;
+  image.dpi = (config->dpi > 0) ? config->dpi : DEFAULT_DPI;
+
+  /* One unit of the SVG document takes up this many pixels. */
+  double scale = image.dpi / DEFAULT_DPI;
+  image.ratio = PT_TO_MM * 1.25 / MM_TO_PT * scale;
+  image.width = (image.area->x2 - image.area->x1) * PT_TO_MM * 1.25 * scale;
+  image.height = (image.area->y2 - image.area->y1) * PT_TO_MM * 1.25 * scale;
+  if (image.width <= 0 || image.height <= 0)
+    {
+      if (region != NULL)
+	puts ("The region to export is empty.");
+      else
+	puts ("The page to export is empty.");
+      return 1;
+    }
+
+  png_structp png = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info = (png != NULL) ? png_create_info_struct (png) : NULL;
+  unsigned char* row = malloc (image.width * 3);
+  if (info == NULL || row == NULL)
+    {
+      png_destroy_write_struct (&png, &info);
+      free (row);
+      return 1;
+    }
+
+  co_png_output output = { write_func, closure };
+  png_set_write_fn (png, &output, co_png_write_data, co_png_flush_data);
+
+  image.num_bands = (image.height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+  image.bands = calloc (image.num_bands, sizeof (co_png_band));
+  if (image.bands == NULL)
+    {
+      png_destroy_write_struct (&png, &info);
+      free (row);
+      return 1;
+    }
+
+  unsigned int index = 0;
+  for (; index < image.num_bands; index++)
+    {
+      image.bands[index].top = index * BAND_HEIGHT;
+      image.bands[index].rows = MIN (BAND_HEIGHT, image.height - image.bands[index].top);
+    }
+
+  image.num_threads = MIN (g_get_num_processors (), image.num_bands);
+  g_mutex_init (&image.lock);
+  g_cond_init (&image.drawn);
+  image.pool = g_thread_pool_new (co_png_draw_band, &image, image.num_threads,
+				  FALSE, NULL);
+
+  int status = co_png_write_bands (png, info, &image, row);
+
+  /* Wait for the bands that are still being drawn, in case something went
+   * wrong half-way. */
+  g_thread_pool_free (image.pool, FALSE, TRUE);
+  for (index = 0; index < image.num_bands; index++)
+    if (image.bands[index].surface != NULL)
+      cairo_surface_destroy (image.bands[index].surface);
+
+  g_cond_clear (&image.drawn);
+  g_mutex_clear (&image.lock);
+  free (image.bands);
+  free (row);
+  png_destroy_write_struct (&png, &info);
+
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PNG_WRITE_TO_FILE                                                       |
+ | This cairo write function writes the data it receives to a FILE.           |
+ '----------------------------------------------------------------------------*/
+static cairo_status_t
+co_png_write_to_file (void* closure, const unsigned char* data, unsigned int length)
+{
+  if (fwrite (data, 1, length, (FILE*)closure) != length)
+    return CAIRO_STATUS_WRITE_ERROR;
+
+  return CAIRO_STATUS_SUCCESS;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_PNG_EXPORT_DOCUMENT_TO_FILE                                             |
+ '----------------------------------------------------------------------------*/
+int
+co_png_export_document_to_file (const char* filename, const dt_document* document,
+				dt_configuration* config, const dt_rectangle* region)
+{
+  FILE* file = fopen (filename, "wb");
+  if (file == NULL)
+    {
+      printf ("Couldn't write to '%s'.\n", filename);
+      return 1;
+    }
+
+  int status = co_png_export_document_to_stream (co_png_write_to_file, file,
+						 document, config, region);
+  if (fclose (file) != 0)
+    status = 1;
+
   return status;
 }
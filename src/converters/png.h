@@ -28,6 +28,9 @@
 
 #include <glib.h>
 #include <librsvg/rsvg.h>
+#include <cairo.h>
+#include "../datatypes/configuration.h"
+#include "../datatypes/document.h"
 
 /**
  * This function converts SVG data to a PNG document.
@@ -45,4 +48,60 @@ int co_png_export_to_file (const char* filename, const char* svg_data);
  */
 int co_png_export_to_file_from_handle (const char* filename, RsvgHandle* handle);
 
+/**
+ * This function converts an RsvgHandle to a PNG document and passes the
+ * result to a cairo write function, so it can be written anywhere.
+ * @param write_func The function that receives the PNG data.
+ * @param closure    User data to pass to 'write_func'.
+ * @param handle     An existing RsvgHandle to use for exporting.
+ * @param config     The settings to take the page dimensions from.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int co_png_export_to_stream (cairo_write_func_t write_func, void* closure,
+                              RsvgHandle* handle, dt_configuration* config);
+
+/**
+ * This function draws part of the page to a PNG document, at the resolution
+ * of the settings. Only the strokes that overlap the part are drawn (see
+ * co_png_export_document_to_stream()).
+ * @param filename The filename to export to.
+ * @param document The document to draw (see dt_document_new()).
+ * @param config   The settings to draw the document with.
+ * @param region   The part of the page, in the units of the page dimensions.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int co_png_export_region_to_file (const char* filename, const dt_document* document,
+				  dt_configuration* config, const dt_rectangle* region);
+
+/**
+ * This function draws a document directly with Cairo, without going through
+ * SVG, and passes the PNG data to a cairo write function. The image is
+ * drawn in horizontal bands by a pool of threads, and each band is
+ * compressed as soon as it's ready. Only a few bands are kept in memory at
+ * a time, no matter how large the image is.
+ * @param write_func The function that receives the PNG data.
+ * @param closure    User data to pass to 'write_func'.
+ * @param document   The document to draw (see dt_document_new()).
+ * @param config     The settings to draw the document with. The image is
+ *                   made at 'config->dpi' dots per inch.
+ * @param region     The part of the page to draw, in the units of the page
+ *                   dimensions, or NULL to draw the whole page.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int co_png_export_document_to_stream (cairo_write_func_t write_func, void* closure,
+				      const dt_document* document, dt_configuration* config,
+				      const dt_rectangle* region);
+
+/**
+ * This function does the same as co_png_export_document_to_stream(), but
+ * writes the PNG data to a file.
+ * @param filename The filename to export to.
+ * @param document The document to draw (see dt_document_new()).
+ * @param config   The settings to draw the document with.
+ * @param region   The part of the page to draw, or NULL for the whole page.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int co_png_export_document_to_file (const char* filename, const dt_document* document,
+				    dt_configuration* config, const dt_rectangle* region);
+
 #endif//CONVERTERS_PNG_H
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "render.h"
+#include "../optimizers/level-of-detail.h"
+
+#include <string.h>
+#include <math.h>
+#include <gdk/gdk.h>
+
+/* These are the same values as used by the SVG converter. */
+#define MM_TO_PT 3.5433
+#define OFFSET_X (settings->page.width * MM_TO_PT) / 1.985
+#define OFFSET_Y (settings->page.height * MM_TO_PT) / 19.85
+#define DEFAULT_COLOR "#00007c"
+
+/* Points that are closer together than half a pixel can't be told apart. */
+#define PIXEL_TOLERANCE 0.5
+
+/*----------------------------------------------------------------------------.
+ | CO_RENDER_SET_COLOR                                                        |
+ '----------------------------------------------------------------------------*/
+static void
+co_render_set_color (cairo_t* cr, const char* name)
+{
+  GdkRGBA color;
+  if (!gdk_rgba_parse (&color, name))
+    gdk_rgba_parse (&color, DEFAULT_COLOR);
+
+  cairo_set_source_rgba (cr, color.red, color.green, color.blue, color.alpha);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_RENDER_STROKE_COLOR                                                     |
+ | This function picks the color of a stroke the same way as the SVG          |
+ | converter does.                                                            |
+ '----------------------------------------------------------------------------*/
+static const char*
+co_render_stroke_color (const dt_document_stroke* stroke,
+			const dt_configuration* settings)
+{
+  if (stroke->color <= settings->num_colors)
+    return settings->colors[stroke->color - 1];
+  else if (settings->num_colors > 0)
+    return settings->colors[0];
+
+  return DEFAULT_COLOR;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_RENDER_STROKE                                                           |
+ | This function adds the outline of a stroke to the path. Like in the SVG    |
+ | converter, the width of the stroke follows the pressure of the pen.        |
+ '----------------------------------------------------------------------------*/
+static void
+co_render_stroke (cairo_t* cr, const dt_point* points, unsigned int num_points,
+		  double pressure_factor)
+{
+  unsigned int index = 0;
+
+  if (pressure_factor == 0)
+    {
+      cairo_move_to (cr, points[0].x, points[0].y);
+      for (index = 1; index < num_points; index++)
+	cairo_line_to (cr, points[index].x, points[index].y);
+
+      return;
+    }
+
+  /* One edge going forward... */
+  cairo_move_to (cr, points[0].x, points[0].y);
+  for (index = 1; index < num_points; index++)
+    {
+      const dt_point* previous = &points[index - 1];
+      const dt_point* point = &points[index];
+      double distance = hypot (point->x - previous->x, point->y - previous->y);
+      if (distance == 0) distance = 1;
+
+      double width = point->pressure * pressure_factor / distance;
+      cairo_line_to (cr,
+		     point->x + (previous->y - point->y) * width,
+		     point->y + (point->x - previous->x) * width);
+    }
+
+  /* ...and the other edge going back. */
+  for (index = num_points - 1; index > 0; index--)
+    {
+      const dt_point* previous = &points[index];
+      const dt_point* point = &points[index - 1];
+      double distance = hypot (point->x - previous->x, point->y - previous->y);
+      if (distance == 0) distance = 1;
+
+      double width = point->pressure * pressure_factor / distance;
+      cairo_line_to (cr,
+		     point->x + (previous->y - point->y) * width,
+		     point->y + (point->x - previous->x) * width);
+    }
+
+  cairo_close_path (cr);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_RENDER_BACKGROUND                                                       |
+ '----------------------------------------------------------------------------*/
+void
+co_render_background (cairo_t* cr, const dt_configuration* settings)
+{
+  /* If no background color was set, use white. */
+  const char* background = settings->background;
+  if (background == NULL) background = "#ffffff";
+
+  if (!strcmp (background, "none")) return;
+
+  co_render_set_color (cr, background);
+  cairo_rectangle (cr, 0, 0, settings->page.width * MM_TO_PT,
+		   settings->page.height * MM_TO_PT);
+  cairo_fill (cr);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_RENDER_SEGMENTS                                                         |
+ | The outline of a stroke can only be closed when the stroke has ended. To   |
+ | draw a part of it, each segment is drawn as a line as wide as the outline, |
+ | with round ends to hide the joints.                                        |
+ '----------------------------------------------------------------------------*/
+void
+co_render_segments (cairo_t* cr, const dt_document_stroke* stroke,
+		    unsigned int first, unsigned int last,
+		    const dt_configuration* settings)
+{
+  if (last >= stroke->num_points) last = stroke->num_points - 1;
+  if (first >= last) return;
+
+  cairo_save (cr);
+  cairo_translate (cr, OFFSET_X, OFFSET_Y);
+  cairo_set_line_cap (cr, CAIRO_LINE_CAP_ROUND);
+  co_render_set_color (cr, co_render_stroke_color (stroke, settings));
+
+  unsigned int index = first + 1;
+  for (; index <= last; index++)
+    {
+      const dt_point* previous = &stroke->points[index - 1];
+      const dt_point* point = &stroke->points[index];
+
+      double width = 1;
+      if (settings->pressure_factor != 0)
+	width = (previous->pressure + point->pressure) * settings->pressure_factor;
+
+      cairo_set_line_width (cr, width);
+      cairo_move_to (cr, previous->x, previous->y);
+      cairo_line_to (cr, point->x, point->y);
+      cairo_stroke (cr);
+    }
+
+  cairo_restore (cr);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_RENDER_STROKES                                                          |
+ | This function draws the background and the strokes of a document. When    |
+ | 'layer' is negative, the strokes of all layers are drawn.                  |
+ '----------------------------------------------------------------------------*/
+static void
+co_render_strokes (cairo_t* cr, const dt_document* document,
+		   const dt_configuration* settings, double ratio, int layer)
+{
+  cairo_save (cr);
+  co_render_background (cr, settings);
+
+  if (document == NULL || settings->process_until == 0)
+    {
+      cairo_restore (cr);
+      return;
+    }
+
+  cairo_translate (cr, OFFSET_X, OFFSET_Y);
+  cairo_set_line_width (cr, 1);
+
+  /* Only draw the strokes that can end up in the visible area. A stroke
+   * reaches outside of its points by the pressure width, or by half the
+   * line width. */
+  double x1, y1, x2, y2;
+  cairo_clip_extents (cr, &x1, &y1, &x2, &y2);
+
+  double margin = document->max_pressure * settings->pressure_factor + 1;
+  dt_rectangle area = { x1 - margin, y1 - margin, x2 + margin, y2 + margin };
+
+  unsigned char* selected = g_try_malloc (document->num_strokes);
+  if (selected != NULL
+      && dt_document_find_strokes (document, &area, selected) == 0)
+    {
+      g_free (selected);
+      cairo_restore (cr);
+      return;
+    }
+
+  float tolerance = PIXEL_TOLERANCE / ratio;
+  unsigned int index = 0;
+  for (; index < document->num_strokes; index++)
+    {
+      const dt_document_stroke* stroke = &document->strokes[index];
+
+      /* The SVG converter stops after the stroke that ended at the time the
+       * user chose. */
+      if (index > 0 && document->strokes[index - 1].time >= settings->process_until)
+	break;
+
+      if (selected != NULL && !selected[index]) continue;
+      if (layer >= 0 && stroke->layer != (unsigned int)layer) continue;
+
+      const dt_point* points = stroke->points;
+      unsigned int num_points = stroke->num_points;
+
+      const dt_stroke_level* level = opt_level_of_detail_select (stroke, tolerance);
+      if (level != NULL)
+	{
+	  points = level->points;
+	  num_points = level->num_points;
+	}
+
+      co_render_set_color (cr, co_render_stroke_color (stroke, settings));
+      co_render_stroke (cr, points, num_points, settings->pressure_factor);
+
+      if (settings->pressure_factor == 0)
+	cairo_stroke (cr);
+      else
+	cairo_fill (cr);
+    }
+
+  g_free (selected);
+  cairo_restore (cr);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_RENDER_DOCUMENT                                                         |
+ '----------------------------------------------------------------------------*/
+void
+co_render_document (cairo_t* cr, const dt_document* document,
+		    const dt_configuration* settings, double ratio)
+{
+  co_render_strokes (cr, document, settings, ratio, -1);
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_RENDER_LAYER                                                            |
+ '----------------------------------------------------------------------------*/
+void
+co_render_layer (cairo_t* cr, const dt_document* document,
+		 const dt_configuration* settings, double ratio,
+		 unsigned int layer)
+{
+  co_render_strokes (cr, document, settings, ratio, layer);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   converters/render.h
+ * @brief  Draw a document with Cairo, without going through SVG.
+ * @author Roel Janssen
+ */
+
+#ifndef CONVERTERS_RENDER_H
+#define CONVERTERS_RENDER_H
+
+#include <cairo.h>
+#include "../datatypes/configuration.h"
+#include "../datatypes/document.h"
+
+/**
+ * This function draws a document the way co_svg_create() would, at a zoom
+ * ratio where one unit of the SVG document takes up 'ratio' pixels. The
+ * scaling must already be applied to 'cr'. When the levels of detail have
+ * been built (see opt_level_of_detail_build()), strokes are drawn with no
+ * more points than can be told apart at that ratio. Only the strokes that
+ * overlap the clip area of 'cr' are drawn.
+ *
+ * @param cr       The Cairo context to draw on.
+ * @param document The document to draw.
+ * @param settings The colors, background, page size and pressure factor.
+ * @param ratio    The number of pixels per unit.
+ */
+void co_render_document (cairo_t* cr, const dt_document* document,
+			 const dt_configuration* settings, double ratio);
+
+/**
+ * This function does the same as co_render_document(), but only draws the
+ * strokes of a single layer on top of the background.
+ *
+ * @param cr       The Cairo context to draw on.
+ * @param document The document to draw.
+ * @param settings The colors, background, page size and pressure factor.
+ * @param ratio    The number of pixels per unit.
+ * @param layer    The 0-based index of the layer to draw.
+ */
+void co_render_layer (cairo_t* cr, const dt_document* document,
+		      const dt_configuration* settings, double ratio,
+		      unsigned int layer);
+
+/**
+ * This function fills the page with the background color of the settings,
+ * unless it is "none".
+ *
+ * @param cr       The Cairo context to draw on, in units of the SVG document.
+ * @param settings The settings to take the background and page size from.
+ */
+void co_render_background (cairo_t* cr, const dt_configuration* settings);
+
+/**
+ * This function draws the segments of a stroke between two of its points,
+ * so that a stroke can be drawn bit by bit while it's being played back.
+ * The result is close to, but not exactly the same as the whole stroke
+ * drawn by co_render_document().
+ *
+ * @param cr       The Cairo context to draw on, in units of the SVG document.
+ * @param stroke   The stroke to draw a part of.
+ * @param first    The index of the first point.
+ * @param last     The index of the last point.
+ * @param settings The colors and pressure factor.
+ */
+void co_render_segments (cairo_t* cr, const dt_document_stroke* stroke,
+			 unsigned int first, unsigned int last,
+			 const dt_configuration* settings);
+
+#endif//CONVERTERS_RENDER_H
@@ -22,7 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <locale.h>
+#include "numeric-locale.h"
 #include "../datatypes/configuration.h"
 #include "../datatypes/element.h"
 #include "../datatypes/clock.h"
@@ -71,12 +71,13 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
 {
   /* Floating-point numbers should be written with a dot instead of a comma.
    * To ensure that this happens, (temporarily) set the locale to the "C"
-   * locale for this program. */
-  setlocale (LC_NUMERIC, "C");
+   * locale for this thread. */
+  co_numeric_locale previous_locale = co_numeric_locale_begin ();
 
   if (g_slist_length (data) == 0)
     {
       puts ("co_svg_create: No useful data was found in the file.\r\n");
+      co_numeric_locale_end (previous_locale);
       return NULL;
     }
 
@@ -92,6 +93,7 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
   if (output == NULL)
     {
       puts ("co_svg_create: Couldn't allocate enough memory.\r\n");
+      co_numeric_locale_end (previous_locale);
       return NULL;
     }
 
@@ -152,11 +154,15 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
   unsigned char is_in_stroke = 0;
   float previous_x = 0;
   float previous_y = 0;
-  unsigned short clock = 0;
+  double time = 0;
   unsigned short stop = 0;
   
   GSList* stroke_data = NULL; 
 
+  /* Each stroke is a span in the trace (see dt_stats_span_start()). */
+  dt_stats_mark stroke_mark;
+  unsigned int stroke_points = 0;
+
   /*--------------------------------------------------------------------------.
    | WRITE DATA POINTS                                                        |
    '--------------------------------------------------------------------------*/
@@ -195,6 +201,9 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
 		  is_in_stroke = 1;
 		  has_stroke_data = 1;
 		  group++;
+
+		  dt_stats_span_start (settings->stats, &stroke_mark);
+		  stroke_points = 0;
 		}
 	      break;
 	      case END_STROKE:
@@ -207,7 +216,9 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
 		      /* end SVG path. */
 		      written += sprintf (output + written, "\" />\n  </g>\n");
 		      is_in_stroke = 0;
-		      if (clock >= settings->process_until) stop = 1;
+		      dt_stats_span_stop (settings->stats, "svg-stroke", &stroke_mark,
+					  1, stroke_points);
+		      if (time >= settings->process_until) stop = 1;
 		      break;
 		    }
 
@@ -247,8 +258,10 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
 		  /* 'Z' means 'closepath' */
 		  written += sprintf (output + written, " z\" />\n  </g>\n");
 		  is_in_stroke = 0;
+		  dt_stats_span_stop (settings->stats, "svg-stroke", &stroke_mark,
+				      1, stroke_points);
 
-		  if (clock >= settings->process_until) stop = 1;
+		  if (time >= settings->process_until) stop = 1;
 		}
 		break;
 	      case NEW_LAYER:
@@ -257,6 +270,8 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
 		    {
 		      written += sprintf (output + written, " z\" />\n  </g>\n");
 		      is_in_stroke = 0;
+		      dt_stats_span_stop (settings->stats, "svg-stroke", &stroke_mark,
+					  1, stroke_points);
 		    }
 		  if (has_stroke_data == 0)
 		    layer_color++;
@@ -269,7 +284,7 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
 			"groupmode=\"layer\" id=\"layer%d\">\n", 
 			layer, layer);
 		      layer++;
-		      if (clock >= settings->process_until) stop = 1;
+		      if (time >= settings->process_until) stop = 1;
 		    }
 		}
 		break;
@@ -281,6 +296,8 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
 	   '------------------------------------------------------------------*/
 	case TYPE_COORDINATE:
 	  {
+	    time = ((dt_coordinate*)e)->time;
+
 	    if (is_in_stroke != 1)
 	      {
 		char* color = DEFAULT_COLOR;
@@ -298,6 +315,9 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
 
 		is_in_stroke = 1;
 		group++;
+
+		dt_stats_span_start (settings->stats, &stroke_mark);
+		stroke_points = 0;
 	      }
 	    
 	    dt_coordinate* c = (dt_coordinate *)e;
@@ -353,6 +373,7 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
 	    previous_y = y;
 
 	    stroke_data = g_slist_prepend (stroke_data, c);
+	    stroke_points++;
 	  }
 	  break;
 	  /*
@@ -362,11 +383,6 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
 	  }
 	  break;
 	  */
-	case TYPE_CLOCK:
-	  {
-	    dt_clock* c = (dt_clock *)e;
-	    clock = c->counter;
-	  }
 	}
 
       data = data->next;
@@ -375,7 +391,11 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
   data = data_head;
 
   if (is_in_stroke != 0)
-    written += sprintf (output + written, " z\" />\n  </g>\n");
+    {
+      written += sprintf (output + written, " z\" />\n  </g>\n");
+      dt_stats_span_stop (settings->stats, "svg-stroke", &stroke_mark,
+			  1, stroke_points);
+    }
   
   written += sprintf (output + written, "</g>\n</svg>");
 
@@ -383,8 +403,8 @@ co_svg_create (GSList* data, const char* title, dt_configuration* settings)
   output = realloc (output, output_len);
   output[written] = '\0';
 
-  /* Reset to default locale settings. */
-  setlocale (LC_NUMERIC, "");
+  /* Reset to the previous locale settings. */
+  co_numeric_locale_end (previous_locale);
 
   return output;
 }
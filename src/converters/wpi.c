@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "wpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../datatypes/clock.h"
+#include "../parsers/wpi.h"
+
+/*----------------------------------------------------------------------------.
+ | CO_WPI_ENCODE_ELEMENT                                                      |
+ | This function writes the block for a single element to 'block'. This is    |
+ | the reverse of what p_wpi_parse() does. Returns the number of bytes used.  |
+ '----------------------------------------------------------------------------*/
+size_t
+co_wpi_encode_element (const dt_element* e, unsigned char* block)
+{
+  memset (block, 0, CO_WPI_MAX_BLOCK_LEN);
+
+  switch (e->type)
+    {
+    case TYPE_COORDINATE:
+      {
+	const dt_coordinate* c = (const dt_coordinate*)e;
+	int x = (int)c->x - 5;
+	int y = ((int)c->y - 5) >> 1;
+
+	block[0] = BLOCK_COORDINATE;
+	block[1] = 6;
+	block[2] = (x >> 8) & 0xff;
+	block[3] = x & 0xff;
+	block[4] = (y >> 8) & 0xff;
+	block[5] = y & 0xff;
+	return 6;
+      }
+    case TYPE_PRESSURE:
+      {
+	const dt_pressure* p = (const dt_pressure*)e;
+	block[0] = BLOCK_PRESSURE;
+	block[1] = 6;
+	block[4] = (p->pressure >> 8) & 0xff;
+	block[5] = p->pressure & 0xff;
+	return 6;
+      }
+    case TYPE_TILT:
+      {
+	const dt_tilt* t = (const dt_tilt*)e;
+	block[0] = BLOCK_TILT;
+	block[1] = 6;
+	block[2] = t->x;
+	block[3] = t->y;
+	return 6;
+      }
+    case TYPE_STROKE:
+      block[0] = BLOCK_STROKE;
+      block[1] = 3;
+      block[2] = ((const dt_stroke*)e)->value;
+      return 3;
+    case TYPE_CLOCK:
+      {
+	const dt_clock* c = (const dt_clock*)e;
+	block[0] = BLOCK_CLOCK;
+	block[1] = 6;
+	block[2] = 0x11;
+	block[4] = (c->counter >> 8) & 0xff;
+	block[5] = c->counter & 0xff;
+	return 6;
+      }
+    }
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_WPI_WRITE_PREAMBLE                                                      |
+ '----------------------------------------------------------------------------*/
+int
+co_wpi_write_preamble (unsigned char* output)
+{
+  gsize header_len = 0;
+  guchar* header = g_base64_decode (WPI_HEADER_BASE64, &header_len);
+  if (header == NULL || header_len != WPI_HEADER_LEN)
+    {
+      g_free (header);
+      return 1;
+    }
+
+  memset (output, 0, WPI_PREAMBLE_LEN);
+  memcpy (output, header, WPI_HEADER_LEN);
+  g_free (header);
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_WPI_CREATE                                                              |
+ '----------------------------------------------------------------------------*/
+unsigned char*
+co_wpi_create (GSList* data, size_t* length)
+{
+  size_t capacity = WPI_PREAMBLE_LEN + g_slist_length (data) * CO_WPI_MAX_BLOCK_LEN;
+  unsigned char* output = calloc (1, capacity);
+  if (output == NULL) return NULL;
+
+  if (co_wpi_write_preamble (output) != 0)
+    {
+      free (output);
+      return NULL;
+    }
+
+  size_t position = WPI_PREAMBLE_LEN;
+  for (; data != NULL; data = data->next)
+    position += co_wpi_encode_element ((dt_element*)data->data,
+				       output + position);
+
+  *length = position;
+  return output;
+}
+
+/*----------------------------------------------------------------------------.
+ | CO_WPI_CREATE_FILE                                                         |
+ '----------------------------------------------------------------------------*/
+int
+co_wpi_create_file (const char* filename, GSList* data)
+{
+  size_t length = 0;
+  unsigned char* output = co_wpi_create (data, &length);
+  if (output == NULL) return 1;
+
+  FILE* file = fopen (filename, "wb");
+  if (file == NULL)
+    {
+      printf ("%s: Couldn't write to '%s'.\n", __func__, filename);
+      free (output);
+      return 1;
+    }
+
+  int status = (fwrite (output, 1, length, file) != length);
+  if (fclose (file) != 0) status = 1;
+
+  free (output);
+  return status;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   converters/wpi.h
+ * @brief  A set of functions to write parsed data back to the WPI format.
+ * @author Roel Janssen
+ */
+
+#ifndef CONVERTERS_WPI_H
+#define CONVERTERS_WPI_H
+
+#include <glib.h>
+#include "../datatypes/element.h"
+
+/**
+ * The largest number of bytes co_wpi_encode_element() writes.
+ */
+#define CO_WPI_MAX_BLOCK_LEN 6
+
+/**
+ * This function writes parsed data to a WPI file.
+ * @param filename The path of the file to write to.
+ * @param data The parsed data (see p_wpi_parse()).
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int co_wpi_create_file (const char* filename, GSList* data);
+
+/**
+ * This function encodes parsed data in the WPI format. Only the blocks that
+ * p_wpi_parse() understands are written, so the preamble after the common
+ * header is left empty.
+ * @param data   The parsed data (see p_wpi_parse()).
+ * @param length Is set to the number of bytes in the returned data.
+ * @return A dynamically allocated buffer with the WPI data, or NULL.
+ */
+unsigned char* co_wpi_create (GSList* data, size_t* length);
+
+/**
+ * This function writes the preamble that every WPI file starts with. Only
+ * the common header is filled in; the rest is left empty.
+ * @param output A buffer of at least WPI_PREAMBLE_LEN bytes.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int co_wpi_write_preamble (unsigned char* output);
+
+/**
+ * This function encodes a single element as a WPI block. This can be used
+ * to write WPI data without keeping all of it in memory.
+ * @param e     The element to encode.
+ * @param block A buffer of at least CO_WPI_MAX_BLOCK_LEN bytes.
+ * @return The number of bytes written to 'block'.
+ */
+size_t co_wpi_encode_element (const dt_element* e, unsigned char* block);
+
+#endif//CONVERTERS_WPI_H
@@ -21,9 +21,11 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <locale.h>
+#include <glib.h>
 
 #define LINE_LENGTH 255
 
@@ -118,6 +120,188 @@ dt_configuration_parse_colors (const char* data, dt_configuration* config)
     }
 }
 
+/*----------------------------------------------------------------------------.
+ | DT_CONFIGURATION_PARSE_FORMATS                                             |
+ | This function sets the output formats from a comma separated list.         |
+ '----------------------------------------------------------------------------*/
+int
+dt_configuration_parse_formats (const char* data, dt_configuration* config)
+{
+  if (data == NULL) return 1;
+
+  char* copy = strdup (data);
+  if (copy == NULL) return 1;
+
+  int status = 0;
+  char* state = NULL;
+  char* format = strtok_r (copy, ",", &state);
+
+  config->export_formats = 0;
+  while (format != NULL)
+    {
+      if (!strcasecmp (format, "svg"))
+        config->export_formats |= FORMAT_SVG;
+      else if (!strcasecmp (format, "png"))
+        config->export_formats |= FORMAT_PNG;
+      else if (!strcasecmp (format, "pdf"))
+        config->export_formats |= FORMAT_PDF;
+      else if (!strcasecmp (format, "json"))
+        config->export_formats |= FORMAT_JSON;
+      else if (!strcasecmp (format, "csv"))
+        config->export_formats |= FORMAT_CSV;
+      else
+        {
+          printf ("Unknown output format '%s'.\n", format);
+          status = 1;
+        }
+
+      format = strtok_r (NULL, ",", &state);
+    }
+
+  free (copy);
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_CONFIGURATION_COPY                                                      |
+ | This function copies a dt_configuration including its strings.            |
+ '----------------------------------------------------------------------------*/
+void
+dt_configuration_copy (const dt_configuration* from, dt_configuration* to)
+{
+  *to = *from;
+
+  to->colors = NULL;
+  to->num_colors = 0;
+  if (from->num_colors > 0)
+    {
+      to->colors = calloc (from->num_colors, sizeof (char*));
+      if (to->colors != NULL)
+        {
+          unsigned int a = 0;
+          for (; a < from->num_colors; a++)
+            to->colors[a] = (from->colors[a] != NULL) ? strdup (from->colors[a]) : NULL;
+
+          to->num_colors = from->num_colors;
+        }
+    }
+
+  to->background = (from->background) ? strdup (from->background) : NULL;
+  to->page.measurement = (from->page.measurement) ? strdup (from->page.measurement) : NULL;
+  to->page.orientation = (from->page.orientation) ? strdup (from->page.orientation) : NULL;
+  to->config_location = (from->config_location) ? strdup (from->config_location) : NULL;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_CONFIGURATION_SET_OPTION                                                |
+ | This function sets a single option by its name, as used in the config     |
+ | file. Values that were set before are replaced.                            |
+ '----------------------------------------------------------------------------*/
+int
+dt_configuration_set_option (const char* key, const char* value, dt_configuration* config)
+{
+  if (key == NULL || value == NULL) return 1;
+
+  if (!strcmp (key, "colors"))
+    {
+      unsigned int a = 0;
+      for (; a < config->num_colors; a++)
+        free (config->colors[a]);
+
+      free (config->colors), config->colors = NULL;
+      config->num_colors = 0;
+      dt_configuration_parse_colors (value, config);
+    }
+  else if (!strcmp (key, "background"))
+    {
+      free (config->background);
+      config->background = strdup (value);
+    }
+  else if (!strcmp (key, "pressure-factor"))
+    {
+      char* end = NULL;
+      double factor = g_ascii_strtod (value, &end);
+      if (end == value) return 1;
+
+      config->pressure_factor = factor;
+    }
+  else if (!strcmp (key, "dimensions"))
+    {
+      free (config->page.measurement), config->page.measurement = NULL;
+      dt_configuration_parse_dimensions (value, config);
+    }
+  else if (!strcmp (key, "orientation"))
+    {
+      int was_landscape = (config->page.orientation != NULL
+                           && !strcmp (config->page.orientation, "Landscape"));
+      int is_landscape = !strcmp (value, "Landscape");
+
+      free (config->page.orientation);
+      config->page.orientation = strdup (value);
+
+      if (was_landscape != is_landscape)
+        {
+          double width = config->page.width;
+          config->page.width = config->page.height;
+          config->page.height = width;
+        }
+    }
+  else if (!strcmp (key, "formats"))
+    return dt_configuration_parse_formats (value, config);
+  else if (!strcmp (key, "dpi"))
+    {
+      char* end = NULL;
+      double dpi = g_ascii_strtod (value, &end);
+      if (end == value || dpi <= 0) return 1;
+
+      config->dpi = dpi;
+    }
+  else if (!strcmp (key, "record-interval"))
+    {
+      char* end = NULL;
+      long interval = strtol (value, &end, 10);
+      if (end == value || interval < 0) return 1;
+
+      config->record_interval = interval;
+    }
+  else if (!strcmp (key, "statistics-interval"))
+    {
+      char* end = NULL;
+      long interval = strtol (value, &end, 10);
+      if (end == value || interval < 0) return 1;
+
+      config->statistics_interval = interval;
+    }
+  else if (!strcmp (key, "filter-min-cutoff"))
+    {
+      char* end = NULL;
+      double cutoff = g_ascii_strtod (value, &end);
+      if (end == value || cutoff < 0) return 1;
+
+      config->filter_min_cutoff = cutoff;
+    }
+  else if (!strcmp (key, "filter-beta"))
+    {
+      char* end = NULL;
+      double beta = g_ascii_strtod (value, &end);
+      if (end == value || beta < 0) return 1;
+
+      config->filter_beta = beta;
+    }
+  else if (!strcmp (key, "filter-prediction"))
+    {
+      char* end = NULL;
+      long prediction = strtol (value, &end, 10);
+      if (end == value || prediction < 0) return 1;
+
+      config->filter_prediction = prediction;
+    }
+  else
+    return 1;
+
+  return 0;
+}
+
 /*----------------------------------------------------------------------------.
  | DT_CLEANUP_CONFIGURATION                                                   |
  | This function cleans up data that was malloc'd in a dt_configuration.      |
@@ -219,6 +403,45 @@ dt_configuration_parse (const char* filename, dt_configuration* config)
                   location += 13;
                   dt_configuration_parse_dimensions (location, config);
                 }
+              else if ((location = strstr (line, "formats = ")) != NULL)
+                {
+                  char* newline = strchr (line, '\r');
+                  if (newline == NULL) newline = strchr (line, '\n');
+                  if (newline != NULL) line[newline - line] = '\0';
+
+                  location += 10;
+                  dt_configuration_parse_formats (location, config);
+                }
+              else if ((location = strstr (line, "dpi = ")) != NULL)
+                {
+                  location += 6;
+                  config->dpi = g_ascii_strtod (location, NULL);
+                }
+              else if ((location = strstr (line, "record-interval = ")) != NULL)
+                {
+                  location += 18;
+                  config->record_interval = atoi (location);
+                }
+              else if ((location = strstr (line, "statistics-interval = ")) != NULL)
+                {
+                  location += 22;
+                  config->statistics_interval = atoi (location);
+                }
+              else if ((location = strstr (line, "filter-min-cutoff = ")) != NULL)
+                {
+                  location += 20;
+                  config->filter_min_cutoff = g_ascii_strtod (location, NULL);
+                }
+              else if ((location = strstr (line, "filter-beta = ")) != NULL)
+                {
+                  location += 14;
+                  config->filter_beta = g_ascii_strtod (location, NULL);
+                }
+              else if ((location = strstr (line, "filter-prediction = ")) != NULL)
+                {
+                  location += 20;
+                  config->filter_prediction = atoi (location);
+                }
               else if ((location = strstr (line, "orientation = ")) != NULL)
                 {
                   char* newline = strchr (line, '\r');
@@ -28,6 +28,16 @@
 #ifndef DATATYPES_CONFIGURATION_H
 #define DATATYPES_CONFIGURATION_H
 
+#include "stats.h"
+
+/* Definitions of output formats that can be combined in 'export_formats'. */
+#define FORMAT_SVG  1
+#define FORMAT_PNG  2
+#define FORMAT_PDF  4
+#define FORMAT_JSON 8
+#define FORMAT_CSV  16
+#define FORMAT_WPI  32
+
 /**
  * This struct is used to describe the page dimensions.
  */
@@ -41,7 +51,11 @@ typedef struct
 
 /**
  * This struct contains all configuration options that a user can configure on
- * run-time.
+ * run-time. When 'stats' is not NULL, the conversions add their measurements
+ * to it. It isn't owned by the configuration, so copies share it. When 'dpi'
+ * is 0, PNG images are made at 90 dots per inch. The converters stop after
+ * the first stroke that ends at 'process_until' seconds since the start of
+ * the recording (see dt_coordinate).
  */
 typedef struct
 {
@@ -53,6 +67,14 @@ typedef struct
   dt_page_dimensions page;
   char* config_location;
   unsigned short process_until;
+  unsigned int export_formats;
+  double dpi;
+  unsigned int record_interval;
+  unsigned int statistics_interval;
+  double filter_min_cutoff;
+  double filter_beta;
+  unsigned int filter_prediction;
+  dt_stats* stats;
 } dt_configuration;
 
 /**
@@ -72,6 +94,34 @@ typedef struct {
  */
 void dt_configuration_parse_colors (const char* data, dt_configuration* config);
 
+/**
+ * This function parses a comma separated list of output formats (for example
+ * "svg,png,pdf") from a string.
+ * @param data   A string to parse.
+ * @param config A dt_configuration structure to store the parsed data to.
+ * @return 0 when all formats were recognized, 1 otherwise.
+ */
+int dt_configuration_parse_formats (const char* data, dt_configuration* config);
+
+/**
+ * This function makes a deep copy of a configuration, so that the copy can be
+ * changed and cleaned up independently of the original.
+ * @param from The dt_configuration to copy.
+ * @param to   A dt_configuration structure to store the copy in.
+ */
+void dt_configuration_copy (const dt_configuration* from, dt_configuration* to);
+
+/**
+ * This function sets a single option. The names of the options are the keys
+ * of the configuration file (see "Changing the default options" in the
+ * manual).
+ * @param key    The name of the option.
+ * @param value  The value to set it to.
+ * @param config A dt_configuration structure to store the option in.
+ * @return 0 when the option was set, 1 when it is unknown or invalid.
+ */
+int dt_configuration_set_option (const char* key, const char* value, dt_configuration* config);
+
 /**
  * This function properly cleans up allocated memory of a dt_configuration.
  * @param config A dt_configuration to clean up.
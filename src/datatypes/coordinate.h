@@ -29,12 +29,15 @@
 
 /**
  * This struct contains the variables that can be extracted for coordinate data.
+ * The 'time' is in seconds since the start of the recording. The parser
+ * derives it from the clock blocks around the coordinate.
  */
 typedef struct {
   unsigned char type;
   float x;
   float y;
   float pressure;
+  double time;
 } dt_coordinate;
 
 #endif//DATATYPES_COORDINATE_H
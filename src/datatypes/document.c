@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "document.h"
+#include "element.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* These are the same correction values as used by the SVG converter. */
+#define SHRINK 27.0
+#define PRESSURE_FACTOR 2000.0
+#define SPIKE_THRESHOLD 25.0
+
+/* The grid has about as many cells as there are strokes, up to this number
+ * of columns and rows. */
+#define MAX_GRID_SIZE 256
+
+/*----------------------------------------------------------------------------.
+ | DT_DOCUMENT_FINISH_STROKE                                                  |
+ | This function adds the points that were collected to the document.         |
+ '----------------------------------------------------------------------------*/
+static void
+dt_document_finish_stroke (GArray* strokes, dt_document_stroke* stroke,
+			   GArray* points, double time)
+{
+  if (points->len > 0)
+    {
+      stroke->time = time;
+      stroke->num_points = points->len;
+      stroke->points = g_new (dt_point, points->len);
+      memcpy (stroke->points, points->data, points->len * sizeof (dt_point));
+
+      stroke->bounds.x1 = stroke->bounds.x2 = stroke->points[0].x;
+      stroke->bounds.y1 = stroke->bounds.y2 = stroke->points[0].y;
+
+      unsigned int index = 1;
+      for (; index < stroke->num_points; index++)
+	{
+	  const dt_point* point = &stroke->points[index];
+	  if (point->x < stroke->bounds.x1) stroke->bounds.x1 = point->x;
+	  if (point->x > stroke->bounds.x2) stroke->bounds.x2 = point->x;
+	  if (point->y < stroke->bounds.y1) stroke->bounds.y1 = point->y;
+	  if (point->y > stroke->bounds.y2) stroke->bounds.y2 = point->y;
+	}
+
+      g_array_append_val (strokes, *stroke);
+    }
+
+  g_array_set_size (points, 0);
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_DOCUMENT_CELLS                                                          |
+ | This function returns the range of cells that a rectangle overlaps. It    |
+ | returns 0 when the rectangle lies outside of the grid.                     |
+ '----------------------------------------------------------------------------*/
+static int
+dt_document_cells (const dt_document_grid* grid, const dt_rectangle* area,
+		   unsigned int* first_column, unsigned int* last_column,
+		   unsigned int* first_row, unsigned int* last_row)
+{
+  if (area->x2 < grid->bounds.x1 || area->x1 > grid->bounds.x2
+      || area->y2 < grid->bounds.y1 || area->y1 > grid->bounds.y2)
+    return 0;
+
+  /* The coordinates are clamped to the grid, so the casts round down. */
+  float x1 = MAX (area->x1, grid->bounds.x1) - grid->bounds.x1;
+  float x2 = MIN (area->x2, grid->bounds.x2) - grid->bounds.x1;
+  float y1 = MAX (area->y1, grid->bounds.y1) - grid->bounds.y1;
+  float y2 = MIN (area->y2, grid->bounds.y2) - grid->bounds.y1;
+
+  *first_column = MIN ((unsigned int)(x1 / grid->cell_width), grid->columns - 1);
+  *last_column = MIN ((unsigned int)(x2 / grid->cell_width), grid->columns - 1);
+  *first_row = MIN ((unsigned int)(y1 / grid->cell_height), grid->rows - 1);
+  *last_row = MIN ((unsigned int)(y2 / grid->cell_height), grid->rows - 1);
+
+  return 1;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_DOCUMENT_BUILD_GRID                                                     |
+ | This function adds each stroke to the cells its bounds overlap. The cells  |
+ | are counted first, so the strokes of all cells fit in a single array.      |
+ '----------------------------------------------------------------------------*/
+static void
+dt_document_build_grid (dt_document* document)
+{
+  dt_document_grid* grid = &document->grid;
+  unsigned int index = 0;
+
+  grid->bounds = document->strokes[0].bounds;
+  for (index = 1; index < document->num_strokes; index++)
+    {
+      const dt_rectangle* bounds = &document->strokes[index].bounds;
+      grid->bounds.x1 = MIN (grid->bounds.x1, bounds->x1);
+      grid->bounds.y1 = MIN (grid->bounds.y1, bounds->y1);
+      grid->bounds.x2 = MAX (grid->bounds.x2, bounds->x2);
+      grid->bounds.y2 = MAX (grid->bounds.y2, bounds->y2);
+    }
+
+  unsigned int size = (unsigned int)sqrt (document->num_strokes) + 1;
+  if (size > MAX_GRID_SIZE) size = MAX_GRID_SIZE;
+
+  grid->columns = size;
+  grid->rows = size;
+  grid->cell_width = (grid->bounds.x2 - grid->bounds.x1) / size;
+  grid->cell_height = (grid->bounds.y2 - grid->bounds.y1) / size;
+  if (grid->cell_width <= 0) grid->cell_width = 1;
+  if (grid->cell_height <= 0) grid->cell_height = 1;
+
+  unsigned int num_cells = grid->columns * grid->rows;
+  grid->start = g_new0 (unsigned int, num_cells + 1);
+
+  unsigned int pass = 0;
+  for (; pass < 2; pass++)
+    {
+      for (index = 0; index < document->num_strokes; index++)
+	{
+	  unsigned int first_column, last_column, first_row, last_row;
+	  dt_document_cells (grid, &document->strokes[index].bounds,
+			     &first_column, &last_column, &first_row, &last_row);
+
+	  unsigned int row = first_row;
+	  for (; row <= last_row; row++)
+	    {
+	      unsigned int column = first_column;
+	      for (; column <= last_column; column++)
+		{
+		  unsigned int cell = row * grid->columns + column;
+
+		  /* The first pass counts, the second pass fills in. */
+		  if (pass == 0)
+		    grid->start[cell + 1]++;
+		  else
+		    grid->strokes[grid->start[cell]++] = index;
+		}
+	    }
+	}
+
+      if (pass == 0)
+	{
+	  for (index = 1; index <= num_cells; index++)
+	    grid->start[index] += grid->start[index - 1];
+
+	  grid->strokes = g_new (unsigned int, grid->start[num_cells]);
+	}
+    }
+
+  /* Filling in moved each start to the start of the next cell. */
+  for (index = num_cells; index > 0; index--)
+    grid->start[index] = grid->start[index - 1];
+  grid->start[0] = 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_DOCUMENT_NEW                                                            |
+ | This function follows the same steps as co_svg_create() to find strokes,   |
+ | layers and colors.                                                         |
+ '----------------------------------------------------------------------------*/
+dt_document*
+dt_document_new (GSList* data)
+{
+  GArray* strokes = g_array_new (FALSE, TRUE, sizeof (dt_document_stroke));
+  GArray* points = g_array_new (FALSE, FALSE, sizeof (dt_point));
+
+  dt_document_stroke stroke;
+  unsigned int layer = 0;
+  unsigned int layer_color = 1;
+  unsigned char has_stroke_data = 0;
+  unsigned char is_in_stroke = 0;
+  double time = 0;
+
+  memset (&stroke, 0, sizeof (dt_document_stroke));
+
+  for (; data != NULL; data = data->next)
+    {
+      dt_element* e = (dt_element*)data->data;
+      switch (e->type)
+	{
+	case TYPE_STROKE:
+	  {
+	    dt_stroke* s = (dt_stroke*)e;
+	    if (s->value == BEGIN_STROKE && !is_in_stroke)
+	      {
+		stroke.layer = layer;
+		stroke.color = layer_color;
+		is_in_stroke = 1;
+		has_stroke_data = 1;
+	      }
+	    else if (s->value == END_STROKE && is_in_stroke)
+	      {
+		dt_document_finish_stroke (strokes, &stroke, points, time);
+		is_in_stroke = 0;
+	      }
+	    else if (s->value == NEW_LAYER)
+	      {
+		if (is_in_stroke)
+		  dt_document_finish_stroke (strokes, &stroke, points, time);
+		is_in_stroke = 0;
+
+		if (has_stroke_data == 0)
+		  layer_color++;
+		else
+		  {
+		    has_stroke_data = 0;
+		    layer_color = 1;
+		    layer++;
+		  }
+	      }
+	  }
+	  break;
+
+	case TYPE_COORDINATE:
+	  {
+	    dt_coordinate* c = (dt_coordinate*)e;
+
+	    time = c->time;
+
+	    if (!is_in_stroke)
+	      {
+		stroke.layer = layer;
+		stroke.color = layer_color;
+		is_in_stroke = 1;
+	      }
+
+	    dt_point point;
+	    point.x = c->x / SHRINK;
+	    point.y = c->y / SHRINK;
+	    point.pressure = 0;
+	    point.time = time;
+
+	    if (data->next != NULL)
+	      {
+		dt_element* next = (dt_element*)data->next->data;
+		if (next != NULL && next->type == TYPE_PRESSURE)
+		  point.pressure = ((dt_pressure*)next)->pressure / PRESSURE_FACTOR;
+	      }
+
+	    /* Skip points that are the same as the previous one, and points
+	     * that are too far away from it. */
+	    if (points->len > 0)
+	      {
+		dt_point* previous = &g_array_index (points, dt_point, points->len - 1);
+		if (point.x == previous->x && point.y == previous->y)
+		  break;
+
+		float distance = sqrt ((point.x - previous->x) * (point.x - previous->x) +
+				       (point.y - previous->y) * (point.y - previous->y));
+		if (distance > SPIKE_THRESHOLD)
+		  break;
+	      }
+
+	    g_array_append_val (points, point);
+	  }
+	  break;
+	}
+    }
+
+  if (is_in_stroke)
+    dt_document_finish_stroke (strokes, &stroke, points, time);
+
+  g_array_free (points, TRUE);
+
+  if (strokes->len == 0)
+    {
+      g_array_free (strokes, TRUE);
+      return NULL;
+    }
+
+  dt_document* document = calloc (1, sizeof (dt_document));
+  if (document == NULL)
+    {
+      g_array_free (strokes, TRUE);
+      return NULL;
+    }
+
+  document->num_strokes = strokes->len;
+  document->strokes = (dt_document_stroke*)g_array_free (strokes, FALSE);
+  document->num_layers = document->strokes[document->num_strokes - 1].layer + 1;
+  document->last_time = time;
+
+  unsigned int index = 0;
+  for (; index < document->num_strokes; index++)
+    {
+      const dt_document_stroke* stroke = &document->strokes[index];
+      document->num_points += stroke->num_points;
+
+      unsigned int point = 0;
+      for (; point < stroke->num_points; point++)
+	if (stroke->points[point].pressure > document->max_pressure)
+	  document->max_pressure = stroke->points[point].pressure;
+    }
+
+  dt_document_build_grid (document);
+
+  return document;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_DOCUMENT_FIND_STROKES                                                   |
+ | This function only looks at the strokes in the cells that overlap the     |
+ | area. Marking them in 'selected' keeps them in drawing order, and counts   |
+ | a stroke only once when it's in more than one of those cells.              |
+ '----------------------------------------------------------------------------*/
+unsigned int
+dt_document_find_strokes (const dt_document* document, const dt_rectangle* area,
+			  unsigned char* selected)
+{
+  const dt_document_grid* grid = &document->grid;
+  unsigned int first_column, last_column, first_row, last_row;
+  unsigned int found = 0;
+
+  memset (selected, 0, document->num_strokes);
+
+  if (!dt_document_cells (grid, area, &first_column, &last_column,
+			  &first_row, &last_row))
+    return 0;
+
+  unsigned int row = first_row;
+  for (; row <= last_row; row++)
+    {
+      unsigned int column = first_column;
+      for (; column <= last_column; column++)
+	{
+	  unsigned int cell = row * grid->columns + column;
+	  unsigned int position = grid->start[cell];
+	  for (; position < grid->start[cell + 1]; position++)
+	    {
+	      unsigned int index = grid->strokes[position];
+	      const dt_rectangle* bounds = &document->strokes[index].bounds;
+
+	      if (selected[index]
+		  || bounds->x2 < area->x1 || bounds->x1 > area->x2
+		  || bounds->y2 < area->y1 || bounds->y1 > area->y2)
+		continue;
+
+	      selected[index] = 1;
+	      found++;
+	    }
+	}
+    }
+
+  return found;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_DOCUMENT_FREE                                                           |
+ '----------------------------------------------------------------------------*/
+void
+dt_document_free (dt_document* document)
+{
+  if (document == NULL) return;
+
+  unsigned int index = 0;
+  for (; index < document->num_strokes; index++)
+    {
+      dt_document_stroke* stroke = &document->strokes[index];
+
+      /* The first level shares its points with the stroke. */
+      unsigned int level = 1;
+      for (; level < stroke->num_levels; level++)
+	g_free (stroke->levels[level].points);
+
+      g_free (stroke->levels);
+      g_free (stroke->points);
+    }
+
+  g_free (document->grid.start);
+  g_free (document->grid.strokes);
+  g_free (document->strokes);
+  free (document);
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   datatypes/document.h
+ * @brief  A drawing as a list of strokes, ready to be rendered.
+ * @author Roel Janssen
+ * @namespace datatypes
+ */
+
+#ifndef DATATYPES_DOCUMENT_H
+#define DATATYPES_DOCUMENT_H
+
+#include <glib.h>
+
+/**
+ * This struct contains a point of a stroke. The position is in SVG user
+ * units, relative to the offset of the page (see co_svg_create()). The time
+ * is in seconds since the start of the recording (see dt_coordinate).
+ */
+typedef struct
+{
+  float x;
+  float y;
+  float pressure;
+  float time;
+} dt_point;
+
+/**
+ * This struct contains the points of a stroke, either all of them or a
+ * reduced set (see opt_level_of_detail_build()).
+ */
+typedef struct
+{
+  float tolerance;
+  unsigned int num_points;
+  dt_point* points;
+} dt_stroke_level;
+
+/**
+ * This struct describes a rectangle by its top-left and bottom-right corner.
+ */
+typedef struct
+{
+  float x1;
+  float y1;
+  float x2;
+  float y2;
+} dt_rectangle;
+
+/**
+ * This struct contains a single stroke of the pen. The 'time' is when the
+ * stroke ended, in seconds since the start of the recording (see
+ * dt_coordinate). The 'bounds' contain all points of the stroke, without the
+ * width that the pressure adds.
+ */
+typedef struct
+{
+  unsigned int layer;
+  unsigned int color;
+  float time;
+  unsigned int num_points;
+  dt_point* points;
+  unsigned int num_levels;
+  dt_stroke_level* levels;
+  dt_rectangle bounds;
+} dt_document_stroke;
+
+/**
+ * This struct divides the area that is drawn on into equally sized cells,
+ * and lists for each cell the strokes that touch it. The strokes of cell
+ * 'n' are strokes[start[n]] up to strokes[start[n + 1]], in drawing order.
+ */
+typedef struct
+{
+  dt_rectangle bounds;
+  unsigned int columns;
+  unsigned int rows;
+  float cell_width;
+  float cell_height;
+  unsigned int* start;
+  unsigned int* strokes;
+} dt_document_grid;
+
+/**
+ * This struct contains the strokes of a drawing in the order in which they
+ * were drawn. The 'max_pressure' is the highest pressure of all points, to
+ * know how far a stroke can reach outside of its bounds. 'num_points' is
+ * the number of points of all strokes together.
+ */
+typedef struct
+{
+  unsigned int num_strokes;
+  dt_document_stroke* strokes;
+  unsigned int num_points;
+  unsigned int num_layers;
+  float last_time;
+  float max_pressure;
+  dt_document_grid grid;
+} dt_document;
+
+/**
+ * This function turns parsed data into strokes. Points that the SVG
+ * converter leaves out (duplicates and spikes) are left out here as well.
+ * The 'color' of a stroke is a 1-based index into the configured colors,
+ * chosen the same way as the SVG converter does.
+ *
+ * @param data The parsed data (see p_wpi_parse()).
+ * @return A newly allocated document, or NULL when there are no strokes.
+ */
+dt_document* dt_document_new (GSList* data);
+
+/**
+ * This function finds the strokes whose bounds overlap a rectangle.
+ *
+ * @param document The document to search in.
+ * @param area     The rectangle, in the units of the points (see dt_point).
+ * @param selected An array of document->num_strokes elements. Element 'n'
+ *                 is set to 1 when stroke 'n' overlaps, and to 0 otherwise.
+ * @return The number of strokes that overlap.
+ */
+unsigned int dt_document_find_strokes (const dt_document* document,
+				       const dt_rectangle* area,
+				       unsigned char* selected);
+
+/**
+ * This function frees a document, including its levels of detail.
+ * @param document The document to free.
+ */
+void dt_document_free (dt_document* document);
+
+#endif//DATATYPES_DOCUMENT_H
@@ -47,6 +47,11 @@
  *   - dt_tilt
  * - dt_configuration
  *   - dt_page_dimensions
+ * - dt_document
+ *   - dt_document_stroke
+ *   - dt_point
+ * - dt_stats
+ *   - dt_stats_stage
  * @}
  */
 
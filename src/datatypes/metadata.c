@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metadata.h"
+
+#include <stdlib.h>
+
+/*----------------------------------------------------------------------------.
+ | DT_METADATA_COUNT_STARTS_UNTIL                                             |
+ | This function returns the number of layers that start at or before 'time', |
+ | or before 'time' when 'inclusive' is 0.                                    |
+ '----------------------------------------------------------------------------*/
+static int
+dt_metadata_count_starts_until (const dt_metadata* metadata, double time,
+				int inclusive)
+{
+  int low = 0;
+  int high = metadata->num_layers;
+
+  while (low < high)
+    {
+      int middle = low + (high - low) / 2;
+      double start = metadata->layers[middle].start;
+
+      if (start < time || (inclusive && start == time))
+	low = middle + 1;
+      else
+	high = middle;
+    }
+
+  return low;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_METADATA_NEXT_LAYER                                                     |
+ '----------------------------------------------------------------------------*/
+int
+dt_metadata_next_layer (const dt_metadata* metadata, double time)
+{
+  if (metadata == NULL || metadata->layers == NULL) return -1;
+
+  int index = dt_metadata_count_starts_until (metadata, time, 1);
+  return (index < metadata->num_layers) ? index : -1;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_METADATA_PREVIOUS_LAYER                                                 |
+ '----------------------------------------------------------------------------*/
+int
+dt_metadata_previous_layer (const dt_metadata* metadata, double time)
+{
+  if (metadata == NULL || metadata->layers == NULL) return -1;
+
+  return dt_metadata_count_starts_until (metadata, time, 0) - 1;
+}
@@ -27,11 +27,41 @@
 #ifndef DATATYPES_METADATA_H
 #define DATATYPES_METADATA_H
 
+/**
+ * This struct contains the times at which a layer starts and ends, in
+ * seconds since the start of the recording (see dt_coordinate).
+ */
+typedef struct
+{
+  double start;
+  double end;
+} dt_layer_timing;
+
+/**
+ * This struct contains metadata about a file. The 'layers' array has
+ * 'num_layers' elements, sorted by their start.
+ */
 typedef struct
 {
   int num_layers;
   int num_seconds;
-  GSList* layer_timings;
+  dt_layer_timing* layers;
 } dt_metadata;
 
+/**
+ * This function finds the first layer that starts after a point in time.
+ * @param metadata The metadata to search in.
+ * @param time     The clock value to search from.
+ * @return The index of the layer, or -1 when no layer starts after 'time'.
+ */
+int dt_metadata_next_layer (const dt_metadata* metadata, double time);
+
+/**
+ * This function finds the last layer that starts before a point in time.
+ * @param metadata The metadata to search in.
+ * @param time     The clock value to search from.
+ * @return The index of the layer, or -1 when no layer starts before 'time'.
+ */
+int dt_metadata_previous_layer (const dt_metadata* metadata, double time);
+
 #endif//DATATYPES_METADATA_H
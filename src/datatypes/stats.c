@@ -0,0 +1,453 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stats.h"
+#include "element.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined (HAVE_MALLINFO2) || defined (HAVE_MALLINFO)
+#include <malloc.h>
+#endif
+
+/* The process ID used in the trace. There's only one process in it. */
+#define TRACE_PID 1
+
+/* A thread that appeared in the trace. */
+typedef struct
+{
+  int id;
+  const char* name;
+  int announced;
+} dt_stats_thread;
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_CPU_TIME                                                          |
+ | This function returns the processor time used by the calling thread, in    |
+ | seconds. Where threads can't be told apart, the time of the whole program  |
+ | is used.                                                                   |
+ '----------------------------------------------------------------------------*/
+static double
+dt_stats_cpu_time ()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec now;
+  if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now) == 0)
+    return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+
+  return (double)clock () / CLOCKS_PER_SEC;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_HEAP                                                              |
+ | This function returns the number of bytes allocated on the heap, or -1     |
+ | when the C library can't tell.                                             |
+ '----------------------------------------------------------------------------*/
+static gint64
+dt_stats_heap ()
+{
+#if defined (HAVE_MALLINFO2)
+  struct mallinfo2 info = mallinfo2 ();
+  return (gint64)info.uordblks + (gint64)info.hblkhd;
+#elif defined (HAVE_MALLINFO)
+  struct mallinfo info = mallinfo ();
+  return (gint64)(unsigned int)info.uordblks + (gint64)(unsigned int)info.hblkhd;
+#else
+  return -1;
+#endif
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_NEW                                                               |
+ '----------------------------------------------------------------------------*/
+dt_stats*
+dt_stats_new ()
+{
+  dt_stats* stats = calloc (1, sizeof (dt_stats));
+  if (stats == NULL) return NULL;
+
+  g_mutex_init (&stats->lock);
+  stats->measures_memory = (dt_stats_heap () >= 0);
+  return stats;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_FREE                                                              |
+ '----------------------------------------------------------------------------*/
+void
+dt_stats_free (dt_stats* stats)
+{
+  if (stats == NULL) return;
+
+  if (stats->trace != NULL)
+    {
+      fputs ("\n]}\n", stats->trace);
+      fclose (stats->trace);
+    }
+
+  if (stats->threads != NULL)
+    g_hash_table_destroy (stats->threads);
+
+  g_mutex_clear (&stats->lock);
+  free (stats);
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_RESET                                                             |
+ '----------------------------------------------------------------------------*/
+void
+dt_stats_reset (dt_stats* stats)
+{
+  if (stats == NULL) return;
+
+  g_mutex_lock (&stats->lock);
+  stats->num_stages = 0;
+  g_mutex_unlock (&stats->lock);
+}
+
+/*----------------------------------------------------------------------------.
+ | TRACING                                                                    |
+ | The events are written as soon as they end, so a trace of a long session   |
+ | doesn't have to be kept in memory. The functions below must be called     |
+ | with the lock held.                                                        |
+ '----------------------------------------------------------------------------*/
+
+static void
+dt_stats_trace_separate (dt_stats* stats)
+{
+  fputs ((stats->trace_events++ > 0) ? ",\n" : "\n", stats->trace);
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_TRACE_THREAD                                                      |
+ | This function returns the number of the calling thread in the trace, and  |
+ | writes its name when it's new or has changed. 'name' may be NULL.          |
+ '----------------------------------------------------------------------------*/
+static int
+dt_stats_trace_thread (dt_stats* stats, const char* name)
+{
+  GThread* self = g_thread_self ();
+  dt_stats_thread* thread = g_hash_table_lookup (stats->threads, self);
+
+  if (thread == NULL)
+    {
+      thread = calloc (1, sizeof (dt_stats_thread));
+      if (thread == NULL) return 0;
+
+      thread->id = g_hash_table_size (stats->threads) + 1;
+      g_hash_table_insert (stats->threads, self, thread);
+    }
+
+  if (name != NULL && (thread->name == NULL || strcmp (thread->name, name)))
+    thread->name = name, thread->announced = 0;
+
+  if (!thread->announced)
+    {
+      dt_stats_trace_separate (stats);
+      fprintf (stats->trace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+	       "\"tid\":%d,\"args\":{\"name\":\"", TRACE_PID, thread->id);
+
+      if (thread->name != NULL)
+	fputs (thread->name, stats->trace);
+      else
+	fprintf (stats->trace, "thread %d", thread->id);
+
+      fputs ("\"}}", stats->trace);
+      thread->announced = 1;
+    }
+
+  return thread->id;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_TRACE_EVENT                                                       |
+ | This function writes a "complete" event, which has a start and a duration. |
+ | 'allocated' is left out when it's negative.                                |
+ '----------------------------------------------------------------------------*/
+static void
+dt_stats_trace_event (dt_stats* stats, const char* name, gint64 start,
+		      gint64 end, guint64 elements, guint64 points,
+		      gint64 allocated)
+{
+  int thread = dt_stats_trace_thread (stats, NULL);
+
+  dt_stats_trace_separate (stats);
+  fprintf (stats->trace, "{\"name\":\"%s\",\"cat\":\"inklingreader\",\"ph\":\"X\","
+	   "\"pid\":%d,\"tid\":%d,\"ts\":%lld,\"dur\":%lld,\"args\":{"
+	   "\"elements\":%llu,\"points\":%llu", name, TRACE_PID, thread,
+	   (long long)(start - stats->trace_start), (long long)(end - start),
+	   (unsigned long long)elements, (unsigned long long)points);
+
+  if (allocated >= 0)
+    fprintf (stats->trace, ",\"allocated_bytes\":%lld", (long long)allocated);
+
+  fputs ("}}", stats->trace);
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_TRACE_TO                                                          |
+ '----------------------------------------------------------------------------*/
+int
+dt_stats_trace_to (dt_stats* stats, const char* filename)
+{
+  if (stats->trace != NULL) return 1;
+
+  FILE* trace = fopen (filename, "w");
+  if (trace == NULL)
+    {
+      printf ("Couldn't write to '%s'.\n", filename);
+      return 1;
+    }
+
+  g_mutex_lock (&stats->lock);
+
+  stats->trace = trace;
+  stats->trace_start = g_get_monotonic_time ();
+  stats->trace_events = 0;
+  stats->threads = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, free);
+
+  fputs ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", trace);
+  dt_stats_trace_separate (stats);
+  fprintf (trace, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+	   "\"args\":{\"name\":\"inklingreader\"}}", TRACE_PID);
+  dt_stats_trace_thread (stats, "main");
+
+  g_mutex_unlock (&stats->lock);
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_NAME_THREAD                                                       |
+ '----------------------------------------------------------------------------*/
+void
+dt_stats_name_thread (dt_stats* stats, const char* name)
+{
+  if (stats == NULL || stats->trace == NULL) return;
+
+  g_mutex_lock (&stats->lock);
+  dt_stats_trace_thread (stats, name);
+  g_mutex_unlock (&stats->lock);
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_SPAN_START                                                        |
+ '----------------------------------------------------------------------------*/
+void
+dt_stats_span_start (const dt_stats* stats, dt_stats_mark* mark)
+{
+  if (stats == NULL || stats->trace == NULL) return;
+
+  mark->wall_time = g_get_monotonic_time ();
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_SPAN_STOP                                                         |
+ '----------------------------------------------------------------------------*/
+void
+dt_stats_span_stop (dt_stats* stats, const char* name, const dt_stats_mark* mark,
+		    guint64 elements, guint64 points)
+{
+  if (stats == NULL || stats->trace == NULL) return;
+
+  gint64 end = g_get_monotonic_time ();
+
+  g_mutex_lock (&stats->lock);
+  dt_stats_trace_event (stats, name, mark->wall_time, end, elements, points, -1);
+  g_mutex_unlock (&stats->lock);
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_START                                                             |
+ '----------------------------------------------------------------------------*/
+void
+dt_stats_start (const dt_stats* stats, dt_stats_mark* mark)
+{
+  if (stats == NULL) return;
+
+  mark->heap = (stats->measures_memory) ? dt_stats_heap () : -1;
+  mark->cpu_time = dt_stats_cpu_time ();
+  mark->wall_time = g_get_monotonic_time ();
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_STOP                                                              |
+ '----------------------------------------------------------------------------*/
+void
+dt_stats_stop (dt_stats* stats, const char* name, const dt_stats_mark* mark,
+	       guint64 elements, guint64 points)
+{
+  if (stats == NULL) return;
+
+  gint64 end = g_get_monotonic_time ();
+  gint64 wall_time = end - mark->wall_time;
+  double cpu_time = dt_stats_cpu_time () - mark->cpu_time;
+  gint64 allocated = (mark->heap >= 0) ? dt_stats_heap () - mark->heap : 0;
+
+  g_mutex_lock (&stats->lock);
+
+  /* There are only a handful of stages, so a linear search will do. */
+  dt_stats_stage* stage = NULL;
+  unsigned int index;
+  for (index = 0; index < stats->num_stages; index++)
+    if (stats->stages[index].name == name
+	|| !strcmp (stats->stages[index].name, name))
+      {
+	stage = &stats->stages[index];
+	break;
+      }
+
+  if (stage == NULL && stats->num_stages < DT_STATS_MAX_STAGES)
+    {
+      stage = &stats->stages[stats->num_stages++];
+      memset (stage, 0, sizeof (dt_stats_stage));
+      stage->name = name;
+    }
+
+  if (stage != NULL)
+    {
+      stage->calls++;
+      stage->wall_time += wall_time / (double)G_USEC_PER_SEC;
+      stage->cpu_time += cpu_time;
+      stage->allocated += allocated;
+      stage->elements += elements;
+      stage->points += points;
+    }
+
+  if (stats->trace != NULL)
+    dt_stats_trace_event (stats, name, mark->wall_time, end, elements, points,
+			  (mark->heap >= 0) ? allocated : -1);
+
+  g_mutex_unlock (&stats->lock);
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_STOP_DATA                                                         |
+ '----------------------------------------------------------------------------*/
+void
+dt_stats_stop_data (dt_stats* stats, const char* name,
+		    const dt_stats_mark* mark, GSList* data)
+{
+  if (stats == NULL) return;
+
+  guint64 elements = 0, points = 0;
+  for (; data != NULL; data = data->next, elements++)
+    if (((dt_element*)data->data)->type == TYPE_COORDINATE)
+      points++;
+
+  dt_stats_stop (stats, name, mark, elements, points);
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_APPEND_SIZE                                                       |
+ | This function appends a number of bytes in a unit that is easy to read.    |
+ '----------------------------------------------------------------------------*/
+static void
+dt_stats_append_size (GString* output, gint64 bytes)
+{
+  static const char* units[] = { "B", "KiB", "MiB", "GiB" };
+  double size = (bytes < 0) ? -bytes : bytes;
+  unsigned int unit = 0;
+
+  while (size >= 1024 && unit < G_N_ELEMENTS (units) - 1)
+    size /= 1024, unit++;
+
+  char text[32];
+  snprintf (text, sizeof (text), "%s%.*f %s", (bytes < 0) ? "-" : "",
+	    (unit == 0) ? 0 : 1, size, units[unit]);
+  g_string_append_printf (output, "%12s", text);
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_TO_STRING                                                         |
+ '----------------------------------------------------------------------------*/
+char*
+dt_stats_to_string (dt_stats* stats, int format)
+{
+  GString* output = g_string_new (NULL);
+  unsigned int index;
+
+  g_mutex_lock (&stats->lock);
+
+  if (format == DT_STATS_JSON)
+    {
+      g_string_append (output, "{ \"stages\": [");
+      for (index = 0; index < stats->num_stages; index++)
+	{
+	  const dt_stats_stage* stage = &stats->stages[index];
+	  g_string_append_printf (output, "%s\n  { \"stage\": \"%s\", \"calls\": %u, "
+				  "\"wall_ms\": %.3f, \"cpu_ms\": %.3f, ",
+				  (index > 0) ? "," : "", stage->name, stage->calls,
+				  stage->wall_time * 1000, stage->cpu_time * 1000);
+
+	  if (stats->measures_memory)
+	    g_string_append_printf (output, "\"allocated_bytes\": %lld, ",
+				    (long long)stage->allocated);
+	  else
+	    g_string_append (output, "\"allocated_bytes\": null, ");
+
+	  g_string_append_printf (output, "\"elements\": %llu, \"points\": %llu }",
+				  (unsigned long long)stage->elements,
+				  (unsigned long long)stage->points);
+	}
+      g_string_append (output, " ] }\n");
+    }
+  else
+    {
+      g_string_append_printf (output, "%-14s %6s %12s %12s %12s %10s %10s\n",
+			      "Stage", "Calls", "Wall time", "CPU time",
+			      "Allocated", "Elements", "Points");
+
+      for (index = 0; index < stats->num_stages; index++)
+	{
+	  const dt_stats_stage* stage = &stats->stages[index];
+	  g_string_append_printf (output, "%-14s %6u %9.3f ms %9.3f ms ",
+				  stage->name, stage->calls,
+				  stage->wall_time * 1000, stage->cpu_time * 1000);
+
+	  if (stats->measures_memory)
+	    dt_stats_append_size (output, stage->allocated);
+	  else
+	    g_string_append_printf (output, "%12s", "-");
+
+	  g_string_append_printf (output, " %10llu %10llu\n",
+				  (unsigned long long)stage->elements,
+				  (unsigned long long)stage->points);
+	}
+    }
+
+  g_mutex_unlock (&stats->lock);
+
+  return g_string_free (output, FALSE);
+}
+
+/*----------------------------------------------------------------------------.
+ | DT_STATS_WRITE                                                             |
+ '----------------------------------------------------------------------------*/
+void
+dt_stats_write (dt_stats* stats, int format, FILE* stream)
+{
+  char* output = dt_stats_to_string (stats, format);
+  fputs (output, stream);
+  fflush (stream);
+  g_free (output);
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file   datatypes/stats.h
+ * @brief  Measure how long each step of a conversion takes, and trace when
+ *         each step ran.
+ * @author Roel Janssen
+ * @namespace datatypes
+ */
+
+#ifndef DATATYPES_STATS_H
+#define DATATYPES_STATS_H
+
+#include <stdio.h>
+#include <glib.h>
+
+/* The number of different stages that can be measured. */
+#define DT_STATS_MAX_STAGES 16
+
+/* The formats dt_stats_write() can write in. */
+#define DT_STATS_TEXT 0
+#define DT_STATS_JSON 1
+
+/**
+ * This struct contains the totals of a stage of the conversion (like
+ * "parse" or "svg") over all the times it ran. The 'allocated' bytes are
+ * the growth of the heap during the stage, of the whole program. That is
+ * mostly the memory taken up by the result of the stage.
+ */
+typedef struct
+{
+  const char* name;
+  unsigned int calls;
+  double wall_time;
+  double cpu_time;
+  gint64 allocated;
+  guint64 elements;
+  guint64 points;
+} dt_stats_stage;
+
+/**
+ * This struct collects the measurements of all stages. It can be shared by
+ * several threads. 'report' is set when the totals were asked for. When
+ * 'trace' is not NULL, every stage and span is also written to it as a
+ * trace event (see dt_stats_trace_to()).
+ */
+typedef struct
+{
+  GMutex lock;
+  int measures_memory;
+  int report;
+  unsigned int num_stages;
+  dt_stats_stage stages[DT_STATS_MAX_STAGES];
+  FILE* trace;
+  gint64 trace_start;
+  guint64 trace_events;
+  GHashTable* threads;
+} dt_stats;
+
+/**
+ * This struct holds the moment a stage started (see dt_stats_start()).
+ */
+typedef struct
+{
+  gint64 wall_time;
+  double cpu_time;
+  gint64 heap;
+} dt_stats_mark;
+
+/**
+ * This function creates an empty collection of measurements.
+ * @return A dt_stats that should be freed with dt_stats_free().
+ */
+dt_stats* dt_stats_new ();
+
+/**
+ * This function frees the measurements, and completes the trace.
+ * @param stats The dt_stats to free. May be NULL.
+ */
+void dt_stats_free (dt_stats* stats);
+
+/**
+ * This function forgets all measurements, to start over.
+ * @param stats The dt_stats to clear. May be NULL.
+ */
+void dt_stats_reset (dt_stats* stats);
+
+/**
+ * This function marks the start of a stage. Nothing is measured when
+ * 'stats' is NULL, so it can be called unconditionally.
+ * @param stats The dt_stats the stage will be added to. May be NULL.
+ * @param mark  Is set to the current time and memory use.
+ */
+void dt_stats_start (const dt_stats* stats, dt_stats_mark* mark);
+
+/**
+ * This function adds the time and memory used since dt_stats_start() to a
+ * stage.
+ * @param stats    The dt_stats to add the stage to. May be NULL.
+ * @param name     The name of the stage. The string must stay valid as long
+ *                 as 'stats' exists, so it should be a literal.
+ * @param mark     The mark set by dt_stats_start().
+ * @param elements The number of elements the stage handled.
+ * @param points   The number of points the stage handled.
+ */
+void dt_stats_stop (dt_stats* stats, const char* name, const dt_stats_mark* mark,
+		    guint64 elements, guint64 points);
+
+/**
+ * This function does the same as dt_stats_stop(), but counts the elements
+ * and coordinates of parsed data. The data is only counted when 'stats' is
+ * not NULL.
+ * @param stats    The dt_stats to add the stage to. May be NULL.
+ * @param name     The name of the stage.
+ * @param mark     The mark set by dt_stats_start().
+ * @param data     Data parsed with p_wpi_parse().
+ */
+void dt_stats_stop_data (dt_stats* stats, const char* name,
+			 const dt_stats_mark* mark, GSList* data);
+
+/**
+ * This function marks the start of a span. Spans only end up in the trace,
+ * not in the totals, and are cheap enough to mark small steps like a single
+ * stroke. Nothing is measured when 'stats' is NULL or isn't tracing.
+ * @param stats The dt_stats the span will be added to. May be NULL.
+ * @param mark  Is set to the current time.
+ */
+void dt_stats_span_start (const dt_stats* stats, dt_stats_mark* mark);
+
+/**
+ * This function writes a span that started at dt_stats_span_start() to the
+ * trace.
+ * @param stats    The dt_stats to add the span to. May be NULL.
+ * @param name     The name of the span.
+ * @param mark     The mark set by dt_stats_span_start().
+ * @param elements The number of elements the span handled.
+ * @param points   The number of points the span handled.
+ */
+void dt_stats_span_stop (dt_stats* stats, const char* name, const dt_stats_mark* mark,
+			 guint64 elements, guint64 points);
+
+/**
+ * This function starts writing trace events to a file, in the Trace Event
+ * Format that chrome://tracing and Perfetto can open. The file is completed
+ * by dt_stats_free(). The calling thread is named "main".
+ * @param stats    The dt_stats to trace.
+ * @param filename The file to write the trace to.
+ * @return 0 when the file was opened, 1 when something went wrong.
+ */
+int dt_stats_trace_to (dt_stats* stats, const char* filename);
+
+/**
+ * This function gives the calling thread a name in the trace. Threads that
+ * aren't named are called "thread N".
+ * @param stats The dt_stats that is tracing. May be NULL.
+ * @param name  The name of the thread. It must stay valid as long as
+ *              'stats' exists.
+ */
+void dt_stats_name_thread (dt_stats* stats, const char* name);
+
+/**
+ * This function describes the measurements as a table for people to read,
+ * or as a JSON object.
+ * @param stats  The measurements.
+ * @param format DT_STATS_TEXT or DT_STATS_JSON.
+ * @return A string that should be freed with g_free().
+ */
+char* dt_stats_to_string (dt_stats* stats, int format);
+
+/**
+ * This function writes the measurements to a stream, like
+ * dt_stats_to_string() describes them.
+ * @param stats  The measurements.
+ * @param format DT_STATS_TEXT or DT_STATS_JSON.
+ * @param stream The stream to write to.
+ */
+void dt_stats_write (dt_stats* stats, int format, FILE* stream);
+
+#endif//DATATYPES_STATS_H
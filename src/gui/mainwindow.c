@@ -18,12 +18,9 @@
  */
 
 #include "mainwindow.h"
+#include "preview.h"
+#include "playback.h"
 #include "../datatypes/configuration.h"
-#include "../converters/svg.h"
-#include "../converters/png.h"
-#include "../converters/pdf.h"
-#include "../converters/json.h"
-#include "../converters/csv.h"
 #include "../parsers/wpi.h"
 #include "../datatypes/element.h"
 #include "../high/conversion.h"
@@ -37,6 +34,9 @@
 #define WINDOW_HEIGHT 600
 #define PT_TO_MM 2.8333
 
+/* The number of milliseconds between updates of the statistics overlay. */
+#define STATS_INTERVAL 500
+
 extern dt_configuration settings;
 extern dt_preset_dimensions formats[];
 
@@ -54,12 +54,18 @@ static GtkWidget* hbox_timing;
 static GtkWidget* clock_scale;
 static GSList* parsed_data;
 static dt_metadata* metadata;
-static RsvgHandle* handle;
 static char* last_file_extension;
 static char* last_dir;
-static guint timeout_id = 0;
 static gboolean is_playing = FALSE;
 static GtkWidget* play_button;
+static GtkWidget* speed_input;
+static GtkWidget* stats_box;
+static GtkWidget* stats_label;
+static guint stats_timer = 0;
+
+/* The playback speeds to choose from, as multiples of real time. */
+static const double playback_speeds[] = { 1, 2, 5, 10, 25 };
+static const char* playback_speed_names[] = { "1x", "2x", "5x", "10x", "25x" };
 
 static const char* file_mimetypes[]  = { 
   "application/pdf", 
@@ -119,6 +125,8 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
   GtkWidget* save_config_button;
   GtkWidget* vbox_pane;
   GtkWidget* hbox_pane;
+  GtkWidget* stats_button;
+  GtkWidget* document_overlay;
   
   /*--------------------------------------------------------------------------.
    | INIT AND CREATION OF WIDGETS                                             |
@@ -127,6 +135,12 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
 
   window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
 
+  /* The conversions are always measured in the graphical user interface.
+   * The overlay is shown from the start when --stats was given. */
+  gboolean show_stats = (settings.stats != NULL && settings.stats->report);
+  if (settings.stats == NULL)
+    settings.stats = dt_stats_new ();
+
   /*--------------------------------------------------------------------------.
    | HEADER BAR AND BUTTONS                                                   |
    '--------------------------------------------------------------------------*/
@@ -139,6 +153,7 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
   export_button = gtk_button_new_with_label ("Export");
   settings_button = gtk_button_new_with_label ("Settings");
   timing_button = gtk_button_new_with_label ("Timeline");
+  stats_button = gtk_toggle_button_new_with_label ("Statistics");
   save_config_button = gtk_button_new_with_label ("Save configuration");
 
   vbox_pane = gtk_paned_new (GTK_ORIENTATION_VERTICAL);
@@ -148,6 +163,7 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
   gtk_header_bar_pack_start (GTK_HEADER_BAR (header), export_button);
   gtk_header_bar_pack_end (GTK_HEADER_BAR (header), settings_button);
   gtk_header_bar_pack_end (GTK_HEADER_BAR (header), timing_button);
+  gtk_header_bar_pack_end (GTK_HEADER_BAR (header), stats_button);
 
   /*--------------------------------------------------------------------------.
    | INITIALIZATION OF CONTAINERS                                             |
@@ -158,6 +174,18 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
   document_container = gtk_scrolled_window_new (NULL, NULL);
   document_viewport = gtk_viewport_new (NULL, NULL);
   document_view = gtk_drawing_area_new ();
+  gui_preview_init (document_view);
+
+  /* The statistics are shown in the top-left corner of the document view,
+   * on top of the document. */
+  document_overlay = gtk_overlay_new ();
+  stats_box = gtk_event_box_new ();
+  stats_label = gtk_label_new (NULL);
+  gtk_label_set_selectable (GTK_LABEL (stats_label), TRUE);
+  gtk_container_add (GTK_CONTAINER (stats_box), stats_label);
+  gtk_widget_set_halign (stats_box, GTK_ALIGN_START);
+  gtk_widget_set_valign (stats_box, GTK_ALIGN_START);
+  gtk_container_set_border_width (GTK_CONTAINER (stats_box), 10);
 
   /*--------------------------------------------------------------------------.
    | SETTINGS POPOVER                                                         |
@@ -279,6 +307,14 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
 
   clock_scale = gtk_scale_new_with_range (GTK_ORIENTATION_HORIZONTAL, 0, 1, 1);
   gtk_scale_set_value_pos (GTK_SCALE (clock_scale), GTK_POS_LEFT);
+
+  speed_input = gtk_combo_box_text_new ();
+  unsigned int speed = 0;
+  for (; speed < sizeof (playback_speeds) / sizeof (double); speed++)
+    gtk_combo_box_text_append (GTK_COMBO_BOX_TEXT (speed_input), NULL,
+			       playback_speed_names[speed]);
+
+  gtk_combo_box_set_active (GTK_COMBO_BOX (speed_input), 0);
   
   /*--------------------------------------------------------------------------.
    | FURTHER CONFIGURATION                                                    |
@@ -293,6 +329,13 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
   gtk_container_add (GTK_CONTAINER (document_viewport), document_view);
   gtk_container_add (GTK_CONTAINER (document_container), document_viewport);
 
+  GdkRGBA stats_bg;
+  gdk_rgba_parse (&stats_bg, "rgba(255,255,255,0.85)");
+  gtk_widget_override_background_color (stats_box, GTK_STATE_FLAG_NORMAL, &stats_bg);
+
+  gtk_container_add (GTK_CONTAINER (document_overlay), document_container);
+  gtk_overlay_add_overlay (GTK_OVERLAY (document_overlay), stats_box);
+
   gtk_spin_button_set_value (GTK_SPIN_BUTTON (pressure_input), settings.pressure_factor);
   gtk_spin_button_set_value (GTK_SPIN_BUTTON (zoom_input), 100.0);
   gtk_switch_set_active (GTK_SWITCH (zoom_toggle), FALSE);
@@ -301,7 +344,7 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
   /*--------------------------------------------------------------------------.
    | CONTAINERS                                                               |
    '--------------------------------------------------------------------------*/
-  gtk_paned_pack1 (GTK_PANED (vbox_pane), document_container, 1, 1);
+  gtk_paned_pack1 (GTK_PANED (vbox_pane), document_overlay, 1, 1);
   gtk_paned_pack2 (GTK_PANED (vbox_pane), hbox_timing, 0, 0);
 
   gtk_paned_pack1 (GTK_PANED (hbox_pane), vbox_pane, 1, 1);
@@ -312,6 +355,7 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
   gtk_box_pack_start (GTK_BOX (hbox_timing), play_button, 0, 0, 5);
   gtk_box_pack_start (GTK_BOX (hbox_timing), backward_button, 0, 0, 5);
   gtk_box_pack_start (GTK_BOX (hbox_timing), forward_button, 0, 0, 5);
+  gtk_box_pack_start (GTK_BOX (hbox_timing), speed_input, 0, 0, 5);
   gtk_box_pack_end (GTK_BOX (hbox_timing), clock_scale, 1, 1, 5);
 
   gtk_container_add (GTK_CONTAINER (window), vbox_window);
@@ -355,6 +399,9 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
   g_signal_connect (G_OBJECT (clock_scale), "value-changed",
 		    G_CALLBACK (gui_mainwindow_set_clock_value), NULL);
 
+  g_signal_connect (G_OBJECT (speed_input), "changed",
+		    G_CALLBACK (gui_mainwindow_set_speed_input), NULL);
+
   g_signal_connect (G_OBJECT (zoom_toggle), "notify::active",
 		    G_CALLBACK (gui_mainwindow_set_zoom_toggle), NULL);
 
@@ -376,6 +423,9 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
   g_signal_connect (G_OBJECT (save_config_button), "clicked",
 		    G_CALLBACK (gui_mainwindow_save_settings), NULL);
 
+  g_signal_connect (G_OBJECT (stats_button), "toggled",
+		    G_CALLBACK (gui_mainwindow_toggle_stats), NULL);
+
   /*--------------------------------------------------------------------------.
    | DISPLAY                                                                  |
    '--------------------------------------------------------------------------*/
@@ -384,6 +434,8 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
   gtk_widget_hide (zoom_input);
   gtk_widget_hide (vbox_settings);
   gtk_widget_hide (hbox_timing);
+  gtk_widget_hide (stats_box);
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (stats_button), show_stats);
   gtk_widget_set_sensitive (GTK_WIDGET (export_button), FALSE);
   gtk_widget_set_sensitive (GTK_WIDGET (timing_button), FALSE);
   
@@ -399,10 +451,9 @@ gui_mainwindow_init (int argc, char** argv, const char* filename)
 static void
 gui_mainwindow_redisplay ()
 {
-  /* Clean up the (old) RsvgHandle data when it's set at this point. */
-  if (handle != NULL)
-    g_object_unref (handle), handle = NULL;
-
+  /* Let the preview render the document again with the new settings. */
+  gui_preview_invalidate ();
+  gui_playback_invalidate ();
   gtk_widget_queue_draw (document_view);
 }
 
@@ -490,20 +541,44 @@ gui_mainwindow_file_dialog (GtkWidget* parent, GtkFileChooserAction action)
   return filename;
 }
 
+/*----------------------------------------------------------------------------.
+ | GUI_MAINWINDOW_STOP_PLAYING                                                |
+ | This function stops the playback and lets the preview show the document    |
+ | up to the clock value that was reached.                                    |
+ '----------------------------------------------------------------------------*/
+static void
+gui_mainwindow_stop_playing ()
+{
+  if (!is_playing) return;
+
+  gui_playback_stop ();
+
+  GtkWidget* icon = gtk_image_new_from_icon_name ("media-playback-start",
+						  GTK_ICON_SIZE_LARGE_TOOLBAR);
+  gtk_button_set_image (GTK_BUTTON (play_button), icon);
+  is_playing = FALSE;
+
+  settings.process_until = (unsigned short)gtk_range_get_value (GTK_RANGE (clock_scale));
+  gui_mainwindow_redisplay ();
+}
+
 /*----------------------------------------------------------------------------.
  | GUI_MAINWINDOW_UPDATE_CLOCK                                                |
- | This function applies the next step in time for the "play" feature.        |
+ | This function moves the clock scale along with the playback, without      |
+ | making the preview render every step.                                      |
  '----------------------------------------------------------------------------*/
-gboolean
-gui_mainwindow_update_clock ()
+void
+gui_mainwindow_update_clock (double clock, gboolean finished)
 {
-  double value = gtk_range_get_value (GTK_RANGE (clock_scale));
-  gtk_range_set_value (GTK_RANGE (clock_scale), value + 1);
-  if (value >= settings.process_until)
-    g_source_remove (timeout_id),
-    timeout_id = 0;
+  if (finished)
+    clock = gtk_adjustment_get_upper (gtk_range_get_adjustment (GTK_RANGE (clock_scale)));
 
-  return TRUE;
+  g_signal_handlers_block_by_func (clock_scale, gui_mainwindow_set_clock_value, NULL);
+  gtk_range_set_value (GTK_RANGE (clock_scale), clock);
+  g_signal_handlers_unblock_by_func (clock_scale, gui_mainwindow_set_clock_value, NULL);
+
+  if (finished)
+    gui_mainwindow_stop_playing ();
 }
 
 /*----------------------------------------------------------------------------.
@@ -513,30 +588,36 @@ gui_mainwindow_update_clock ()
 void
 gui_mainwindow_play ()
 {
-  if (timeout_id != 0)
-    g_source_remove (timeout_id),
-    timeout_id = 0;
-
-  GtkWidget *icon;
-  
-  if (!is_playing)
+  if (is_playing)
     {
-      timeout_id = g_timeout_add (100, gui_mainwindow_update_clock, NULL);
+      gui_mainwindow_stop_playing ();
+      return;
+    }
 
-      icon = gtk_image_new_from_icon_name ("media-playback-pause",
-					   GTK_ICON_SIZE_LARGE_TOOLBAR);
+  if (parsed_data == NULL) return;
 
-      gtk_button_set_image (GTK_BUTTON (play_button), icon);
-      is_playing = TRUE;
-    }
-  else
-    {
-      icon = gtk_image_new_from_icon_name ("media-playback-start",
-					   GTK_ICON_SIZE_LARGE_TOOLBAR);
+  /* Start over when the clock is at the end. */
+  double from = gtk_range_get_value (GTK_RANGE (clock_scale));
+  if (from >= gtk_adjustment_get_upper (gtk_range_get_adjustment (GTK_RANGE (clock_scale))))
+    from = 0;
 
-      gtk_button_set_image (GTK_BUTTON (play_button), icon);      
-      is_playing = FALSE;
-    }
+  GtkWidget* icon = gtk_image_new_from_icon_name ("media-playback-pause",
+						  GTK_ICON_SIZE_LARGE_TOOLBAR);
+  gtk_button_set_image (GTK_BUTTON (play_button), icon);
+  is_playing = TRUE;
+
+  gui_playback_start (document_view, from, gui_mainwindow_update_clock);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_MAINWINDOW_SET_SPEED_INPUT                                             |
+ '----------------------------------------------------------------------------*/
+void
+gui_mainwindow_set_speed_input (GtkWidget* widget)
+{
+  int speed = gtk_combo_box_get_active (GTK_COMBO_BOX (widget));
+  if (speed >= 0)
+    gui_playback_set_speed (playback_speeds[speed]);
 }
 
 /*----------------------------------------------------------------------------.
@@ -548,21 +629,11 @@ gui_mainwindow_forward ()
 {
   if (metadata == NULL) return;
 
-  metadata->layer_timings = g_slist_reverse (metadata->layer_timings);
-  GSList* timings = metadata->layer_timings;
-  while (timings != NULL)
-    {
-      double timings_value = (double)*(int *)timings->data;
-      if (timings_value > gtk_range_get_value (GTK_RANGE (clock_scale))) break;
-      timings = timings->next;
-    }
-
-  if (timings != NULL)
-    gtk_range_set_value (GTK_RANGE (clock_scale), *(int *)timings->data);
+  int layer = dt_metadata_next_layer (metadata, gtk_range_get_value (GTK_RANGE (clock_scale)));
+  if (layer >= 0)
+    gtk_range_set_value (GTK_RANGE (clock_scale), metadata->layers[layer].start);
   else
     gtk_range_set_value (GTK_RANGE (clock_scale), metadata->num_seconds);
-
-  metadata->layer_timings = g_slist_reverse (metadata->layer_timings);
 }
 
 /*----------------------------------------------------------------------------.
@@ -573,16 +644,10 @@ void
 gui_mainwindow_backward ()
 {
   if (metadata == NULL) return;
-  GSList* timings = metadata->layer_timings;
-  while (timings != NULL)
-    {
-      double timings_value = (double)*(int *)timings->data;
-      if (timings_value < gtk_range_get_value (GTK_RANGE (clock_scale))) break;
-      timings = timings->next;
-    }
 
-  if (timings != NULL)
-    gtk_range_set_value (GTK_RANGE (clock_scale), *(int *)timings->data);
+  int layer = dt_metadata_previous_layer (metadata, gtk_range_get_value (GTK_RANGE (clock_scale)));
+  if (layer >= 0)
+    gtk_range_set_value (GTK_RANGE (clock_scale), metadata->layers[layer].start);
   else
     gtk_range_set_value (GTK_RANGE (clock_scale), 0);
 }
@@ -613,34 +678,47 @@ gui_mainwindow_file_activated (GtkWidget* widget, void* data)
 
       free (window_title);
 
+      gui_mainwindow_stop_playing ();
+
       /* Clean-up the old parsed data. */
       if (parsed_data)
 	{
 	  p_wpi_cleanup (parsed_data), parsed_data = NULL;
 	  p_wpi_metadata_cleanup (metadata), metadata = NULL;
 	}
-	  
+
+      /* The statistics only describe the document that is shown. */
+      dt_stats_reset (settings.stats);
+
+      dt_stats_mark mark;
+      dt_stats_start (settings.stats, &mark);
       parsed_data = p_wpi_parse (filename, &settings.process_until);
+      dt_stats_stop_data (settings.stats, "parse", &mark, parsed_data);
+      gui_preview_load (filename);
+      gui_playback_load (parsed_data);
       gtk_scale_clear_marks (GTK_SCALE (clock_scale));
+
+      dt_stats_start (settings.stats, &mark);
+      metadata = p_wpi_get_metadata (parsed_data);
+      dt_stats_stop_data (settings.stats, "metadata", &mark, parsed_data);
+
+      /* The clock scale, the layer marks, the playback and the preview all
+       * use the seconds since the start of the recording. */
+      if (metadata != NULL)
+	settings.process_until = metadata->num_seconds;
+
       gtk_range_set_range (GTK_RANGE (clock_scale), 0, settings.process_until);
       gtk_range_set_value (GTK_RANGE (clock_scale), settings.process_until);
 
-      metadata = p_wpi_get_metadata (parsed_data);
       if (metadata != NULL)
 	{
-	  if (metadata->num_layers > 1)
-	    gtk_scale_add_mark (GTK_SCALE (clock_scale), 0, GTK_POS_BOTTOM, "Layer 1");
-	      
-	  short layer_number = metadata->num_layers;
-	  GSList* timings = metadata->layer_timings;
-	  while (timings != NULL)
+	  int layer = 0;
+	  for (; metadata->num_layers > 1 && layer < metadata->num_layers; layer++)
 	    {
-	      char layername[9];
-	      memset (&layername, '\0', 9);
-	      snprintf ((char *)layername, 9, "Layer %d", layer_number);
-	      gtk_scale_add_mark (GTK_SCALE (clock_scale), *(int *)timings->data, GTK_POS_BOTTOM, layername);
-	      timings = timings->next;
-	      layer_number--;
+	      char layername[16];
+	      snprintf (layername, sizeof (layername), "Layer %d", layer + 1);
+	      gtk_scale_add_mark (GTK_SCALE (clock_scale), metadata->layers[layer].start,
+				  GTK_POS_BOTTOM, layername);
 	    }
 	}
 
@@ -674,20 +752,10 @@ gui_mainwindow_export_activated (GtkWidget* widget)
 
   if (filename == NULL) return;
 
+  /* The preview only keeps image tiles, so the document is converted
+   * from the parsed data. */
   char* ext = strrchr (filename, '.');
-  if (!strcmp (ext, ".png") && CAIRO_HAS_PNG_FUNCTIONS)
-    co_png_export_to_file_from_handle (filename, handle);
-
-  else if (!strcmp (ext, ".pdf"))
-    co_pdf_export_to_file_from_handle (filename, handle);
-
-  else if (!strcmp (ext, ".json"))
-    co_json_create_file (filename, parsed_data);
-
-  else if (!strcmp (ext, ".csv"))
-    co_csv_create_file (filename, parsed_data);
-
-  else if (!strcmp (ext, ".svg"))
+  if (ext != NULL && (strcmp (ext, ".png") || CAIRO_HAS_PNG_FUNCTIONS))
     high_export_to_file (parsed_data, NULL, filename, &settings);
 
   g_free (filename);
@@ -700,7 +768,7 @@ gui_mainwindow_export_activated (GtkWidget* widget)
 gboolean
 gui_mainwindow_document_view_draw (GtkWidget *widget, cairo_t *cr)
 {
-  if (parsed_data == NULL && handle == NULL) return 0;
+  if (parsed_data == NULL) return 0;
 
   double w = gtk_widget_get_allocated_width (document_container);
   double ratio = 1.00;
@@ -708,31 +776,34 @@ gui_mainwindow_document_view_draw (GtkWidget *widget, cairo_t *cr)
   if (!gtk_widget_get_visible (zoom_input))
     ratio = w / (settings.page.width * PT_TO_MM * 1.25) / 1.15;
   else
-    ratio = gtk_spin_button_get_value (GTK_SPIN_BUTTON (zoom_input)) / 100.0,
-    gtk_spin_button_set_value (GTK_SPIN_BUTTON (zoom_input), ratio * 100);
+    ratio = gtk_spin_button_get_value (GTK_SPIN_BUTTON (zoom_input)) / 100.0;
 
   double padding = ((w - (settings.page.width * PT_TO_MM * 1.25 * ratio)) / 2);
   if (padding < 0) padding = 0;
   double h = settings.page.height * PT_TO_MM * 1.25 * ratio + padding * 2;
   w = settings.page.width * PT_TO_MM * 1.25 * ratio + padding;
 
-  gtk_widget_set_size_request (widget, w, h);
+  /* Changing the size request causes a new layout, so only do it when the
+   * size actually changes. */
+  int current_w, current_h;
+  gtk_widget_get_size_request (widget, &current_w, &current_h);
+  if (current_w != (int)w || current_h != (int)h)
+    gtk_widget_set_size_request (widget, w, h);
 
-  cairo_translate (cr, padding, padding);
-  cairo_scale (cr, ratio, ratio);
+  /* The document is rendered in the background. Only the parts that are
+   * finished are painted here. During playback, the strokes are added to
+   * the page as they come due. */
+  dt_stats_mark mark;
+  dt_stats_span_start (settings.stats, &mark);
 
-  if (handle)
-    rsvg_handle_render_cairo (handle, cr),
-    rsvg_handle_close (handle, NULL);
-  else if (parsed_data)
-    {
-      char* svg_data = co_svg_create (parsed_data, NULL, &settings);
+  cairo_translate (cr, padding, padding);
+  if (gui_playback_is_active ())
+    gui_playback_draw (cr, ratio);
+  else
+    gui_preview_draw (cr, ratio, settings.page.width * PT_TO_MM * 1.25,
+		      settings.page.height * PT_TO_MM * 1.25);
 
-      handle = rsvg_handle_new_from_data ((unsigned char*)svg_data, strlen (svg_data), NULL);
-      free (svg_data), svg_data = NULL;
-      rsvg_handle_render_cairo (handle, cr);
-      rsvg_handle_close (handle, NULL);
-    }
+  dt_stats_span_stop (settings.stats, "draw", &mark, 0, 0);
 
   return 0;
 }
@@ -882,7 +953,9 @@ gui_mainwindow_set_pressure_input (GtkWidget* widget)
 void
 gui_mainwindow_set_zoom_input ()
 {
-  gui_mainwindow_redisplay();
+  /* The zoom ratio doesn't change the document, so the preview only has to
+   * render tiles at the new ratio. */
+  gtk_widget_queue_draw (document_view);
 }
 
 /*----------------------------------------------------------------------------.
@@ -904,7 +977,7 @@ gui_mainwindow_set_zoom_toggle (GtkWidget* widget)
   else
     {
       gtk_widget_hide (zoom_input);
-      gui_mainwindow_redisplay();
+      gtk_widget_queue_draw (document_view);
     }
 }  
 
@@ -966,11 +1039,15 @@ gui_mainwindow_set_orientation_input ()
 void
 gui_mainwindow_set_clock_value (GtkWidget* widget)
 {
-  settings.process_until = (unsigned short)gtk_range_get_value (GTK_RANGE (widget));
-
-  if (handle != NULL)
-    g_object_unref (handle), handle = NULL;
+  /* When the user moves the clock during playback, continue from there. */
+  if (is_playing)
+    {
+      gui_playback_start (document_view, gtk_range_get_value (GTK_RANGE (widget)),
+			  gui_mainwindow_update_clock);
+      return;
+    }
 
+  settings.process_until = (unsigned short)gtk_range_get_value (GTK_RANGE (widget));
   gui_mainwindow_redisplay();  
 }
 
@@ -1001,6 +1078,55 @@ gui_mainwindow_toggle_timing (GtkWidget* widget, void* data)
 }
 
 
+/*----------------------------------------------------------------------------.
+ | GUI_MAINWINDOW_UPDATE_STATS                                                |
+ | This function shows the latest statistics, for as long as they're shown.  |
+ '----------------------------------------------------------------------------*/
+static gboolean
+gui_mainwindow_update_stats (gpointer data)
+{
+  (void)data;
+
+  if (!gtk_widget_get_visible (stats_box))
+    {
+      stats_timer = 0;
+      return FALSE;
+    }
+
+  char* text = dt_stats_to_string (settings.stats, DT_STATS_TEXT);
+  char* escaped = g_markup_escape_text (text, -1);
+  char* markup = g_strconcat ("<tt>", escaped, "</tt>", NULL);
+
+  gtk_label_set_markup (GTK_LABEL (stats_label), markup);
+
+  g_free (markup);
+  g_free (escaped);
+  g_free (text);
+
+  return TRUE;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_MAINWINDOW_TOGGLE_STATS                                                |
+ | This callback is for toggling the visibility of the statistics overlay.    |
+ '----------------------------------------------------------------------------*/
+void
+gui_mainwindow_toggle_stats (GtkWidget* widget)
+{
+  if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget)))
+    {
+      gtk_widget_show_all (stats_box);
+      gui_mainwindow_update_stats (NULL);
+
+      /* The preview keeps rendering after the window was drawn, so the
+       * overlay is updated every now and then. */
+      if (stats_timer == 0)
+	stats_timer = g_timeout_add (STATS_INTERVAL, gui_mainwindow_update_stats, NULL);
+    }
+  else
+    gtk_widget_hide (stats_box);
+}
+
 /*----------------------------------------------------------------------------.
  | GUI_MAINWINDOW_QUIT                                                        |
  | Clean up when quitting.                                                    |
@@ -1008,8 +1134,11 @@ gui_mainwindow_toggle_timing (GtkWidget* widget, void* data)
 void
 gui_mainwindow_quit ()
 {
-  if (handle != NULL)
-    g_object_unref (handle);
+  gui_playback_cleanup ();
+  gui_preview_cleanup ();
+
+  if (stats_timer != 0)
+    g_source_remove (stats_timer), stats_timer = 0;
 
   if (parsed_data != NULL)
     p_wpi_cleanup (parsed_data);
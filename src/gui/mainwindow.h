@@ -139,9 +139,16 @@ void gui_mainwindow_forward ();
 void gui_mainwindow_backward ();
 
 /**
- * This function applies the next step in time for the "play" feature.
+ * This function moves the clock along with the playback.
+ * @param clock    The clock value that the playback has reached.
+ * @param finished TRUE when the playback has reached the end.
  */
-gboolean gui_mainwindow_update_clock ();
+void gui_mainwindow_update_clock (double clock, gboolean finished);
+
+/**
+ * This function is the callback for changing the playback speed.
+ */
+void gui_mainwindow_set_speed_input (GtkWidget* widget);
 
 /**
  * This callback funciton handles showing or hiding the "Settings" pane.
@@ -153,6 +160,12 @@ void gui_mainwindow_toggle_settings (GtkWidget* widget, void* data);
  */
 void gui_mainwindow_toggle_timing (GtkWidget* widget, void* data);
 
+/**
+ * This callback function handles showing or hiding the statistics of the
+ * conversions on top of the document (see dt_stats).
+ */
+void gui_mainwindow_toggle_stats (GtkWidget* widget);
+
 /**
  * Clean up when quitting.
  */
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "playback.h"
+#include "../datatypes/configuration.h"
+#include "../datatypes/document.h"
+#include "../converters/render.h"
+
+#include <stdlib.h>
+
+#define MM_TO_PT 3.5433
+
+extern dt_configuration settings;
+
+static dt_document* document = NULL;
+static GtkWidget* view_widget = NULL;
+static guint tick_id = 0;
+static void (*step_callback) (double clock, gboolean finished) = NULL;
+
+/* The time that has been played back, in seconds, and the frame time at
+ * which it was reached, in microseconds. */
+static double play_time = 0;
+static gint64 last_frame_time = 0;
+static double speed = 1.0;
+
+/* The surface that the played back strokes are drawn on, and the point up
+ * to which they have been drawn. */
+static cairo_surface_t* surface = NULL;
+static double surface_ratio = 0;
+static unsigned int stroke_index = 0;
+static unsigned int point_index = 0;
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_CLEAR                                                         |
+ | This function throws away the surface, so the next frame starts over.     |
+ '----------------------------------------------------------------------------*/
+static void
+gui_playback_clear ()
+{
+  if (surface != NULL)
+    cairo_surface_destroy (surface), surface = NULL;
+
+  stroke_index = 0;
+  point_index = 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_ADVANCE                                                       |
+ | This function draws the points up to 'play_time' that haven't been drawn  |
+ | yet. It returns whether anything was drawn.                                |
+ '----------------------------------------------------------------------------*/
+static gboolean
+gui_playback_advance (double ratio)
+{
+  if (document == NULL) return FALSE;
+
+  if (surface != NULL && surface_ratio != ratio)
+    gui_playback_clear ();
+
+  if (surface == NULL)
+    {
+      surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+		  settings.page.width * MM_TO_PT * ratio + 0.5,
+		  settings.page.height * MM_TO_PT * ratio + 0.5);
+      surface_ratio = ratio;
+
+      cairo_t* cr = cairo_create (surface);
+      cairo_scale (cr, ratio, ratio);
+      co_render_background (cr, &settings);
+      cairo_destroy (cr);
+    }
+
+  gboolean drawn = FALSE;
+  cairo_t* cr = cairo_create (surface);
+  cairo_scale (cr, ratio, ratio);
+
+  while (stroke_index < document->num_strokes)
+    {
+      const dt_document_stroke* stroke = &document->strokes[stroke_index];
+
+      unsigned int last = point_index;
+      while (last < stroke->num_points && stroke->points[last].time <= play_time)
+	last++;
+
+      /* 'last' is one past the last point that is due. */
+      if (last > point_index)
+	{
+	  unsigned int first = (point_index > 0) ? point_index - 1 : 0;
+	  co_render_segments (cr, stroke, first, last - 1, &settings);
+	  point_index = last;
+	  drawn = TRUE;
+	}
+
+      if (point_index < stroke->num_points) break;
+
+      stroke_index++;
+      point_index = 0;
+    }
+
+  cairo_destroy (cr);
+  return drawn;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_TICK                                                          |
+ | This function is called by the frame clock before each frame.              |
+ '----------------------------------------------------------------------------*/
+static gboolean
+gui_playback_tick (GtkWidget* widget, GdkFrameClock* frame_clock, gpointer data)
+{
+  (void)data;
+
+  gint64 frame_time = gdk_frame_clock_get_frame_time (frame_clock);
+  if (last_frame_time != 0)
+    play_time += (frame_time - last_frame_time) / (double)G_USEC_PER_SEC * speed;
+  last_frame_time = frame_time;
+
+  gboolean finished = (document == NULL || play_time >= document->last_time);
+  if (finished && document != NULL)
+    play_time = document->last_time;
+
+  gtk_widget_queue_draw (widget);
+
+  /* The callback is removed by returning, so it must not be removed again
+   * when the step callback stops the playback. */
+  if (finished)
+    tick_id = 0;
+
+  if (step_callback != NULL)
+    step_callback (play_time, finished);
+
+  return (finished) ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_LOAD                                                          |
+ '----------------------------------------------------------------------------*/
+void
+gui_playback_load (GSList* data)
+{
+  gui_playback_stop ();
+  gui_playback_clear ();
+
+  dt_document_free (document);
+  document = dt_document_new (data);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_START                                                         |
+ '----------------------------------------------------------------------------*/
+void
+gui_playback_start (GtkWidget* widget, double from,
+		    void (*on_step) (double clock, gboolean finished))
+{
+  gui_playback_stop ();
+
+  /* Playing back from an earlier point in time means starting over. */
+  if (from < play_time || surface == NULL)
+    gui_playback_clear ();
+
+  view_widget = widget;
+  step_callback = on_step;
+  play_time = from;
+  last_frame_time = 0;
+  tick_id = gtk_widget_add_tick_callback (widget, gui_playback_tick, NULL, NULL);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_STOP                                                          |
+ '----------------------------------------------------------------------------*/
+void
+gui_playback_stop ()
+{
+  if (tick_id != 0)
+    gtk_widget_remove_tick_callback (view_widget, tick_id), tick_id = 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_IS_ACTIVE                                                     |
+ '----------------------------------------------------------------------------*/
+gboolean
+gui_playback_is_active ()
+{
+  return (tick_id != 0);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_SET_SPEED                                                     |
+ '----------------------------------------------------------------------------*/
+void
+gui_playback_set_speed (double new_speed)
+{
+  if (new_speed > 0)
+    speed = new_speed;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_INVALIDATE                                                    |
+ '----------------------------------------------------------------------------*/
+void
+gui_playback_invalidate ()
+{
+  gui_playback_clear ();
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_DRAW                                                          |
+ '----------------------------------------------------------------------------*/
+void
+gui_playback_draw (cairo_t* cr, double ratio)
+{
+  gui_playback_advance (ratio);
+  if (surface == NULL) return;
+
+  cairo_set_source_surface (cr, surface, 0, 0);
+  cairo_paint (cr);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PLAYBACK_CLEANUP                                                       |
+ '----------------------------------------------------------------------------*/
+void
+gui_playback_cleanup ()
+{
+  gui_playback_stop ();
+  gui_playback_clear ();
+  dt_document_free (document), document = NULL;
+}
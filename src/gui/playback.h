@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   gui/playback.h
+ * @brief  Plays back the drawing in real time, in sync with the screen.
+ * @author Roel Janssen
+ */
+
+/**
+ * @namespace gui::playback
+ * During playback, the drawing is built up on a surface that is kept
+ * between frames. On each frame of the widget's frame clock, only the
+ * points that were drawn since the previous frame are added to it. The
+ * time of each point follows from the clock in the WPI file and
+ * CLOCK_FREQUENCY, so a speed of 1 replays the drawing in real time.
+ *
+ * @note The prefix for this namespace is "gui_playback_".
+ */
+
+#ifndef GUI_PLAYBACK_H
+#define GUI_PLAYBACK_H
+
+#include <gtk/gtk.h>
+
+/**
+ * This function prepares the playback of new data.
+ * @param data  The parsed data (see p_wpi_parse()). Only used during the
+ *              call.
+ */
+void gui_playback_load (GSList* data);
+
+/**
+ * This function starts playing back.
+ * @param widget   The widget to draw on. Its frame clock drives the playback.
+ * @param from     The clock value to start at. Everything drawn before it is
+ *                 shown at once.
+ * @param on_step  Is called on every frame with the clock value that has
+ *                 been reached, and with TRUE as the last argument when the
+ *                 end has been reached. The playback stops by itself at the
+ *                 end.
+ */
+void gui_playback_start (GtkWidget* widget, double from,
+			 void (*on_step) (double clock, gboolean finished));
+
+/**
+ * This function stops playing back.
+ */
+void gui_playback_stop ();
+
+/**
+ * This function returns whether the playback is running.
+ */
+gboolean gui_playback_is_active ();
+
+/**
+ * This function sets how many times faster than real time to play back.
+ * @param speed The speed multiplier. 1 is real time.
+ */
+void gui_playback_set_speed (double speed);
+
+/**
+ * This function makes the next frame draw everything up to the current time
+ * again, for example after the settings have changed.
+ */
+void gui_playback_invalidate ();
+
+/**
+ * This function paints the part of the drawing that has been played back.
+ * @param cr     The cairo context, translated to the top-left of the page.
+ * @param ratio  The zoom ratio to draw at.
+ */
+void gui_playback_draw (cairo_t* cr, double ratio);
+
+/**
+ * This function stops the playback and frees its data.
+ */
+void gui_playback_cleanup ();
+
+#endif//GUI_PLAYBACK_H
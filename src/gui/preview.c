@@ -0,0 +1,717 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "preview.h"
+#include "../datatypes/configuration.h"
+#include "../datatypes/document.h"
+#include "../converters/render.h"
+#include "../optimizers/level-of-detail.h"
+#include "../parsers/wpi.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* The width and height of a tile in pixels. */
+#define TILE_SIZE 256
+
+/* The number of finished tiles to keep. 256 tiles take up 64 MiB. */
+#define MAX_TILES 256
+
+/* When all tiles of a zoom ratio are finished, they are combined into a
+ * single surface for the whole page. Only a few of these are kept, and only
+ * for ratios at which the page isn't too big. */
+#define MAX_LEVELS 3
+#define MAX_LEVEL_TILES (MAX_TILES / 2)
+
+extern dt_configuration settings;
+
+typedef enum
+{
+  TASK_LOAD,
+  TASK_SETTINGS,
+  TASK_TILE
+} gui_preview_task_type;
+
+/* A piece of work for the worker thread. */
+typedef struct
+{
+  gui_preview_task_type type;
+  int generation;
+  int view;
+  char* filename;
+  dt_configuration* settings;
+  double ratio;
+  int column;
+  int row;
+  cairo_surface_t* surface;
+} gui_preview_task;
+
+/* A tile of the document at a certain zoom ratio. While the tile is being
+ * rendered, 'surface' is NULL. */
+typedef struct
+{
+  int generation;
+  double ratio;
+  int column;
+  int row;
+  cairo_surface_t* surface;
+  guint64 last_used;
+} gui_preview_tile;
+
+/* The whole page at a certain zoom ratio. */
+typedef struct
+{
+  int generation;
+  double ratio;
+  cairo_surface_t* surface;
+  guint64 last_used;
+} gui_preview_level;
+
+/* These variables are only used by the main thread. */
+static GtkWidget* view_widget = NULL;
+static GThreadPool* pool = NULL;
+static GPtrArray* tiles = NULL;
+static GPtrArray* levels = NULL;
+static dt_configuration* last_settings = NULL;
+static double last_ratio = 0;
+static guint64 use_counter = 0;
+
+/* These variables are changed by the main thread, and read by the worker to
+ * skip work that has become useless. The generation changes with the
+ * settings, the view changes with the zoom ratio. */
+static volatile gint generation = 0;
+static volatile gint view = 0;
+static volatile gint stopping = 0;
+
+/* These variables are only used by the worker thread. */
+static dt_document* worker_document = NULL;
+static dt_configuration* worker_settings = NULL;
+static int worker_generation = -1;
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_FREE_TASK                                                      |
+ '----------------------------------------------------------------------------*/
+static void
+gui_preview_free_task (gui_preview_task* task)
+{
+  if (task->settings != NULL)
+    {
+      dt_configuration_cleanup (task->settings);
+      free (task->settings);
+    }
+
+  if (task->surface != NULL)
+    cairo_surface_destroy (task->surface);
+
+  free (task->filename);
+  free (task);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_FREE_TILE                                                      |
+ '----------------------------------------------------------------------------*/
+static void
+gui_preview_free_tile (gpointer data)
+{
+  gui_preview_tile* tile = (gui_preview_tile*)data;
+  if (tile->surface != NULL)
+    cairo_surface_destroy (tile->surface);
+
+  free (tile);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_FREE_LEVEL                                                     |
+ '----------------------------------------------------------------------------*/
+static void
+gui_preview_free_level (gpointer data)
+{
+  gui_preview_level* level = (gui_preview_level*)data;
+  cairo_surface_destroy (level->surface);
+  free (level);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_FIND_LEVEL                                                     |
+ '----------------------------------------------------------------------------*/
+static gui_preview_level*
+gui_preview_find_level (int level_generation, double ratio)
+{
+  unsigned int index = 0;
+  for (; index < levels->len; index++)
+    {
+      gui_preview_level* level = g_ptr_array_index (levels, index);
+      if (level->generation == level_generation && level->ratio == ratio)
+	return level;
+    }
+
+  return NULL;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_FIND_TILE                                                      |
+ '----------------------------------------------------------------------------*/
+static gui_preview_tile*
+gui_preview_find_tile (int tile_generation, double ratio, int column, int row)
+{
+  unsigned int index = 0;
+  for (; index < tiles->len; index++)
+    {
+      gui_preview_tile* tile = g_ptr_array_index (tiles, index);
+      if (tile->generation == tile_generation && tile->ratio == ratio
+	  && tile->column == column && tile->row == row)
+	return tile;
+    }
+
+  return NULL;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_DELIVER                                                        |
+ | This function runs on the main thread and stores a rendered tile.          |
+ '----------------------------------------------------------------------------*/
+static gboolean
+gui_preview_deliver (gpointer data)
+{
+  gui_preview_task* task = (gui_preview_task*)data;
+
+  if (tiles != NULL)
+    {
+      gui_preview_tile* tile = gui_preview_find_tile (task->generation, task->ratio,
+						      task->column, task->row);
+
+      if (tile != NULL && tile->surface == NULL)
+	{
+	  if (task->surface != NULL)
+	    {
+	      tile->surface = task->surface, task->surface = NULL;
+	      tile->last_used = ++use_counter;
+	      gtk_widget_queue_draw (view_widget);
+	    }
+	  else
+	    {
+	      /* The tile was skipped, so it can be requested again. When the
+	       * view went back to this ratio in the meantime, it's still on
+	       * screen and has to be requested by drawing once more. */
+	      g_ptr_array_remove_fast (tiles, tile);
+	      gtk_widget_queue_draw (view_widget);
+	    }
+	}
+    }
+
+  gui_preview_free_task (task);
+  return FALSE;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_WORK                                                           |
+ | This function runs in the worker thread and handles a single task.         |
+ '----------------------------------------------------------------------------*/
+static void
+gui_preview_work (gpointer data, gpointer user_data)
+{
+  gui_preview_task* task = (gui_preview_task*)data;
+  (void)user_data;
+
+  dt_stats_name_thread (settings.stats, "preview");
+
+  if (g_atomic_int_get (&stopping))
+    {
+      gui_preview_free_task (task);
+      return;
+    }
+
+  switch (task->type)
+    {
+    case TASK_LOAD:
+      {
+	unsigned short seconds = 0;
+	dt_stats_mark mark;
+	dt_stats_start (settings.stats, &mark);
+	GSList* data = p_wpi_parse (task->filename, &seconds);
+	dt_stats_stop_data (settings.stats, "parse", &mark, data);
+
+	/* The strokes and their levels of detail are made once, so that
+	 * drawing the page when zoomed out only has to go through a fraction
+	 * of the points. */
+	dt_document_free (worker_document);
+	dt_stats_start (settings.stats, &mark);
+	worker_document = dt_document_new (data);
+	dt_stats_stop_data (settings.stats, "document", &mark, data);
+
+	if (worker_document != NULL)
+	  {
+	    dt_stats_start (settings.stats, &mark);
+	    opt_level_of_detail_build (worker_document);
+	    dt_stats_stop (settings.stats, "level-of-detail", &mark,
+			   worker_document->num_strokes, worker_document->num_points);
+	  }
+
+	p_wpi_cleanup (data);
+	gui_preview_free_task (task);
+      }
+      break;
+
+    case TASK_SETTINGS:
+      {
+	/* Settings that have already been replaced are never drawn. */
+	if (task->generation == g_atomic_int_get (&generation))
+	  {
+	    if (worker_settings != NULL)
+	      {
+		dt_configuration_cleanup (worker_settings);
+		free (worker_settings);
+	      }
+
+	    worker_settings = task->settings, task->settings = NULL;
+	    worker_generation = task->generation;
+	  }
+
+	gui_preview_free_task (task);
+      }
+      break;
+
+    case TASK_TILE:
+      {
+	if (task->view == g_atomic_int_get (&view)
+	    && task->generation == worker_generation
+	    && worker_settings != NULL)
+	  {
+	    dt_stats_mark mark;
+	    dt_stats_start (worker_settings->stats, &mark);
+
+	    task->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+							TILE_SIZE, TILE_SIZE);
+
+	    cairo_t* cr = cairo_create (task->surface);
+	    cairo_translate (cr, -task->column * TILE_SIZE, -task->row * TILE_SIZE);
+	    cairo_scale (cr, task->ratio, task->ratio);
+	    co_render_document (cr, worker_document, worker_settings, task->ratio);
+	    cairo_destroy (cr);
+
+	    dt_stats_stop (worker_settings->stats, "render-tile", &mark, 0, 0);
+	  }
+
+	/* Skipped tiles are delivered without a surface. */
+	g_idle_add (gui_preview_deliver, task);
+      }
+      break;
+    }
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_REQUEST_TILE                                                   |
+ | This function adds a placeholder for a tile and asks the worker for it.    |
+ '----------------------------------------------------------------------------*/
+static void
+gui_preview_request_tile (double ratio, int column, int row)
+{
+  /* Make room by removing the finished tile that was used least recently. */
+  if (tiles->len >= MAX_TILES)
+    {
+      gui_preview_tile* oldest = NULL;
+      unsigned int index = 0;
+      for (; index < tiles->len; index++)
+	{
+	  gui_preview_tile* tile = g_ptr_array_index (tiles, index);
+	  if (tile->surface != NULL
+	      && (oldest == NULL || tile->last_used < oldest->last_used))
+	    oldest = tile;
+	}
+
+      if (oldest != NULL)
+	g_ptr_array_remove_fast (tiles, oldest);
+    }
+
+  gui_preview_tile* tile = calloc (1, sizeof (gui_preview_tile));
+  gui_preview_task* task = calloc (1, sizeof (gui_preview_task));
+  if (tile == NULL || task == NULL)
+    {
+      free (tile);
+      free (task);
+      return;
+    }
+
+  tile->generation = task->generation = g_atomic_int_get (&generation);
+  tile->ratio = task->ratio = ratio;
+  tile->column = task->column = column;
+  tile->row = task->row = row;
+  g_ptr_array_add (tiles, tile);
+
+  task->type = TASK_TILE;
+  task->view = g_atomic_int_get (&view);
+  g_thread_pool_push (pool, task, NULL);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_PAINT_SCALED                                                   |
+ | This function paints a surface that was rendered at 'from_ratio' at        |
+ | 'to_ratio', when it overlaps the area that is being filled.                |
+ '----------------------------------------------------------------------------*/
+static void
+gui_preview_paint_scaled (cairo_t* cr, cairo_surface_t* surface, double from_ratio,
+			  double to_ratio, double x, double y, double area_x,
+			  double area_y)
+{
+  double scale = to_ratio / from_ratio;
+  double left = x * scale;
+  double top = y * scale;
+  double right = left + cairo_image_surface_get_width (surface) * scale;
+  double bottom = top + cairo_image_surface_get_height (surface) * scale;
+
+  if (left >= area_x + TILE_SIZE || right <= area_x
+      || top >= area_y + TILE_SIZE || bottom <= area_y)
+    return;
+
+  cairo_save (cr);
+  cairo_translate (cr, left, top);
+  cairo_scale (cr, scale, scale);
+  cairo_set_source_surface (cr, surface, 0, 0);
+  cairo_paint (cr);
+  cairo_restore (cr);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_DRAW_REPLACEMENT                                               |
+ | This function fills a missing tile with (scaled) pages and tiles of other  |
+ | zoom ratios or older settings. The current settings are painted last.      |
+ '----------------------------------------------------------------------------*/
+static void
+gui_preview_draw_replacement (cairo_t* cr, double ratio, int column, int row)
+{
+  int current = g_atomic_int_get (&generation);
+  double x = column * TILE_SIZE;
+  double y = row * TILE_SIZE;
+
+  cairo_save (cr);
+  cairo_rectangle (cr, x, y, TILE_SIZE, TILE_SIZE);
+  cairo_clip (cr);
+
+  int pass = 0;
+  for (; pass < 2; pass++)
+    {
+      unsigned int index = 0;
+      for (; index < levels->len; index++)
+	{
+	  gui_preview_level* level = g_ptr_array_index (levels, index);
+	  if ((level->generation == current) != (pass == 1)) continue;
+
+	  gui_preview_paint_scaled (cr, level->surface, level->ratio, ratio,
+				    0, 0, x, y);
+	}
+
+      for (index = 0; index < tiles->len; index++)
+	{
+	  gui_preview_tile* tile = g_ptr_array_index (tiles, index);
+	  if (tile->surface == NULL) continue;
+	  if ((tile->generation == current) != (pass == 1)) continue;
+	  if (tile->generation == current && tile->ratio == ratio) continue;
+
+	  gui_preview_paint_scaled (cr, tile->surface, tile->ratio, ratio,
+				    tile->column * TILE_SIZE, tile->row * TILE_SIZE,
+				    x, y);
+	}
+    }
+
+  cairo_restore (cr);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_COMPOSE_LEVEL                                                  |
+ | This function combines the tiles of a zoom ratio into a single surface,    |
+ | so that the page can be painted at once. Returns NULL when a tile is       |
+ | still missing.                                                             |
+ '----------------------------------------------------------------------------*/
+static gui_preview_level*
+gui_preview_compose_level (double ratio, int columns, int rows, int width, int height)
+{
+  int current = g_atomic_int_get (&generation);
+  int row, column;
+
+  for (row = 0; row < rows; row++)
+    for (column = 0; column < columns; column++)
+      {
+	gui_preview_tile* tile = gui_preview_find_tile (current, ratio, column, row);
+	if (tile == NULL || tile->surface == NULL) return NULL;
+      }
+
+  gui_preview_level* level = calloc (1, sizeof (gui_preview_level));
+  if (level == NULL) return NULL;
+
+  level->generation = current;
+  level->ratio = ratio;
+  level->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  level->last_used = ++use_counter;
+
+  cairo_t* cr = cairo_create (level->surface);
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  for (row = 0; row < rows; row++)
+    for (column = 0; column < columns; column++)
+      {
+	gui_preview_tile* tile = gui_preview_find_tile (current, ratio, column, row);
+	cairo_set_source_surface (cr, tile->surface, column * TILE_SIZE, row * TILE_SIZE);
+	cairo_paint (cr);
+	g_ptr_array_remove_fast (tiles, tile);
+      }
+
+  cairo_destroy (cr);
+
+  /* Keep the pages that were used most recently. */
+  if (levels->len >= MAX_LEVELS)
+    {
+      gui_preview_level* oldest = NULL;
+      unsigned int index = 0;
+      for (; index < levels->len; index++)
+	{
+	  gui_preview_level* other = g_ptr_array_index (levels, index);
+	  if (oldest == NULL || other->last_used < oldest->last_used)
+	    oldest = other;
+	}
+
+      g_ptr_array_remove_fast (levels, oldest);
+    }
+
+  g_ptr_array_add (levels, level);
+  return level;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_SETTINGS_CHANGED                                               |
+ | This function checks whether a change in settings changes the document.   |
+ '----------------------------------------------------------------------------*/
+static int
+gui_preview_settings_changed (dt_configuration* old, dt_configuration* current)
+{
+  if (old == NULL
+      || old->pressure_factor != current->pressure_factor
+      || old->page.width != current->page.width
+      || old->page.height != current->page.height
+      || old->process_until != current->process_until
+      || old->num_colors != current->num_colors
+      || g_strcmp0 (old->background, current->background)
+      || g_strcmp0 (old->page.measurement, current->page.measurement))
+    return 1;
+
+  unsigned int index = 0;
+  for (; index < current->num_colors; index++)
+    if (g_strcmp0 (old->colors[index], current->colors[index]))
+      return 1;
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_INIT                                                           |
+ '----------------------------------------------------------------------------*/
+void
+gui_preview_init (GtkWidget* widget)
+{
+  view_widget = widget;
+  tiles = g_ptr_array_new_with_free_func (gui_preview_free_tile);
+  levels = g_ptr_array_new_with_free_func (gui_preview_free_level);
+
+  /* A single worker renders all tiles, so the document and the settings it
+   * is drawn with don't need a lock. */
+  pool = g_thread_pool_new (gui_preview_work, NULL, 1, FALSE, NULL);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_LOAD                                                           |
+ '----------------------------------------------------------------------------*/
+void
+gui_preview_load (const char* filename)
+{
+  gui_preview_task* task = calloc (1, sizeof (gui_preview_task));
+  if (task == NULL) return;
+
+  task->type = TASK_LOAD;
+  task->filename = strdup (filename);
+  g_thread_pool_push (pool, task, NULL);
+
+  /* Make sure the next call to gui_preview_invalidate() renders the new
+   * document, even when the settings are the same. */
+  if (last_settings != NULL)
+    {
+      dt_configuration_cleanup (last_settings);
+      free (last_settings), last_settings = NULL;
+    }
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_INVALIDATE                                                     |
+ '----------------------------------------------------------------------------*/
+void
+gui_preview_invalidate ()
+{
+  gui_preview_task* task = calloc (1, sizeof (gui_preview_task));
+  if (task == NULL) return;
+
+  task->settings = calloc (1, sizeof (dt_configuration));
+  if (task->settings == NULL)
+    {
+      free (task);
+      return;
+    }
+
+  dt_configuration_copy (&settings, task->settings);
+
+  /* Many widgets report a change when nothing changed for the document
+   * (for example, when the same color is chosen again). The rendered
+   * pages and tiles can be kept in that case. */
+  if (!gui_preview_settings_changed (last_settings, task->settings))
+    {
+      gui_preview_free_task (task);
+      return;
+    }
+
+  if (last_settings == NULL)
+    last_settings = calloc (1, sizeof (dt_configuration));
+  else
+    dt_configuration_cleanup (last_settings);
+
+  if (last_settings != NULL)
+    dt_configuration_copy (task->settings, last_settings);
+
+  g_atomic_int_inc (&generation);
+  task->type = TASK_SETTINGS;
+  task->generation = g_atomic_int_get (&generation);
+  g_thread_pool_push (pool, task, NULL);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_DRAW                                                           |
+ '----------------------------------------------------------------------------*/
+void
+gui_preview_draw (cairo_t* cr, double ratio, double width, double height)
+{
+  if (tiles == NULL) return;
+
+  /* Tiles that are queued for another zoom ratio will be skipped. */
+  if (ratio != last_ratio)
+    {
+      last_ratio = ratio;
+      g_atomic_int_inc (&view);
+    }
+
+  int current = g_atomic_int_get (&generation);
+
+  /* When the whole page has been rendered at this ratio, it only needs to
+   * be copied. This is the case for most redraws, like when scrolling. */
+  gui_preview_level* level = gui_preview_find_level (current, ratio);
+  if (level != NULL)
+    {
+      cairo_set_source_surface (cr, level->surface, 0, 0);
+      cairo_paint (cr);
+      level->last_used = ++use_counter;
+      return;
+    }
+
+  double x1, y1, x2, y2;
+  cairo_clip_extents (cr, &x1, &y1, &x2, &y2);
+
+  if (x1 < 0) x1 = 0;
+  if (y1 < 0) y1 = 0;
+  if (x2 > width * ratio) x2 = width * ratio;
+  if (y2 > height * ratio) y2 = height * ratio;
+  if (x2 <= x1 || y2 <= y1) return;
+  /* The coordinates are positive, so the casts round down. A tile that
+   * starts exactly at the right or bottom edge isn't visible. */
+  int first_column = (int)(x1 / TILE_SIZE);
+  int last_column = (int)(x2 / TILE_SIZE);
+  int first_row = (int)(y1 / TILE_SIZE);
+  int last_row = (int)(y2 / TILE_SIZE);
+  if (last_column * TILE_SIZE >= x2) last_column--;
+  if (last_row * TILE_SIZE >= y2) last_row--;
+
+  int row = first_row;
+  for (; row <= last_row; row++)
+    {
+      int column = first_column;
+      for (; column <= last_column; column++)
+	{
+	  gui_preview_tile* tile = gui_preview_find_tile (current, ratio, column, row);
+
+	  if (tile != NULL && tile->surface != NULL)
+	    {
+	      cairo_set_source_surface (cr, tile->surface,
+					column * TILE_SIZE, row * TILE_SIZE);
+	      cairo_rectangle (cr, column * TILE_SIZE, row * TILE_SIZE,
+			       TILE_SIZE, TILE_SIZE);
+	      cairo_fill (cr);
+	      tile->last_used = ++use_counter;
+	      continue;
+	    }
+
+	  gui_preview_draw_replacement (cr, ratio, column, row);
+
+	  if (tile == NULL)
+	    gui_preview_request_tile (ratio, column, row);
+	}
+    }
+
+  /* Render the rest of the page in the background as well when it's small
+   * enough to be kept as a whole. Once all tiles are there, they are
+   * combined. */
+  int page_width = (int)(width * ratio + 0.5);
+  int page_height = (int)(height * ratio + 0.5);
+  int columns = (page_width + TILE_SIZE - 1) / TILE_SIZE;
+  int rows = (page_height + TILE_SIZE - 1) / TILE_SIZE;
+
+  if (columns * rows > MAX_LEVEL_TILES || page_width <= 0 || page_height <= 0)
+    return;
+
+  for (row = 0; row < rows; row++)
+    {
+      int column = 0;
+      for (; column < columns; column++)
+	if (gui_preview_find_tile (current, ratio, column, row) == NULL)
+	  gui_preview_request_tile (ratio, column, row);
+    }
+
+  gui_preview_compose_level (ratio, columns, rows, page_width, page_height);
+}
+
+/*----------------------------------------------------------------------------.
+ | GUI_PREVIEW_CLEANUP                                                        |
+ '----------------------------------------------------------------------------*/
+void
+gui_preview_cleanup ()
+{
+  if (pool == NULL) return;
+
+  /* Let the worker skip the remaining tasks, and wait for it. */
+  g_atomic_int_set (&stopping, 1);
+  g_thread_pool_free (pool, FALSE, TRUE), pool = NULL;
+
+  if (worker_settings != NULL)
+    {
+      dt_configuration_cleanup (worker_settings);
+      free (worker_settings), worker_settings = NULL;
+    }
+
+  dt_document_free (worker_document), worker_document = NULL;
+  g_ptr_array_free (tiles, TRUE), tiles = NULL;
+  g_ptr_array_free (levels, TRUE), levels = NULL;
+
+  if (last_settings != NULL)
+    {
+      dt_configuration_cleanup (last_settings);
+      free (last_settings), last_settings = NULL;
+    }
+}
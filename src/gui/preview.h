@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   gui/preview.h
+ * @brief  Renders the document view in the background, in tiles.
+ * @author Roel Janssen
+ */
+
+/**
+ * @namespace gui::preview
+ * Rendering a large document can take seconds. To keep the window
+ * responsive, the document is rendered by a worker thread in tiles. The
+ * tiles are cached, so drawing the document view only has to paint the
+ * tiles that are finished. While tiles are being rendered, the tiles of a
+ * previous zoom level or of previous settings are shown in their place.
+ * Once all tiles of a zoom level are finished, they are combined into one
+ * surface, so that scrolling and other redraws only need a single copy.
+ *
+ * @note The prefix for this namespace is "gui_preview_".
+ */
+
+#ifndef GUI_PREVIEW_H
+#define GUI_PREVIEW_H
+
+#include <gtk/gtk.h>
+
+/**
+ * This function starts the worker thread.
+ * @param widget The widget to redraw when tiles are finished.
+ */
+void gui_preview_init (GtkWidget* widget);
+
+/**
+ * This function makes the worker read a WPI file. The preview keeps its own
+ * parsed data, so that it can't interfere with the rest of the program.
+ * Call gui_preview_invalidate() afterwards to render it.
+ * @param filename The WPI file to show.
+ */
+void gui_preview_load (const char* filename);
+
+/**
+ * This function throws away the rendered tiles after the settings have
+ * changed. The current settings are copied, so the worker doesn't see later
+ * changes. The old tiles are shown until they have been replaced. Nothing
+ * happens when the settings that affect the document are the same as the
+ * last time.
+ */
+void gui_preview_invalidate ();
+
+/**
+ * This function paints the tiles that are visible in 'cr' and requests the
+ * ones that are missing.
+ * @param cr     The cairo context, translated to the top-left of the page.
+ * @param ratio  The zoom ratio to render at.
+ * @param width  The width of the page in pixels, at a ratio of 1.
+ * @param height The height of the page in pixels, at a ratio of 1.
+ */
+void gui_preview_draw (cairo_t* cr, double ratio, double width, double height);
+
+/**
+ * This function stops the worker thread and frees the tiles.
+ */
+void gui_preview_cleanup ();
+
+#endif//GUI_PREVIEW_H
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "batch.h"
+#include "conversion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "../parsers/wpi.h"
+
+/* Rendering is CPU-bound, so more workers than processors doesn't help. */
+#define MAX_WORKERS 8
+
+#define LINE_LENGTH 4096
+
+/* A single output that is made from an input. */
+typedef struct
+{
+  char* output;
+  unsigned int format;
+  char** options;
+} batch_job;
+
+/* All outputs that are made from the same input. */
+typedef struct
+{
+  char* input;
+  GSList* jobs;
+} batch_group;
+
+static dt_configuration* batch_settings = NULL;
+static int batch_failures = 0;
+
+/*----------------------------------------------------------------------------.
+ | BATCH_APPLY_OPTIONS                                                        |
+ | This function applies the "key=value" options of a job to 'config'.        |
+ | Returns 0 on success, 1 when an option is unknown or invalid.              |
+ '----------------------------------------------------------------------------*/
+static int
+batch_apply_options (batch_job* job, dt_configuration* config, int line_number)
+{
+  int status = 0;
+  char** option = job->options;
+
+  for (; option != NULL && *option != NULL; option++)
+    {
+      char* value = strchr (*option, '=');
+      int is_valid = (value != NULL);
+
+      if (is_valid)
+	{
+	  char* key = g_strndup (*option, value - *option);
+	  if (!strcmp (key, "format"))
+	    {
+	      job->format = high_format_from_name (value + 1);
+	      is_valid = (job->format != 0);
+	    }
+	  else
+	    is_valid = !dt_configuration_set_option (key, value + 1, config);
+
+	  g_free (key);
+	}
+
+      if (!is_valid)
+	{
+	  if (line_number > 0)
+	    printf ("Line %d: Unknown or invalid option '%s'.\n", line_number, *option);
+	  status = 1;
+	}
+    }
+
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | BATCH_FREE_JOB                                                             |
+ | This function frees a batch_job.                                           |
+ '----------------------------------------------------------------------------*/
+static void
+batch_free_job (gpointer data)
+{
+  batch_job* job = (batch_job*)data;
+  g_free (job->output);
+  g_strfreev (job->options);
+  free (job);
+}
+
+/*----------------------------------------------------------------------------.
+ | BATCH_CONVERT_GROUP                                                        |
+ | This function runs in a worker thread. It parses an input once and makes   |
+ | each of its outputs in turn. The outputs can't be made in parallel,        |
+ | because the converters modify the parsed data.                             |
+ '----------------------------------------------------------------------------*/
+static void
+batch_convert_group (gpointer data, gpointer user_data)
+{
+  batch_group* group = (batch_group*)data;
+  (void)user_data;
+
+  dt_stats_name_thread (batch_settings->stats, "batch");
+
+  dt_stats_mark mark;
+  dt_stats_start (batch_settings->stats, &mark);
+  unsigned short process_until = 0;
+  GSList* elements = p_wpi_parse (group->input, &process_until);
+  dt_stats_stop_data (batch_settings->stats, "parse", &mark, elements);
+
+  GSList* iterator;
+  for (iterator = group->jobs; iterator != NULL; iterator = iterator->next)
+    {
+      batch_job* job = (batch_job*)iterator->data;
+      int status = 1;
+
+      if (elements != NULL)
+	{
+	  dt_configuration settings;
+	  dt_configuration_copy (batch_settings, &settings);
+	  settings.process_until = process_until;
+
+	  batch_apply_options (job, &settings, 0);
+	  status = high_export_format_to_file (elements, job->format, job->output,
+					       &settings);
+	  dt_configuration_cleanup (&settings);
+	}
+
+      if (status != 0)
+	{
+	  printf ("Couldn't convert '%s' to '%s'.\n", group->input, job->output);
+	  g_atomic_int_inc (&batch_failures);
+	}
+    }
+
+  p_wpi_cleanup (elements);
+}
+
+/*----------------------------------------------------------------------------.
+ | BATCH_READ_MANIFEST                                                        |
+ | This function reads the jobs of a manifest and groups them by input.       |
+ | Returns the groups in the order in which their inputs first appear.        |
+ '----------------------------------------------------------------------------*/
+static GSList*
+batch_read_manifest (FILE* file, dt_configuration* settings)
+{
+  GSList* groups = NULL;
+  GHashTable* inputs = g_hash_table_new (g_str_hash, g_str_equal);
+
+  char line[LINE_LENGTH];
+  int line_number = 0;
+
+  while (fgets (line, LINE_LENGTH, file) != NULL)
+    {
+      line_number++;
+
+      size_t length = strlen (line);
+      if (length == LINE_LENGTH - 1 && line[length - 1] != '\n' && !feof (file))
+	{
+	  printf ("Line %d: The line is too long.\n", line_number);
+	  batch_failures++;
+
+	  /* Skip the rest of the line. */
+	  while (fgets (line, LINE_LENGTH, file) != NULL
+		 && line[strlen (line) - 1] != '\n')
+	    ;
+	  continue;
+	}
+
+      g_strstrip (line);
+      if (line[0] == '\0' || line[0] == '#') continue;
+
+      int argc = 0;
+      char** argv = NULL;
+      if (!g_shell_parse_argv (line, &argc, &argv, NULL) || argc < 2)
+	{
+	  printf ("Line %d: Expected an input and an output file.\n", line_number);
+	  batch_failures++;
+	  g_strfreev (argv);
+	  continue;
+	}
+
+      batch_job* job = calloc (1, sizeof (batch_job));
+      if (job == NULL)
+	{
+	  g_strfreev (argv);
+	  break;
+	}
+
+      job->output = g_strdup (argv[1]);
+      job->options = g_strdupv (argv + 2);
+
+      /* Check the options up front, so that mistakes are reported with their
+       * line number and before anything is converted. */
+      dt_configuration scratch;
+      dt_configuration_copy (settings, &scratch);
+      int status = batch_apply_options (job, &scratch, line_number);
+      dt_configuration_cleanup (&scratch);
+
+      if (status == 0 && job->format == 0)
+	{
+	  job->format = high_format_from_name (job->output);
+	  if (job->format == 0)
+	    {
+	      printf ("Line %d: Unknown format for '%s'.\n", line_number, job->output);
+	      status = 1;
+	    }
+	}
+
+      if (status != 0)
+	{
+	  batch_failures++;
+	  batch_free_job (job);
+	  g_strfreev (argv);
+	  continue;
+	}
+
+      batch_group* group = g_hash_table_lookup (inputs, argv[0]);
+      if (group == NULL)
+	{
+	  group = calloc (1, sizeof (batch_group));
+	  if (group == NULL)
+	    {
+	      batch_free_job (job);
+	      g_strfreev (argv);
+	      break;
+	    }
+
+	  group->input = g_strdup (argv[0]);
+	  g_hash_table_insert (inputs, group->input, group);
+	  groups = g_slist_prepend (groups, group);
+	}
+
+      group->jobs = g_slist_prepend (group->jobs, job);
+      g_strfreev (argv);
+    }
+
+  g_hash_table_destroy (inputs);
+
+  GSList* iterator;
+  for (iterator = groups; iterator != NULL; iterator = iterator->next)
+    {
+      batch_group* group = (batch_group*)iterator->data;
+      group->jobs = g_slist_reverse (group->jobs);
+    }
+
+  return g_slist_reverse (groups);
+}
+
+/*----------------------------------------------------------------------------.
+ | HIGH_RUN_BATCH                                                             |
+ | This function reads a manifest and runs its conversions in parallel.       |
+ '----------------------------------------------------------------------------*/
+int
+high_run_batch (const char* manifest, dt_configuration* settings)
+{
+  FILE* file = stdin;
+  if (strcmp (manifest, "-"))
+    file = fopen (manifest, "r");
+
+  if (file == NULL)
+    {
+      printf ("Couldn't read '%s'.\n", manifest);
+      return 1;
+    }
+
+  /* Set the defaults that the converters rely on once, so that each job
+   * doesn't have to. */
+  if (settings->page.measurement == NULL)
+    dt_configuration_parse_dimensions (NULL, settings);
+
+  batch_settings = settings;
+  batch_failures = 0;
+
+  GSList* groups = batch_read_manifest (file, settings);
+  if (file != stdin)
+    fclose (file);
+
+  long workers = 1;
+  #ifdef _SC_NPROCESSORS_ONLN
+  workers = sysconf (_SC_NPROCESSORS_ONLN);
+  #endif
+  if (workers < 1) workers = 1;
+  if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+
+  GThreadPool* pool;
+  pool = g_thread_pool_new (batch_convert_group, NULL, workers, TRUE, NULL);
+
+  GSList* iterator;
+  for (iterator = groups; iterator != NULL; iterator = iterator->next)
+    g_thread_pool_push (pool, iterator->data, NULL);
+
+  /* Wait until all conversions are done. */
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  for (iterator = groups; iterator != NULL; iterator = iterator->next)
+    {
+      batch_group* group = (batch_group*)iterator->data;
+      g_slist_free_full (group->jobs, batch_free_job);
+      g_free (group->input);
+      free (group);
+    }
+
+  g_slist_free (groups);
+
+  return (batch_failures > 0);
+}
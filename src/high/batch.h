@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   high/batch.h
+ * @brief  Run many conversions from a manifest in a single process.
+ * @author Roel Janssen
+ */
+
+#ifndef HIGH_BATCH_H
+#define HIGH_BATCH_H
+
+#include "../datatypes/configuration.h"
+
+/**
+ * This function runs the conversions that are listed in a manifest. Each
+ * line of the manifest names an input file and an output file, optionally
+ * followed by "key=value" settings for that output only:
+ *
+ *   SKETCH.WPI sketch.pdf dimensions=A5 orientation=Landscape
+ *   SKETCH.WPI sketch.png background=none
+ *
+ * Names containing spaces can be quoted like in a shell. Empty lines and
+ * lines starting with '#' are ignored. The format of an output is taken
+ * from its extension, unless "format=FORMAT" is given.
+ *
+ * Every input is parsed only once, no matter how many outputs are made from
+ * it. Different inputs are converted in parallel.
+ *
+ * @param manifest  The manifest to read, or "-" to read it from stdin.
+ * @param settings  The default settings for every conversion.
+ * @return 0 when all conversions succeeded, 1 otherwise.
+ */
+int high_run_batch (const char* manifest, dt_configuration* settings);
+
+#endif//HIGH_BATCH_H
@@ -17,13 +17,26 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* copy_file_range() is a GNU extension. */
+#ifdef HAVE_COPY_FILE_RANGE
+#define _GNU_SOURCE
+#endif
+
 #include "conversion.h"
 
 #include <stdlib.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 #include "../datatypes/element.h"
 #include "../parsers/wpi.h"
@@ -32,8 +45,20 @@
 #include "../converters/svg.h"
 #include "../converters/json.h"
 #include "../converters/csv.h"
+#include "../converters/wpi.h"
 #include "../datatypes/configuration.h"
 
+/* O_BINARY only exists (and matters) on Windows. */
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* Windows has no symbolic links in the POSIX sense. */
+#ifdef _WIN32
+#define lstat stat
+#define S_ISLNK(mode) 0
+#endif
+
 /* nested inline function turned into global static inline function for clang
  * see also: <https://wiki.freebsd.org/PortsAndClang#Build_failures_with_fixes> */
 static inline void unsupported ()
@@ -42,49 +67,251 @@ static inline void unsupported ()
 	"are supported.");
 }
 
+/*----------------------------------------------------------------------------.
+ | WRITE_SVG_FILE                                                             |
+ | This function writes an SVG string to a file. Returns 0 on success.        |
+ '----------------------------------------------------------------------------*/
+static int
+write_svg_file (const char* filename, const char* svg, dt_stats* stats)
+{
+  dt_stats_mark mark;
+  dt_stats_span_start (stats, &mark);
+
+  int status = 1;
+  FILE* file = fopen (filename, "w");
+  if (file != NULL)
+    {
+      size_t length = strlen (svg);
+      status = (fwrite (svg, 1, length, file) != length);
+      if (fclose (file) != 0)
+	status = 1;
+    }
+
+  if (status != 0)
+    printf ("Couldn't write to '%s'.\n", filename);
+
+  dt_stats_span_stop (stats, "write", &mark, 0, 0);
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | HAS_WPI_EXTENSION                                                          |
+ | This function returns 1 when 'name' ends with ".wpi" in any case.          |
+ '----------------------------------------------------------------------------*/
+int
+high_has_wpi_extension (const char* name)
+{
+  size_t length = strlen (name);
+  return (length > 4 && !g_ascii_strcasecmp (name + length - 4, ".wpi"));
+}
+
+/*----------------------------------------------------------------------------.
+ | DRAWS_PNG_DIRECTLY                                                         |
+ | When a resolution has been set, PNG images are drawn directly in bands     |
+ | (see co_png_export_document_to_stream()) instead of from the SVG data.     |
+ '----------------------------------------------------------------------------*/
+static int
+draws_png_directly (const dt_configuration* settings)
+{
+  return (settings->dpi > 0);
+}
+
+/*----------------------------------------------------------------------------.
+ | NEW_DOCUMENT                                                               |
+ | This function turns parsed data into a document and measures it.           |
+ '----------------------------------------------------------------------------*/
+static dt_document*
+new_document (GSList* data, dt_configuration* settings)
+{
+  dt_stats_mark mark;
+  dt_stats_start (settings->stats, &mark);
+  dt_document* document = dt_document_new (data);
+  dt_stats_stop_data (settings->stats, "document", &mark, data);
+
+  return document;
+}
+
+/*----------------------------------------------------------------------------.
+ | CONVERT_FILE                                                               |
+ | This function parses a WPI file once and writes every requested format     |
+ | next to it. The SVG data and the RsvgHandle are shared between outputs.    |
+ | When one output fails, the others are still written. Returns 0 when all    |
+ | of them succeeded.                                                         |
+ '----------------------------------------------------------------------------*/
+int
+high_convert_file (const char* filename, dt_configuration* settings)
+{
+  unsigned int formats = settings->export_formats;
+  if (formats == 0) formats = FORMAT_SVG;
+
+  dt_stats_mark mark;
+  dt_stats_start (settings->stats, &mark);
+  GSList* data = p_wpi_parse (filename, &settings->process_until);
+  dt_stats_stop_data (settings->stats, "parse", &mark, data);
+  if (data == NULL) return 1;
+
+  /* Strip the extension so each format can add its own. */
+  size_t base_len = strlen (filename);
+  if (high_has_wpi_extension (filename)) base_len -= 4;
+
+  char* output = malloc (base_len + 6);
+  if (output == NULL)
+    {
+      p_wpi_cleanup (data);
+      return 1;
+    }
+
+  memcpy (output, filename, base_len);
+  char* extension = output + base_len;
+  int status = 0;
+
+  if ((formats & FORMAT_PNG) && draws_png_directly (settings))
+    {
+      strcpy (extension, ".png");
+      dt_document* document = new_document (data, settings);
+      if (co_png_export_document_to_file (output, document, settings, NULL) != 0)
+	status = 1;
+      dt_document_free (document);
+      formats &= ~FORMAT_PNG;
+    }
+
+  /* PNG and PDF are rendered from the SVG data, so it only needs to be
+   * generated once for all three formats. */
+  if (formats & (FORMAT_SVG | FORMAT_PNG | FORMAT_PDF))
+    {
+      strcpy (extension, ".svg");
+      dt_stats_start (settings->stats, &mark);
+      char* svg = co_svg_create (data, output, settings);
+      dt_stats_stop_data (settings->stats, "svg", &mark, data);
+      if (svg == NULL)
+	status = 1;
+      else
+	{
+	  if ((formats & FORMAT_SVG)
+	      && write_svg_file (output, svg, settings->stats) != 0)
+	    status = 1;
+
+	  if (formats & (FORMAT_PNG | FORMAT_PDF))
+	    {
+	      RsvgHandle* handle;
+	      dt_stats_start (settings->stats, &mark);
+	      handle = rsvg_handle_new_from_data ((unsigned char*)svg,
+						  strlen (svg), NULL);
+	      dt_stats_stop (settings->stats, "rsvg", &mark, 0, 0);
+	      if (handle == NULL)
+		status = 1;
+	      else
+		{
+		  if (formats & FORMAT_PNG)
+		    {
+		      strcpy (extension, ".png");
+		      if (co_png_export_to_file_from_handle (output, handle) != 0)
+			status = 1;
+		    }
+
+		  if (formats & FORMAT_PDF)
+		    {
+		      strcpy (extension, ".pdf");
+		      if (co_pdf_export_to_file_from_handle (output, handle) != 0)
+			status = 1;
+		    }
+
+		  g_object_unref (handle);
+		}
+	    }
+
+	  free (svg);
+	}
+    }
+
+  if (formats & FORMAT_JSON)
+    {
+      strcpy (extension, ".json");
+      dt_stats_start (settings->stats, &mark);
+      if (co_json_create_file (output, data) != 0)
+	status = 1;
+      dt_stats_stop_data (settings->stats, "json", &mark, data);
+    }
+
+  if (formats & FORMAT_CSV)
+    {
+      strcpy (extension, ".csv");
+      dt_stats_start (settings->stats, &mark);
+      if (co_csv_create_file (output, data) != 0)
+	status = 1;
+      dt_stats_stop_data (settings->stats, "csv", &mark, data);
+    }
+
+  free (output);
+  p_wpi_cleanup (data);
+
+  return status;
+}
+
 /*----------------------------------------------------------------------------.
  | CONVERT_DIRECTORY                                                          |
- | This function is a helper to convert all WPI files in a directory to SVG.  |
+ | This function is a helper to convert all WPI files in a directory tree to  |
+ | the requested formats. Returns 0 when all of them were converted.          |
  '----------------------------------------------------------------------------*/
-void
+int
 high_convert_directory (const char* path, dt_configuration* settings)
 {
   DIR* directory;
   struct dirent* entry;
+  int status = 0;
 
   directory = opendir (path);
-  while ((entry = readdir (directory)) != NULL)
+  if (directory == NULL)
     {
-      /* Don't show files starting with a dot, '.' and '..' and only show 
-       * files with the WPI extension (others are not relevant). */
-      char* extension = entry->d_name + strlen (entry->d_name) - 3;
-      if (entry->d_name[0] != '.' && !strcmp (extension, "WPI"))
-	{
-	  size_t name_len = strlen (path) + strlen (entry->d_name) + 2;
-	  char* name = malloc (name_len);
-	  char* new_name = malloc (name_len);
-	  if (name == NULL || new_name == NULL) break;
+      printf ("Couldn't open directory '%s'.\n", path);
+      return 1;
+    }
 
-	  /* Construct a string that holds "path/name". */
-	  snprintf (name, name_len, "%s/%s", path, entry->d_name);
+  while ((entry = readdir (directory)) != NULL)
+    {
+      /* Don't look at files or directories starting with a dot. This also
+       * skips '.' and '..'. */
+      if (entry->d_name[0] == '.') continue;
 
-	  /* Parse a file.*/
-	  GSList* coordinates = p_wpi_parse (name, &settings->process_until);
+      /* Construct a string that holds "path/name". */
+      size_t name_len = strlen (path) + strlen (entry->d_name) + 2;
+      char* name = malloc (name_len);
+      if (name == NULL)
+	{
+	  status = 1;
+	  break;
+	}
 
-	  /* Construct a string for the new filename. */
-	  snprintf (new_name, name_len - 3, "%s/%s", path, entry->d_name);
-	  strcat (new_name, "svg");
+      snprintf (name, name_len, "%s/%s", path, entry->d_name);
 
-	  /* Convert a file. */
-	  co_svg_create_file (new_name, coordinates, settings);
+      /* Descend into subdirectories and only convert files with the WPI
+       * extension (others are not relevant). Symbolic links to directories
+       * are not followed to avoid endless loops. */
+      struct stat info;
+      if (lstat (name, &info) == 0)
+	{
+	  if (S_ISLNK (info.st_mode) && stat (name, &info) == 0
+	      && S_ISDIR (info.st_mode))
+	    info.st_mode = 0;
 
-	  /* Clean up. */
-	  p_wpi_cleanup (coordinates), coordinates = NULL;
-	  free (name);
-	  free (new_name);
+	  if (S_ISDIR (info.st_mode))
+	    {
+	      if (high_convert_directory (name, settings) != 0)
+		status = 1;
+	    }
+	  else if (S_ISREG (info.st_mode) && high_has_wpi_extension (entry->d_name)
+		   && high_convert_file (name, settings) != 0)
+	    {
+	      printf ("Couldn't convert '%s'.\n", name);
+	      status = 1;
+	    }
 	}
+
+      free (name);
     }
+
   closedir (directory);
+  return status;
 }
 
 
@@ -103,17 +330,36 @@ high_export_to_file (GSList* data, const char* svg_data, const char* to, dt_conf
 
   if (strlen (to) > 4)
     {
+      dt_stats_mark mark;
       char* extension = strrchr (to, '.');
       if (!strcmp (extension, ".json"))
-	co_json_create_file (to, data);
+	{
+	  dt_stats_start (settings->stats, &mark);
+	  co_json_create_file (to, data);
+	  dt_stats_stop_data (settings->stats, "json", &mark, data);
+	}
       else if (!strcmp (extension, ".csv"))
-	co_csv_create_file (to, data);
+	{
+	  dt_stats_start (settings->stats, &mark);
+	  co_csv_create_file (to, data);
+	  dt_stats_stop_data (settings->stats, "csv", &mark, data);
+	}
+      else if (!strcmp (extension, ".png") && draws_png_directly (settings))
+	{
+	  dt_document* document = new_document (data, settings);
+	  co_png_export_document_to_file (to, document, settings, NULL);
+	  dt_document_free (document);
+	}
       else
 	{
 	  char* svg = NULL;
 	  /* When no svg data is available yet, create it. */
 	  if (svg_data == NULL)
-	    svg = co_svg_create (data, to, settings);
+	    {
+	      dt_stats_start (settings->stats, &mark);
+	      svg = co_svg_create (data, to, settings);
+	      dt_stats_stop_data (settings->stats, "svg", &mark, data);
+	    }
 	  else
 	    svg = (char*)svg_data;
 
@@ -126,14 +372,7 @@ high_export_to_file (GSList* data, const char* svg_data, const char* to, dt_conf
 	  else if (!strcmp (extension, ".pdf"))
 	    co_pdf_export_to_file (to, svg);
 	  else if (!strcmp (extension, ".svg"))
-	    {
-	      FILE* file;
-	      file = fopen (to, "w");
-	      if (file != NULL)
-		fwrite (svg, strlen (svg), 1, file);
-
-	      fclose (file);
-	    }
+	    write_svg_file (to, svg, settings->stats);
 	  else
 	    unsupported ();
 
@@ -146,66 +385,490 @@ high_export_to_file (GSList* data, const char* svg_data, const char* to, dt_conf
 }
 
 
+/*----------------------------------------------------------------------------.
+ | APPEND_TO_STRING                                                           |
+ | This cairo write function appends the data it receives to a GString.      |
+ '----------------------------------------------------------------------------*/
+static cairo_status_t
+append_to_string (void* closure, const unsigned char* data, unsigned int length)
+{
+  g_string_append_len ((GString*)closure, (const gchar*)data, length);
+  return CAIRO_STATUS_SUCCESS;
+}
+
+/*----------------------------------------------------------------------------.
+ | EXPORT_TO_MEMORY                                                           |
+ | This function does the same as high_export_to_file() for a single format,  |
+ | but keeps the result in memory. Returns NULL when something went wrong.    |
+ '----------------------------------------------------------------------------*/
+char*
+high_export_to_memory (GSList* data, unsigned int format, dt_configuration* settings,
+		       size_t* length)
+{
+  char* output = NULL;
+  dt_stats_mark mark;
+
+  if (format == FORMAT_JSON)
+    {
+      dt_stats_start (settings->stats, &mark);
+      output = co_json_create (data);
+      dt_stats_stop_data (settings->stats, "json", &mark, data);
+    }
+  else if (format == FORMAT_CSV)
+    {
+      dt_stats_start (settings->stats, &mark);
+      output = co_csv_create (data);
+      dt_stats_stop_data (settings->stats, "csv", &mark, data);
+    }
+  else if (format == FORMAT_WPI)
+    {
+      dt_stats_start (settings->stats, &mark);
+      output = (char*)co_wpi_create (data, length);
+      dt_stats_stop_data (settings->stats, "wpi", &mark, data);
+      return output;
+    }
+  else if (format == FORMAT_PNG && draws_png_directly (settings))
+    {
+      dt_document* document = new_document (data, settings);
+      GString* buffer = g_string_new (NULL);
+      int status = co_png_export_document_to_stream (append_to_string, buffer,
+						     document, settings, NULL);
+      dt_document_free (document);
+
+      if (status == 0)
+	{
+	  *length = buffer->len;
+	  output = malloc (buffer->len + 1);
+	  if (output != NULL)
+	    memcpy (output, buffer->str, buffer->len + 1);
+	}
+
+      g_string_free (buffer, TRUE);
+      return output;
+    }
+  else
+    {
+      dt_stats_start (settings->stats, &mark);
+      output = co_svg_create (data, NULL, settings);
+      dt_stats_stop_data (settings->stats, "svg", &mark, data);
+      if (output == NULL || format == FORMAT_SVG)
+	{
+	  if (output != NULL) *length = strlen (output);
+	  return output;
+	}
+
+      RsvgHandle* handle;
+      dt_stats_start (settings->stats, &mark);
+      handle = rsvg_handle_new_from_data ((unsigned char*)output,
+					  strlen (output), NULL);
+      dt_stats_stop (settings->stats, "rsvg", &mark, 0, 0);
+      free (output), output = NULL;
+      if (handle == NULL) return NULL;
+
+      GString* buffer = g_string_new (NULL);
+      int status = 1;
+      if (format == FORMAT_PNG)
+	status = co_png_export_to_stream (append_to_string, buffer, handle, settings);
+      else if (format == FORMAT_PDF)
+	status = co_pdf_export_to_stream (append_to_string, buffer, handle, settings);
+
+      g_object_unref (handle);
+
+      if (status != 0)
+	{
+	  g_string_free (buffer, TRUE);
+	  return NULL;
+	}
+
+      /* Hand over the GString's data as a plain malloc'd block, so that the
+       * caller can free() it like the other formats. */
+      *length = buffer->len;
+      output = malloc (buffer->len + 1);
+      if (output != NULL)
+	memcpy (output, buffer->str, buffer->len + 1);
+
+      g_string_free (buffer, TRUE);
+      return output;
+    }
+
+  if (output != NULL) *length = strlen (output);
+  return output;
+}
+
+/*----------------------------------------------------------------------------.
+ | EXPORT_REGION_TO_FILE                                                      |
+ '----------------------------------------------------------------------------*/
+int
+high_export_region_to_file (GSList* data, const char* to, dt_configuration* settings,
+			    const dt_rectangle* region)
+{
+  if (high_format_from_name (to) != FORMAT_PNG)
+    {
+      puts ("Only PNG files can be exported for a region.");
+      return 1;
+    }
+
+  dt_document* document = new_document (data, settings);
+  int status = co_png_export_region_to_file (to, document, settings, region);
+  dt_document_free (document);
+
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | FORMAT_FROM_NAME                                                           |
+ | This function turns the name or file extension of a single format into a   |
+ | FORMAT_* value. Returns 0 when the format is unknown.                      |
+ '----------------------------------------------------------------------------*/
+unsigned int
+high_format_from_name (const char* name)
+{
+  if (name == NULL) return 0;
+
+  /* Allow a filename to be passed. */
+  const char* extension = strrchr (name, '.');
+  if (extension != NULL) name = extension + 1;
+
+  if (!g_ascii_strcasecmp (name, "svg"))  return FORMAT_SVG;
+  if (!g_ascii_strcasecmp (name, "png"))  return FORMAT_PNG;
+  if (!g_ascii_strcasecmp (name, "pdf"))  return FORMAT_PDF;
+  if (!g_ascii_strcasecmp (name, "json")) return FORMAT_JSON;
+  if (!g_ascii_strcasecmp (name, "csv"))  return FORMAT_CSV;
+  if (!g_ascii_strcasecmp (name, "wpi"))  return FORMAT_WPI;
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | EXPORT_FORMAT_TO_FILE                                                      |
+ | This function converts parsed data to a single format and writes it to a   |
+ | file. Returns 0 on success, 1 when something went wrong.                   |
+ '----------------------------------------------------------------------------*/
+int
+high_export_format_to_file (GSList* data, unsigned int format, const char* to,
+			    dt_configuration* settings)
+{
+  /* Don't keep the whole image in memory when it's drawn in bands. */
+  if (format == FORMAT_PNG && draws_png_directly (settings))
+    {
+      dt_document* document = new_document (data, settings);
+      int status = co_png_export_document_to_file (to, document, settings, NULL);
+      dt_document_free (document);
+      return status;
+    }
+
+  size_t length = 0;
+  char* output = high_export_to_memory (data, format, settings, &length);
+  if (output == NULL) return 1;
+
+  dt_stats_mark mark;
+  dt_stats_span_start (settings->stats, &mark);
+
+  int status = 1;
+  FILE* file = fopen (to, "wb");
+  if (file != NULL)
+    {
+      status = (fwrite (output, 1, length, file) != length);
+      if (fclose (file) != 0) status = 1;
+    }
+
+  dt_stats_span_stop (settings->stats, "write", &mark, 0, 0);
+
+  free (output);
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | COPY_FILE_DATA                                                             |
+ | This function copies 'length' bytes from 'in' (starting at 'offset') to    |
+ | the current position of 'out'. The kernel does the copying when it can.    |
+ | Returns 0 on success, 1 when something went wrong.                         |
+ '----------------------------------------------------------------------------*/
+static int
+copy_file_data (int in, off_t offset, size_t length, int out)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+  loff_t position = offset;
+  while (length > 0)
+    {
+      ssize_t copied = copy_file_range (in, &position, out, NULL, length, 0);
+      if (copied <= 0) break;
+      length -= copied;
+    }
+
+  offset = position;
+  if (length == 0) return 0;
+#endif
+
+#ifdef HAVE_SYS_SENDFILE_H
+  while (length > 0)
+    {
+      ssize_t copied = sendfile (out, in, &offset, length);
+      if (copied <= 0) break;
+      length -= copied;
+    }
+
+  if (length == 0) return 0;
+#endif
+
+  /* Fall back to copying through a small buffer. */
+  if (lseek (in, offset, SEEK_SET) == (off_t)-1)
+    return 1;
+
+  unsigned char buffer[65536];
+  while (length > 0)
+    {
+      size_t chunk = (length < sizeof (buffer)) ? length : sizeof (buffer);
+      ssize_t bytes = read (in, buffer, chunk);
+      if (bytes <= 0) return 1;
+
+      ssize_t written = 0;
+      while (written < bytes)
+	{
+	  ssize_t result = write (out, buffer + written, bytes - written);
+	  if (result < 0) return 1;
+	  written += result;
+	}
+
+      length -= bytes;
+    }
+
+  return 0;
+}
+
 /*----------------------------------------------------------------------------.
  | MERGE_WPI_FILES:                                                           |
- | This function merges two WPI files.                                        |
+ | This function merges WPI files by streaming their data into a new file.    |
+ | The first file is copied as a whole. Of each other file, only the data     |
+ | after the preamble is appended, preceded by a "new layer" marker.          |
  '----------------------------------------------------------------------------*/
-void
-high_merge_wpi_files (const char* first, const char* second)
+int
+high_merge_wpi_files (const char** inputs, int num_inputs, const char* output)
 {
-  char* ext1 = (char*)first + strlen (first) - 3;
-  char* ext2 = (char*)second + strlen (second) - 3;
+  int index;
+  for (index = 0; index < num_inputs; index++)
+    if (!high_has_wpi_extension (inputs[index]))
+      {
+	puts ("I can only merge files with a .WPI extension.");
+	return 1;
+      }
 
-  if (strcmp (ext1, "WPI") || strcmp (ext2, "WPI"))
+  /* Write to a temporary file first, so that the output can also be one
+   * of the inputs, and so that a failure doesn't leave a broken file. */
+  char* temporary = g_strconcat (output, ".XXXXXX", NULL);
+  int out = g_mkstemp (temporary);
+  if (out < 0)
     {
-      puts ("I can only merge files with a .WPI extension.");
-      return;
+      printf ("Couldn't write to '%s'.\n", output);
+      g_free (temporary);
+      return 1;
     }
 
-  FILE* file1 = fopen (first, "rb");
-  FILE* file2 = fopen (second, "rb");
+  int status = 0;
+  for (index = 0; index < num_inputs && status == 0; index++)
+    {
+      int in = open (inputs[index], O_RDONLY | O_BINARY);
+      struct stat info;
 
-  if (!file1 && !file2)
+      if (in < 0 || fstat (in, &info) != 0 || info.st_size < WPI_PREAMBLE_LEN)
+	{
+	  printf ("Couldn't read '%s'.\n", inputs[index]);
+	  status = 1;
+	}
+      else if (index == 0)
+	{
+	  /* g_mkstemp() creates a file that only its owner can read. Give
+	   * the output the permissions of the first file instead. */
+#ifndef _WIN32
+	  fchmod (out, info.st_mode & 0777);
+#endif
+	  status = copy_file_data (in, 0, info.st_size, out);
+	}
+      else
+	{
+	  /* Put the data of this file in a separate layer. */
+	  unsigned char marker[3] = { BLOCK_STROKE, 3, NEW_LAYER };
+	  if (write (out, marker, sizeof (marker)) != sizeof (marker))
+	    status = 1;
+	  else
+	    status = copy_file_data (in, WPI_PREAMBLE_LEN,
+				     info.st_size - WPI_PREAMBLE_LEN, out);
+	}
+
+      if (in >= 0)
+	close (in);
+    }
+
+  if (close (out) != 0)
+    status = 1;
+
+  if (status == 0)
     {
-      puts ("Couldn't open all files.");
-      return;
+#ifdef _WIN32
+      /* On Windows, rename() doesn't replace existing files. */
+      remove (output);
+#endif
+      if (rename (temporary, output) != 0)
+	status = 1;
     }
 
-  /* Check out the length of the files. */
-  struct stat info1, info2;
-  stat (first, &info1);
-  stat (second, &info2);
+  if (status != 0)
+    {
+      printf ("Couldn't write to '%s'.\n", output);
+      remove (temporary);
+    }
 
-  /* Allocate memory to store both files in one variable. */
-  size_t data_len = info1.st_size + info2.st_size - 2040;
-  unsigned char* data = malloc (data_len + 4);
-  size_t written = 0;
+  g_free (temporary);
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | ADD_PDF_PAGES                                                              |
+ | This function adds a WPI file to a book, on a single page or with each of  |
+ | its layers on a page of its own. Returns 0 on success.                     |
+ '----------------------------------------------------------------------------*/
+static int
+add_pdf_pages (co_pdf_book* book, const char* filename, dt_configuration* settings,
+	       int by_layer)
+{
+  dt_stats_mark mark;
+  dt_stats_start (settings->stats, &mark);
+  unsigned short seconds = 0;
+  GSList* data = p_wpi_parse (filename, &seconds);
+  dt_stats_stop_data (settings->stats, "parse", &mark, data);
+  if (data == NULL)
+    {
+      printf ("Couldn't read '%s'.\n", filename);
+      return 1;
+    }
 
-  /* Put the contents of the files in the memory. */
-  written += fread (data, 1, info1.st_size, file1);
-  fclose (file1);
+  dt_document* document = new_document (data, settings);
 
-  /* Put the data of the second file in a separate layer. */
-  data[written] = BLOCK_STROKE;
-  data[written + 1] = 3;
-  data[written + 2] = NEW_LAYER;
-  written += 3;
+  /* The strokes have been taken from the parsed data, so it can go before
+   * the pages are drawn. */
+  p_wpi_cleanup (data);
 
-  /* Append the data from the second file. */
-  fseek (file2, 2040, SEEK_SET);
-  written += fread (data + written, 1, info2.st_size - 2040, file2);
-  fclose (file2);
+  /* A page always shows the whole file, like a recording does (see
+   * usb_recording_flush()). Only that differs from the shared settings, so
+   * a shallow copy will do. */
+  dt_configuration page_settings = *settings;
+  page_settings.process_until = USHRT_MAX;
 
-  /* Write the combined data to the second file. */
-  FILE* output = fopen (second, "wb");
-  if (!file2)
-    printf ("Couldn't write to '%s'\r\n", second);
+  int status = 0;
+  if (!by_layer || document == NULL || document->num_layers < 2)
+    status = co_pdf_book_add_page (book, document, &page_settings, -1);
   else
     {
-      data[written] = '\0';
-      fwrite (data, data_len + 1, 1, output);
-      fclose (output);
+      unsigned int layer = 0;
+      for (; layer < document->num_layers && status == 0; layer++)
+	status = co_pdf_book_add_page (book, document, &page_settings, layer);
+    }
+
+  dt_document_free (document);
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | ADD_PDF_DIRECTORY                                                          |
+ | This function adds each WPI file in a directory tree to a book, in the     |
+ | order of their names. Like high_convert_directory(), hidden files and      |
+ | symbolic links to directories are skipped. Returns 0 on success.           |
+ '----------------------------------------------------------------------------*/
+static int
+add_pdf_directory (co_pdf_book* book, const char* path, dt_configuration* settings)
+{
+  DIR* directory = opendir (path);
+  if (directory == NULL)
+    {
+      printf ("Couldn't open directory '%s'.\n", path);
+      return 1;
+    }
+
+  /* readdir() returns the entries in no particular order. */
+  GSList* names = NULL;
+  struct dirent* entry;
+  while ((entry = readdir (directory)) != NULL)
+    if (entry->d_name[0] != '.')
+      names = g_slist_prepend (names, g_strdup (entry->d_name));
+
+  closedir (directory);
+  names = g_slist_sort (names, (GCompareFunc)strcmp);
+
+  int status = 0;
+  GSList* item = names;
+  for (; item != NULL; item = item->next)
+    {
+      const char* base = (const char*)item->data;
+      char* name = g_strconcat (path, "/", base, NULL);
+
+      struct stat info;
+      if (lstat (name, &info) == 0)
+	{
+	  if (S_ISLNK (info.st_mode) && stat (name, &info) == 0
+	      && S_ISDIR (info.st_mode))
+	    info.st_mode = 0;
+
+	  if (S_ISDIR (info.st_mode))
+	    status |= add_pdf_directory (book, name, settings);
+	  else if (S_ISREG (info.st_mode) && high_has_wpi_extension (base))
+	    status |= add_pdf_pages (book, name, settings, 0);
+	}
+
+      g_free (name);
+    }
+
+  g_slist_free_full (names, g_free);
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | EXPORT_PAGES_TO_PDF                                                        |
+ | This function draws WPI files as pages of a single PDF document. Each      |
+ | file is parsed, drawn and freed before the next one is read.               |
+ '----------------------------------------------------------------------------*/
+int
+high_export_pages_to_pdf (const char** inputs, int num_inputs, const char* to,
+			  dt_configuration* settings)
+{
+  if (high_format_from_name (to) != FORMAT_PDF)
+    {
+      puts ("Pages can only be exported to a PDF file.");
+      return 1;
+    }
+
+  /* Make sure we have valid dimensions. */
+  if (settings->page.measurement == NULL)
+    dt_configuration_parse_dimensions (NULL, settings);
+
+  co_pdf_book* book = co_pdf_book_new (to, settings->stats);
+  if (book == NULL) return 1;
+
+  int status = 0;
+  int index = 0;
+  for (; index < num_inputs; index++)
+    {
+      struct stat info;
+      if (stat (inputs[index], &info) == 0 && S_ISDIR (info.st_mode))
+	status |= add_pdf_directory (book, inputs[index], settings);
+      else
+	status |= add_pdf_pages (book, inputs[index], settings, 1);
+    }
+
+  if (book->num_pages == 0)
+    {
+      puts ("There are no pages to export.");
+      co_pdf_book_close (book);
+      return 1;
+    }
+
+  dt_stats_mark mark;
+  dt_stats_span_start (settings->stats, &mark);
+  if (co_pdf_book_close (book) != 0)
+    {
+      printf ("Couldn't write to '%s'.\n", to);
+      status = 1;
     }
+  dt_stats_span_stop (settings->stats, "write", &mark, 0, 0);
 
-  free (data);
+  return status;
 }
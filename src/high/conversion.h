@@ -36,6 +36,7 @@
 
 #include <glib.h>
 #include "../datatypes/configuration.h"
+#include "../datatypes/document.h"
 
 /**
  * This function handles exporting a file. It looks at the file extension to figure out
@@ -50,17 +51,104 @@
 void high_export_to_file (GSList* data, const char* svg_data, const char* to, dt_configuration* settings);
 
 /**
- * This function exports all non-hidden files in a directory to SVGs.
+ * This function converts parsed data to a single format and keeps the
+ * result in memory.
+ *
+ * @param data      Data parsed with p_wpi_parse().
+ * @param format    One of the FORMAT_* values.
+ * @param settings  Pass along the user's custom settings.
+ * @param length    Is set to the number of bytes in the result.
+ * @return A malloc'd buffer that should be freed with free(), or NULL when
+ *         something went wrong.
+ */
+char* high_export_to_memory (GSList* data, unsigned int format, dt_configuration* settings,
+			     size_t* length);
+
+/**
+ * This function converts parsed data to a single format and writes it to a
+ * file. Unlike high_export_to_file(), all settings are taken from 'settings'.
+ *
+ * @param data      Data parsed with p_wpi_parse().
+ * @param format    One of the FORMAT_* values.
+ * @param to        The filename to export to.
+ * @param settings  Pass along the user's custom settings.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int high_export_format_to_file (GSList* data, unsigned int format, const char* to,
+				dt_configuration* settings);
+
+/**
+ * This function draws part of the page to a PNG file. Only the strokes that
+ * overlap the part are looked at.
+ *
+ * @param data      Data parsed with p_wpi_parse().
+ * @param to        The filename to export to. It must end with ".png".
+ * @param settings  Pass along the user's custom settings.
+ * @param region    The part of the page, in the units of the page dimensions.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int high_export_region_to_file (GSList* data, const char* to, dt_configuration* settings,
+				const dt_rectangle* region);
+
+/**
+ * This function looks up the FORMAT_* value for the name of a format (for
+ * example "png") or for the extension of a filename.
+ * @param name  The name of the format, or a filename.
+ * @return The FORMAT_* value, or 0 when the format is unknown.
+ */
+unsigned int high_format_from_name (const char* name);
+
+/**
+ * This function checks whether a filename has the WPI extension. The
+ * extension is matched case-insensitively.
+ * @param name  The filename to check.
+ * @return 1 when the filename ends with ".wpi", 0 otherwise.
+ */
+int high_has_wpi_extension (const char* name);
+
+/**
+ * This function parses a WPI file once and writes each format that is set in
+ * 'settings->export_formats' (SVG when none is set) next to the file.
+ * When one format can't be written, the others still are.
+ * @param filename  The WPI file to convert.
+ * @param settings  Pass along the user's custom settings.
+ * @return 0 when every format was written, 1 when something went wrong.
+ */
+int high_convert_file (const char* filename, dt_configuration* settings);
+
+/**
+ * This function converts all non-hidden WPI files in a directory and its
+ * subdirectories. See high_convert_file() for the formats that are written.
  * @param path      The directory with WPI files to convert.
  * @param settings  Pass along the user's custom settings.
+ * @return 0 when every file was converted, 1 when something went wrong.
+ */
+int high_convert_directory (const char* path, dt_configuration* settings);
+
+/**
+ * This function merges WPI files into one. The data of each file is put in a
+ * separate layer. The files are streamed, so the memory usage does not
+ * depend on the size of the files.
+ * @param inputs      The documents to merge, in order.
+ * @param num_inputs  The number of documents in 'inputs'.
+ * @param output      The file to write to. This may be one of the inputs.
+ * @return 0 when everything went fine, 1 when something went wrong.
  */
-void high_convert_directory (const char* path, dt_configuration* settings);
+int high_merge_wpi_files (const char** inputs, int num_inputs, const char* output);
 
 /**
- * This function merges two WPI files. It puts each layer in a seperate layer.
- * @param first  The document to merge to.
- * @param second The document to add to the first.
+ * This function draws WPI files as the pages of a single PDF document.
+ * A directory adds a page for each WPI file in it and its subdirectories,
+ * in the order of their names. A WPI file adds a page for each of its
+ * layers. Pages are written as soon as they are drawn, so the memory usage
+ * does not depend on the number of pages.
+ * @param inputs      The WPI files and directories, in order.
+ * @param num_inputs  The number of elements in 'inputs'.
+ * @param to          The PDF file to write to.
+ * @param settings    Pass along the user's custom settings.
+ * @return 0 when everything went fine, 1 when something went wrong.
  */
-void high_merge_wpi_files (const char* first, const char* second);
+int high_export_pages_to_pdf (const char** inputs, int num_inputs, const char* to,
+			      dt_configuration* settings);
 
 #endif//DATATYPES_CONVERSION_H
@@ -0,0 +1,710 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "server.h"
+#include "conversion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#ifndef _WIN32
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "../parsers/wpi.h"
+
+/* Rendering is CPU-bound, so more workers than processors doesn't help. */
+#define MAX_WORKERS 8
+
+/* Limits that protect the server against clients that misbehave. */
+#define MAX_LINE_LEN  4096
+#define MAX_DATA_LEN  (256 * 1024 * 1024)
+
+/* Connections without a request for this many seconds are closed. */
+#define IDLE_TIMEOUT 60
+
+/* A request must be sent, and its reply taken, within this many seconds. */
+#define REQUEST_TIMEOUT 30
+
+/* A small read buffer so that request lines don't need a system call for
+ * every byte. 'last_active' is when the last request was handled. */
+typedef struct
+{
+  int fd;
+  gint64 last_active;
+  size_t start;
+  size_t end;
+  char buffer[65536];
+} serve_connection;
+
+static volatile sig_atomic_t stop_serving = 0;
+static dt_configuration* serve_settings = NULL;
+
+/* The connections of which a request is being handled, so they can be shut
+ * down when the server stops. */
+static GHashTable* busy = NULL;
+static GMutex connections_lock;
+
+/* The connections that the workers hand back to the main loop after a
+ * request, and the pipe that wakes the main loop up. */
+static GSList* returned = NULL;
+static int wake_pipe[2] = { -1, -1 };
+
+/*----------------------------------------------------------------------------.
+ | SERVE_STOP                                                                 |
+ | This signal handler makes the main loop stop.                              |
+ '----------------------------------------------------------------------------*/
+static void
+serve_stop (int signal_number)
+{
+  (void)signal_number;
+  stop_serving = 1;
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_FILL                                                                 |
+ | This function reads more data into the connection's buffer. Returns 0 on   |
+ | success, 1 when the connection was closed or an error occurred.            |
+ '----------------------------------------------------------------------------*/
+static int
+serve_fill (serve_connection* connection)
+{
+  if (connection->start == connection->end)
+    connection->start = connection->end = 0;
+
+  ssize_t bytes;
+  do
+    bytes = read (connection->fd, connection->buffer + connection->end,
+		  sizeof (connection->buffer) - connection->end);
+  while (bytes < 0 && errno == EINTR);
+
+  if (bytes <= 0) return 1;
+
+  connection->end += bytes;
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_READ_LINE                                                            |
+ | This function reads a line without its newline into 'line'. Returns 0 on   |
+ | success, 1 when the connection was closed or the line is too long.         |
+ '----------------------------------------------------------------------------*/
+static int
+serve_read_line (serve_connection* connection, GString* line)
+{
+  g_string_truncate (line, 0);
+
+  while (1)
+    {
+      char* start = connection->buffer + connection->start;
+      size_t available = connection->end - connection->start;
+      char* newline = memchr (start, '\n', available);
+
+      size_t length = (newline != NULL) ? (size_t)(newline - start) : available;
+      g_string_append_len (line, start, length);
+
+      if (line->len > MAX_LINE_LEN) return 1;
+
+      if (newline != NULL)
+	{
+	  connection->start += length + 1;
+	  if (line->len > 0 && line->str[line->len - 1] == '\r')
+	    g_string_truncate (line, line->len - 1);
+	  return 0;
+	}
+
+      connection->start = connection->end;
+      if (serve_fill (connection)) return 1;
+    }
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_READ_DATA                                                            |
+ | This function reads exactly 'length' bytes. Returns 0 on success.          |
+ '----------------------------------------------------------------------------*/
+static int
+serve_read_data (serve_connection* connection, unsigned char* data, size_t length)
+{
+  size_t received = 0;
+  while (received < length)
+    {
+      if (connection->start == connection->end && serve_fill (connection))
+	return 1;
+
+      size_t chunk = connection->end - connection->start;
+      if (chunk > length - received) chunk = length - received;
+
+      memcpy (data + received, connection->buffer + connection->start, chunk);
+      connection->start += chunk;
+      received += chunk;
+    }
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_WRITE                                                                |
+ | This function writes a complete buffer to a socket. Returns 0 on success.  |
+ '----------------------------------------------------------------------------*/
+static int
+serve_write (int fd, const char* data, size_t length)
+{
+  while (length > 0)
+    {
+      ssize_t written = write (fd, data, length);
+      if (written < 0 && errno == EINTR) continue;
+      if (written <= 0) return 1;
+
+      data += written;
+      length -= written;
+    }
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_REPLY_ERROR                                                          |
+ | This function sends an error message to the client.                        |
+ '----------------------------------------------------------------------------*/
+static int
+serve_reply_error (int fd, const char* message)
+{
+  char* reply = g_strconcat ("status=error\nmessage=", message, "\n\n", NULL);
+  int status = serve_write (fd, reply, strlen (reply));
+  g_free (reply);
+
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_REPLY                                                                |
+ | This function sends the result of a conversion to the client.              |
+ '----------------------------------------------------------------------------*/
+static int
+serve_reply (int fd, const char* data, size_t length)
+{
+  char header[64];
+  snprintf (header, sizeof (header), "status=ok\nlength=%lu\n\n",
+	    (unsigned long)length);
+
+  if (serve_write (fd, header, strlen (header)))
+    return 1;
+
+  return serve_write (fd, data, length);
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_REQUEST                                                              |
+ | This function handles a single request on a connection. Returns 0 when the |
+ | connection can be used for another request.                                |
+ '----------------------------------------------------------------------------*/
+static int
+serve_request (serve_connection* connection, GString* line)
+{
+  char* input = NULL;
+  char* output = NULL;
+  unsigned int format = 0;
+  unsigned long length = 0;
+  int has_data = 0;
+  int status = 0;
+  const char* error = NULL;
+
+  /* Each request gets its own copy of the settings, so that the overrides
+   * of one request don't affect others. */
+  dt_configuration settings;
+  dt_configuration_copy (serve_settings, &settings);
+
+  /* Read the header lines. A connection that is closed before the first
+   * line of a request simply ends the conversation. */
+  int lines = 0;
+  while ((status = serve_read_line (connection, line)) == 0 && line->len > 0)
+    {
+      lines++;
+      char* value = strchr (line->str, '=');
+      if (value == NULL)
+	{
+	  error = "Expected a line in the form 'key=value'.";
+	  continue;
+	}
+
+      *value = '\0';
+      value++;
+
+      if (!strcmp (line->str, "input"))
+	g_free (input), input = g_strdup (value);
+      else if (!strcmp (line->str, "output"))
+	g_free (output), output = g_strdup (value);
+      else if (!strcmp (line->str, "format"))
+	{
+	  format = high_format_from_name (value);
+	  if (format == 0) error = "Unknown format.";
+	}
+      else if (!strcmp (line->str, "length"))
+	{
+	  char* end = NULL;
+	  errno = 0;
+	  length = strtoul (value, &end, 10);
+	  has_data = 1;
+	  if (errno != 0 || *end != '\0' || length > MAX_DATA_LEN)
+	    {
+	      /* The data can't be skipped safely, so the connection is
+	       * closed after replying. */
+	      serve_reply_error (connection->fd, "Invalid length.");
+	      status = 1;
+	      break;
+	    }
+	}
+      else if (dt_configuration_set_option (line->str, value, &settings))
+	error = "Unknown or invalid option.";
+    }
+
+  if (status != 0)
+    {
+      if (lines > 0 && !has_data)
+	serve_reply_error (connection->fd, "Incomplete request.");
+      goto done;
+    }
+
+  /* Read the WPI data that follows the header, even when the request is
+   * invalid, so that the next request starts at the right place. */
+  unsigned char* data = NULL;
+  if (has_data)
+    {
+      data = malloc (length + 1);
+      if (data == NULL || serve_read_data (connection, data, length))
+	{
+	  free (data);
+	  status = 1;
+	  goto done;
+	}
+    }
+
+  if (error == NULL && has_data == (input != NULL))
+    error = "Specify either 'input' or 'length'.";
+
+  if (error == NULL && format == 0)
+    {
+      format = (output != NULL) ? high_format_from_name (output) : FORMAT_SVG;
+      if (format == 0) error = "Unknown format.";
+    }
+
+  if (error != NULL)
+    {
+      free (data);
+      status = serve_reply_error (connection->fd, error);
+      goto done;
+    }
+
+  dt_stats_mark mark;
+  dt_stats_start (settings.stats, &mark);
+
+  GSList* elements = NULL;
+  if (has_data)
+    elements = p_wpi_parse_data (data, length, &settings.process_until);
+  else
+    elements = p_wpi_parse (input, &settings.process_until);
+
+  dt_stats_stop_data (settings.stats, "parse", &mark, elements);
+
+  free (data);
+
+  if (elements == NULL)
+    {
+      status = serve_reply_error (connection->fd, "Couldn't parse the WPI data.");
+      goto done;
+    }
+
+  if (output != NULL)
+    {
+      if (high_export_format_to_file (elements, format, output, &settings))
+	status = serve_reply_error (connection->fd, "Couldn't write the output file.");
+      else
+	status = serve_reply (connection->fd, NULL, 0);
+    }
+  else
+    {
+      size_t result_len = 0;
+      char* result = high_export_to_memory (elements, format, &settings, &result_len);
+
+      if (result == NULL)
+	status = serve_reply_error (connection->fd, "Couldn't convert the WPI data.");
+      else
+	status = serve_reply (connection->fd, result, result_len);
+
+      free (result);
+    }
+
+  p_wpi_cleanup (elements);
+
+ done:
+  g_free (input);
+  g_free (output);
+  dt_configuration_cleanup (&settings);
+
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_CLOSE                                                                |
+ '----------------------------------------------------------------------------*/
+static void
+serve_close (serve_connection* connection)
+{
+  close (connection->fd);
+  free (connection);
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_HANDLE_REQUEST                                                       |
+ | This function runs in a worker thread and handles one request. Then the    |
+ | connection goes back to the main loop, so that waiting for the next        |
+ | request doesn't keep a worker busy.                                        |
+ '----------------------------------------------------------------------------*/
+static void
+serve_handle_request (gpointer data, gpointer user_data)
+{
+  serve_connection* connection = (serve_connection*)data;
+  (void)user_data;
+
+  dt_stats_name_thread (serve_settings->stats, "serve");
+
+  GString* line = g_string_new (NULL);
+  int status = serve_request (connection, line);
+  g_string_free (line, TRUE);
+
+  g_mutex_lock (&connections_lock);
+  g_hash_table_remove (busy, connection);
+  if (status == 0)
+    {
+      connection->last_active = g_get_monotonic_time ();
+      returned = g_slist_prepend (returned, connection);
+    }
+  g_mutex_unlock (&connections_lock);
+
+  if (status != 0)
+    {
+      serve_close (connection);
+      return;
+    }
+
+  /* The pipe doesn't block. When it's full, the main loop will wake up
+   * anyway. */
+  char byte = 0;
+  if (write (wake_pipe[1], &byte, 1) < 0 && errno != EAGAIN)
+    perror ("write");
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_DISPATCH                                                             |
+ | This function hands a connection with a request over to the workers.       |
+ '----------------------------------------------------------------------------*/
+static void
+serve_dispatch (GThreadPool* pool, serve_connection* connection)
+{
+  g_mutex_lock (&connections_lock);
+  g_hash_table_insert (busy, connection, NULL);
+  g_mutex_unlock (&connections_lock);
+
+  g_thread_pool_push (pool, connection, NULL);
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_NEW_CONNECTION                                                       |
+ | This function prepares an accepted connection. A client that stops in the  |
+ | middle of a request, or doesn't read its reply, only keeps a worker busy   |
+ | for REQUEST_TIMEOUT seconds. Returns NULL when it's out of memory.         |
+ '----------------------------------------------------------------------------*/
+static serve_connection*
+serve_new_connection (int fd)
+{
+  struct timeval timeout = { REQUEST_TIMEOUT, 0 };
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+  setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+
+  serve_connection* connection = calloc (1, sizeof (serve_connection));
+  if (connection == NULL)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  connection->fd = fd;
+  connection->last_active = g_get_monotonic_time ();
+
+  return connection;
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_TAKE_RETURNED                                                        |
+ | This function takes the connections that the workers handed back. A client |
+ | may have sent its next request along with the previous one, in which case  |
+ | it is already in the buffer and poll() won't report it.                    |
+ '----------------------------------------------------------------------------*/
+static void
+serve_take_returned (GThreadPool* pool, GPtrArray* idle)
+{
+  char drain[64];
+  while (read (wake_pipe[0], drain, sizeof (drain)) > 0)
+    ;
+
+  g_mutex_lock (&connections_lock);
+  GSList* list = returned;
+  returned = NULL;
+  g_mutex_unlock (&connections_lock);
+
+  GSList* item = list;
+  for (; item != NULL; item = item->next)
+    {
+      serve_connection* connection = (serve_connection*)item->data;
+      if (connection->start < connection->end)
+	serve_dispatch (pool, connection);
+      else
+	g_ptr_array_add (idle, connection);
+    }
+
+  g_slist_free (list);
+}
+
+/*----------------------------------------------------------------------------.
+ | SERVE_SHUTDOWN_CONNECTION                                                  |
+ | This function makes a worker that waits for the rest of a request return.  |
+ '----------------------------------------------------------------------------*/
+static void
+serve_shutdown_connection (gpointer key, gpointer value, gpointer user_data)
+{
+  (void)value;
+  (void)user_data;
+  shutdown (((serve_connection*)key)->fd, SHUT_RD);
+}
+
+/*----------------------------------------------------------------------------.
+ | HIGH_SERVE                                                                 |
+ | This function accepts connections and waits for requests on them. Each     |
+ | request is handed over to a worker pool.                                   |
+ '----------------------------------------------------------------------------*/
+int
+high_serve (const char* path, dt_configuration* settings)
+{
+  struct sockaddr_un address;
+  memset (&address, 0, sizeof (address));
+  address.sun_family = AF_UNIX;
+
+  if (strlen (path) >= sizeof (address.sun_path))
+    {
+      printf ("The socket path '%s' is too long.\n", path);
+      return 1;
+    }
+
+  strcpy (address.sun_path, path);
+
+  /* Remove a socket that was left behind by a previous run, but never
+   * remove anything else. */
+  struct stat info;
+  if (lstat (path, &info) == 0 && S_ISSOCK (info.st_mode))
+    unlink (path);
+
+  int server = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0)
+    {
+      perror ("socket");
+      return 1;
+    }
+
+  /* Clients can read and write any file that the server can, so only the
+   * user that runs the server may connect. Until listen() is called, no
+   * client can connect with the permissions of the umask. */
+  if (bind (server, (struct sockaddr*)&address, sizeof (address)) != 0
+      || chmod (path, S_IRUSR | S_IWUSR) != 0
+      || listen (server, SOMAXCONN) != 0)
+    {
+      printf ("Couldn't listen on '%s': %s\n", path, strerror (errno));
+      close (server);
+      return 1;
+    }
+
+  if (pipe (wake_pipe) != 0)
+    {
+      perror ("pipe");
+      close (server);
+      unlink (path);
+      return 1;
+    }
+
+  fcntl (wake_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl (wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+  /* Stop gracefully on Ctrl+C or when the service is stopped. The handler is
+   * installed without SA_RESTART so poll() returns when a signal arrives.
+   * A client that disconnects early must not terminate the server. */
+  struct sigaction action;
+  memset (&action, 0, sizeof (action));
+  action.sa_handler = serve_stop;
+  sigemptyset (&action.sa_mask);
+  sigaction (SIGINT, &action, NULL);
+  sigaction (SIGTERM, &action, NULL);
+
+  action.sa_handler = SIG_IGN;
+  sigaction (SIGPIPE, &action, NULL);
+
+  long workers = sysconf (_SC_NPROCESSORS_ONLN);
+  if (workers < 1) workers = 1;
+  if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+
+  /* Make sure the defaults that the converters rely on are set once, instead
+   * of in every request. */
+  if (settings->page.measurement == NULL)
+    dt_configuration_parse_dimensions (NULL, settings);
+
+  serve_settings = settings;
+  busy = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  GThreadPool* pool;
+  pool = g_thread_pool_new (serve_handle_request, NULL, workers, TRUE, NULL);
+
+  /* The connections that wait for their next request. */
+  GPtrArray* idle = g_ptr_array_new ();
+
+  printf ("Listening on '%s'.\n", path);
+
+  while (!stop_serving)
+    {
+      /* Wait for new connections, for requests on the idle connections and
+       * for connections that the workers hand back. The timeout makes sure
+       * that idle connections are closed in time. */
+      guint count = idle->len + 2;
+      struct pollfd* fds = g_new0 (struct pollfd, count);
+      fds[0].fd = server;
+      fds[0].events = POLLIN;
+      fds[1].fd = wake_pipe[0];
+      fds[1].events = POLLIN;
+
+      guint index = 0;
+      for (; index < idle->len; index++)
+	{
+	  fds[index + 2].fd = ((serve_connection*)g_ptr_array_index (idle, index))->fd;
+	  fds[index + 2].events = POLLIN;
+	}
+
+      if (poll (fds, count, 1000) < 0)
+	{
+	  g_free (fds);
+	  if (errno == EINTR) continue;
+	  perror ("poll");
+	  break;
+	}
+
+      /* Going backwards, removing a connection only moves connections that
+       * have already been looked at. */
+      gint64 now = g_get_monotonic_time ();
+      index = idle->len;
+      while (index-- > 0)
+	{
+	  serve_connection* connection = g_ptr_array_index (idle, index);
+	  if (fds[index + 2].revents != 0)
+	    {
+	      g_ptr_array_remove_index_fast (idle, index);
+	      serve_dispatch (pool, connection);
+	    }
+	  else if (now - connection->last_active > IDLE_TIMEOUT * G_USEC_PER_SEC)
+	    {
+	      g_ptr_array_remove_index_fast (idle, index);
+	      serve_close (connection);
+	    }
+	}
+
+      if (fds[1].revents != 0)
+	serve_take_returned (pool, idle);
+
+      int accepted = (fds[0].revents != 0);
+      g_free (fds);
+
+      if (accepted)
+	{
+	  int client = accept (server, NULL, NULL);
+	  if (client >= 0)
+	    {
+	      serve_connection* connection = serve_new_connection (client);
+	      if (connection != NULL)
+		g_ptr_array_add (idle, connection);
+	    }
+	  else if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN)
+	    {
+	      perror ("accept");
+	      break;
+	    }
+	}
+    }
+
+  close (server);
+  unlink (path);
+
+  /* Let the workers finish the requests they're working on, but don't wait
+   * for clients that are in the middle of sending one. */
+  g_mutex_lock (&connections_lock);
+  g_hash_table_foreach (busy, serve_shutdown_connection, NULL);
+  g_mutex_unlock (&connections_lock);
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  guint index = 0;
+  for (; index < idle->len; index++)
+    serve_close (g_ptr_array_index (idle, index));
+  g_ptr_array_free (idle, TRUE);
+
+  GSList* item = returned;
+  for (; item != NULL; item = item->next)
+    serve_close (item->data);
+  g_slist_free (returned), returned = NULL;
+
+  close (wake_pipe[0]);
+  close (wake_pipe[1]);
+  wake_pipe[0] = wake_pipe[1] = -1;
+
+  g_hash_table_destroy (busy), busy = NULL;
+
+  return 0;
+}
+
+#else
+
+/*----------------------------------------------------------------------------.
+ | HIGH_SERVE                                                                 |
+ | The server uses UNIX domain sockets, which are not available on Windows.   |
+ '----------------------------------------------------------------------------*/
+int
+high_serve (const char* path, dt_configuration* settings)
+{
+  (void)path;
+  (void)settings;
+  puts ("Serving conversions is not supported on Windows.");
+  return 1;
+}
+
+#endif
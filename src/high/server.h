@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   high/server.h
+ * @brief  Convert WPI data on request over a local socket.
+ * @author Roel Janssen
+ */
+
+#ifndef HIGH_SERVER_H
+#define HIGH_SERVER_H
+
+#include "../datatypes/configuration.h"
+
+/**
+ * This function listens on a UNIX domain socket and converts WPI data for
+ * the programs that connect to it. This avoids starting the program for
+ * every conversion. Requests are handled by a pool of worker threads, so
+ * requests on different connections run in parallel, while the requests on
+ * one connection are answered in order.
+ *
+ * Only the user that runs the server can connect, because clients can read
+ * and write any file that the server can. Connections without a request for
+ * a minute are closed.
+ *
+ * A client sends one or more requests over a connection. A request consists
+ * of "key=value" lines, followed by an empty line:
+ *
+ *   - input=PATH      The WPI file to convert.
+ *   - length=N        Instead of 'input', N bytes of WPI data follow the
+ *                     empty line.
+ *   - format=FORMAT   One of svg, png, pdf, json or csv. Defaults to the
+ *                     extension of 'output', or to svg.
+ *   - output=PATH     Write the result to PATH instead of sending it back.
+ *
+ * Other keys override the settings for this request only (see
+ * dt_configuration_set_option()).
+ *
+ * The server replies with "status=ok" and "length=N" lines, an empty line
+ * and N bytes of output, or with "status=error" and "message=TEXT" lines and
+ * an empty line.
+ *
+ * The function returns when the program receives SIGINT or SIGTERM.
+ *
+ * @param path      The location of the socket to create.
+ * @param settings  The default settings for every request.
+ * @return 0 when the server stopped normally, 1 when something went wrong.
+ */
+int high_serve (const char* path, dt_configuration* settings);
+
+#endif//HIGH_SERVER_H
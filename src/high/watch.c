@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "watch.h"
+#include "conversion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#ifdef __linux__
+
+#include <sys/inotify.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+
+/* Directories are watched for files that are completely written or moved
+ * into place, and for new subdirectories. */
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+/* The conversion is mostly CPU-bound, but a drop directory rarely receives
+ * more than a handful of files at once. */
+#define MAX_WORKERS 4
+
+/* The states a file can be in while it's being handled. */
+#define JOB_QUEUED  1
+#define JOB_RUNNING 2
+#define JOB_RERUN   3
+
+static volatile sig_atomic_t stop_watching = 0;
+static dt_configuration* watch_settings = NULL;
+
+/* Maps watch descriptors to the path of the watched directory. */
+static GHashTable* watches = NULL;
+
+/* Maps the path of a file to its JOB_* state, so a file that is written
+ * twice in a row isn't converted by two workers at the same time. */
+static GHashTable* pending = NULL;
+static GMutex pending_lock;
+
+/*----------------------------------------------------------------------------.
+ | WATCH_STOP                                                                 |
+ | This signal handler makes the main loop stop.                              |
+ '----------------------------------------------------------------------------*/
+static void
+watch_stop (int signal_number)
+{
+  (void)signal_number;
+  stop_watching = 1;
+}
+
+/*----------------------------------------------------------------------------.
+ | WATCH_CONVERT                                                              |
+ | This function runs in a worker thread and converts one file. When the file |
+ | changed again while it was being converted, it is converted once more.     |
+ '----------------------------------------------------------------------------*/
+static void
+watch_convert (gpointer data, gpointer user_data)
+{
+  char* path = (char*)data;
+  int state;
+  (void)user_data;
+
+  dt_stats_name_thread (watch_settings->stats, "watch");
+
+  do
+    {
+      g_mutex_lock (&pending_lock);
+      g_hash_table_insert (pending, g_strdup (path), GINT_TO_POINTER (JOB_RUNNING));
+      g_mutex_unlock (&pending_lock);
+
+      /* Each worker gets its own copy of the settings, because parsing and
+       * converting a file changes some of them. */
+      dt_configuration settings;
+      dt_configuration_copy (watch_settings, &settings);
+      if (high_convert_file (path, &settings) != 0)
+	printf ("Couldn't convert '%s'.\n", path);
+      dt_configuration_cleanup (&settings);
+
+      g_mutex_lock (&pending_lock);
+      state = GPOINTER_TO_INT (g_hash_table_lookup (pending, path));
+      if (state != JOB_RERUN)
+	g_hash_table_remove (pending, path);
+      g_mutex_unlock (&pending_lock);
+    }
+  while (state == JOB_RERUN);
+
+  g_free (path);
+}
+
+/*----------------------------------------------------------------------------.
+ | WATCH_ENQUEUE                                                              |
+ | This function hands a file over to the worker pool. It takes ownership of  |
+ | 'path'.                                                                    |
+ '----------------------------------------------------------------------------*/
+static void
+watch_enqueue (GThreadPool* pool, char* path)
+{
+  g_mutex_lock (&pending_lock);
+  int state = GPOINTER_TO_INT (g_hash_table_lookup (pending, path));
+
+  if (state == JOB_RUNNING)
+    g_hash_table_insert (pending, g_strdup (path), GINT_TO_POINTER (JOB_RERUN));
+  else if (state == 0)
+    g_hash_table_insert (pending, g_strdup (path), GINT_TO_POINTER (JOB_QUEUED));
+  g_mutex_unlock (&pending_lock);
+
+  if (state == 0)
+    g_thread_pool_push (pool, path, NULL);
+  else
+    g_free (path);
+}
+
+/*----------------------------------------------------------------------------.
+ | WATCH_ADD_DIRECTORY                                                        |
+ | This function watches a directory and its subdirectories. WPI files that   |
+ | are already in there are handed over to the worker pool.                   |
+ '----------------------------------------------------------------------------*/
+static void
+watch_add_directory (int inotify_fd, GThreadPool* pool, const char* path)
+{
+  int wd = inotify_add_watch (inotify_fd, path, WATCH_EVENTS | IN_ONLYDIR);
+  if (wd < 0)
+    {
+      printf ("Couldn't watch '%s': %s\n", path, strerror (errno));
+      return;
+    }
+
+  g_hash_table_insert (watches, GINT_TO_POINTER (wd), g_strdup (path));
+
+  DIR* directory = opendir (path);
+  if (directory == NULL) return;
+
+  struct dirent* entry;
+  while ((entry = readdir (directory)) != NULL)
+    {
+      if (entry->d_name[0] == '.') continue;
+
+      char* name = g_strconcat (path, "/", entry->d_name, NULL);
+      struct stat info;
+
+      if (lstat (name, &info) == 0 && S_ISDIR (info.st_mode))
+	watch_add_directory (inotify_fd, pool, name);
+      else if (high_has_wpi_extension (entry->d_name))
+	{
+	  watch_enqueue (pool, name);
+	  continue;
+	}
+
+      g_free (name);
+    }
+
+  closedir (directory);
+}
+
+/*----------------------------------------------------------------------------.
+ | HIGH_WATCH_DIRECTORY                                                       |
+ | This function converts WPI files as soon as they land in a directory.      |
+ '----------------------------------------------------------------------------*/
+int
+high_watch_directory (const char* path, dt_configuration* settings)
+{
+  int inotify_fd = inotify_init1 (IN_CLOEXEC);
+  if (inotify_fd < 0)
+    {
+      perror ("inotify_init1");
+      return 1;
+    }
+
+  /* Stop gracefully on Ctrl+C or when the service is stopped. The handler is
+   * installed without SA_RESTART so read() returns when a signal arrives. */
+  struct sigaction action;
+  memset (&action, 0, sizeof (action));
+  action.sa_handler = watch_stop;
+  sigemptyset (&action.sa_mask);
+  sigaction (SIGINT, &action, NULL);
+  sigaction (SIGTERM, &action, NULL);
+
+  long workers = sysconf (_SC_NPROCESSORS_ONLN);
+  if (workers < 1) workers = 1;
+  if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+
+  watch_settings = settings;
+  watches = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+  pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  GThreadPool* pool = g_thread_pool_new (watch_convert, NULL, workers, TRUE, NULL);
+
+  /* Add the watches before looking at the files that are already there, so
+   * that no file can slip through in between. */
+  watch_add_directory (inotify_fd, pool, path);
+  if (g_hash_table_size (watches) == 0)
+    {
+      g_thread_pool_free (pool, FALSE, TRUE);
+      g_hash_table_destroy (watches), watches = NULL;
+      g_hash_table_destroy (pending), pending = NULL;
+      close (inotify_fd);
+      return 1;
+    }
+
+  printf ("Watching '%s' for WPI files.\n", path);
+
+  char buffer[4096]
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+
+  while (!stop_watching)
+    {
+      ssize_t length = read (inotify_fd, buffer, sizeof (buffer));
+      if (length < 0)
+	{
+	  if (errno == EINTR) continue;
+	  perror ("read");
+	  break;
+	}
+
+      char* position = buffer;
+      while (position < buffer + length)
+	{
+	  const struct inotify_event* event = (const struct inotify_event*)position;
+	  position += sizeof (struct inotify_event) + event->len;
+
+	  if (event->mask & IN_IGNORED)
+	    {
+	      g_hash_table_remove (watches, GINT_TO_POINTER (event->wd));
+	      continue;
+	    }
+
+	  if (event->len == 0 || event->name[0] == '.') continue;
+
+	  const char* directory = g_hash_table_lookup (watches, GINT_TO_POINTER (event->wd));
+	  if (directory == NULL) continue;
+
+	  char* name = g_strconcat (directory, "/", event->name, NULL);
+
+	  if (event->mask & IN_ISDIR)
+	    {
+	      if (event->mask & (IN_CREATE | IN_MOVED_TO))
+		watch_add_directory (inotify_fd, pool, name);
+	      g_free (name);
+	    }
+	  else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+		   && high_has_wpi_extension (event->name))
+	    watch_enqueue (pool, name);
+	  else
+	    g_free (name);
+	}
+    }
+
+  /* Let the workers finish the files they already started on. */
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  g_hash_table_destroy (watches), watches = NULL;
+  g_hash_table_destroy (pending), pending = NULL;
+  close (inotify_fd);
+
+  return 0;
+}
+
+#else
+
+/*----------------------------------------------------------------------------.
+ | HIGH_WATCH_DIRECTORY                                                       |
+ | Watching a directory relies on inotify, which is specific to Linux.        |
+ '----------------------------------------------------------------------------*/
+int
+high_watch_directory (const char* path, dt_configuration* settings)
+{
+  (void)path;
+  (void)settings;
+  puts ("Watching a directory is only supported on GNU/Linux.");
+  return 1;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   high/watch.h
+ * @brief  Convert WPI files as soon as they appear in a directory.
+ * @author Roel Janssen
+ */
+
+#ifndef HIGH_WATCH_H
+#define HIGH_WATCH_H
+
+#include "../datatypes/configuration.h"
+
+/**
+ * This function converts all WPI files in a directory (like
+ * high_convert_directory()) and then keeps watching the directory tree.
+ * Every WPI file that is written or moved into it is converted by a small
+ * pool of worker threads. The function returns when the program receives
+ * SIGINT or SIGTERM.
+ *
+ * @param path      The directory to watch.
+ * @param settings  Pass along the user's custom settings.
+ * @return 0 when the directory was watched, 1 when something went wrong.
+ */
+int high_watch_directory (const char* path, dt_configuration* settings);
+
+#endif//HIGH_WATCH_H
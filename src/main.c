@@ -43,6 +43,9 @@
 #include "datatypes/configuration.h"
 #include "gui/mainwindow.h"
 #include "high/conversion.h"
+#include "high/watch.h"
+#include "high/server.h"
+#include "high/batch.h"
 #include "converters/svg.h"
 #include "optimizers/point-reduction.h"
 #include "usb/online-mode.h"
@@ -87,13 +90,34 @@ show_help ()
 	"  --background,        -b  Specify the background color for the document.\n"
 	"  --colors,            -c  Specify a list of colors (comma separated).\n"
 	"  --pressure-factor,   -p  Specify a factor for handling pressure data.\n"
-	"  --convert-directory, -d  Convert all WPI files in a directory.\n"
+	"  --convert-directory, -d  Convert all WPI files in a directory (recursively).\n"
+	"  --formats,           -x  Formats to write with --convert-directory\n"
+	"                           (comma separated: svg,png,pdf,json,csv).\n"
 	"  --file,              -f  Specify the WPI file to convert.\n"
+	"  --batch,             -n  Run the conversions listed in a file (or '-' for stdin).\n"
+	"  --region,            -r  Only export X,Y,WIDTH,HEIGHT of the page to PNG.\n"
+	"  --dpi,               -D  Draw PNG images at this many dots per inch.\n"
 	"  --to,                -t  Specify the file to write to.\n"
 	"  --direct-output,     -i  Tell the program to output SVG data to stdout.\n"
-	"  --merge,             -m  Merge two WPI files into one.\n"
+	"  --merge,             -m  Merge WPI files into the file given to --to.\n"
+	"                           Repeat it to merge more than two files.\n"
+	"  --book,              -B  Draw the WPI files in a directory, or the layers of\n"
+	"                           a WPI file, as pages of the PDF file given to --to.\n"
+	"                           Repeat it to add more pages.\n"
+	"  --watch,             -w  Convert WPI files as soon as they appear in a directory.\n"
+	"  --serve,             -s  Convert WPI data on request over a UNIX domain socket.\n"
 	"  --gui,               -g  Start the graphical user interface.\n"
 	"  --online-mode        -j  Use the online mode.\n"
+	"  --record,            -k  Record the pen data in online mode to a file.\n"
+	"  --capture,           -u  Store the raw reports of online mode in a file.\n"
+	"  --online-statistics, -l  Write online mode statistics as JSON to a file\n"
+	"                           (or '-' for stdout). SIGUSR1 writes them at once.\n"
+	"  --replay,            -y  Replay a file made with --capture without a device.\n"
+	"  --replay-speed,      -z  Replay this many times faster (0 is as fast as possible).\n"
+	"  --stats[=json],      -q  Show the time and memory each step of a conversion\n"
+	"                           took on stderr, for people to read or as JSON.\n"
+	"  --trace,             -T  Write when each step ran to a file, for Perfetto\n"
+	"                           or chrome://tracing.\n"
 	"  --version,           -v  Show versioning information.\n"
 	"  --help,              -h  Show this message.\n\n");
 }
@@ -106,6 +130,7 @@ show_help ()
 static void cleanup_configuration ()
 {
   dt_configuration_cleanup (&settings);
+  dt_stats_free (settings.stats), settings.stats = NULL;
 }
 
 
@@ -121,6 +146,10 @@ main (int argc, char** argv)
   unsigned char launch_gui = 1;
   char* filename = NULL;
 
+  /* The exit status. It becomes 1 when one of the tasks fails, so that
+   * scripts can tell. */
+  int status = 0;
+
   /* Set sensible default values for some settings. */
   settings.pressure_factor = 1.0;
 
@@ -136,7 +165,13 @@ main (int argc, char** argv)
       int arg = 0;
       int index = 0;
       GSList* coordinates = NULL;
-      char* merge_val = NULL;
+      GSList* merge_files = NULL;
+      GSList* book_inputs = NULL;
+      dt_rectangle* region = NULL;
+      dt_rectangle region_data;
+      usb_online_mode_options online_options = { NULL, NULL, NULL };
+      double replay_speed = 1.0;
+      int stats_format = DT_STATS_TEXT;
 
       /*----------------------------------------------------------------------.
        | OPTIONS                                                              |
@@ -147,26 +182,40 @@ main (int argc, char** argv)
 	{
 	  { "dimensions",        required_argument, 0, 'a' },
 	  { "background",        required_argument, 0, 'b' },
+	  { "batch",             required_argument, 0, 'n' },
+	  { "book",              required_argument, 0, 'B' },
 	  { "colors",            required_argument, 0, 'c' },
 	  { "convert-directory", required_argument, 0, 'd' },
 	  { "config",            required_argument, 0, 'e' },
 	  { "file",              required_argument, 0, 'f' },
+	  { "formats",           required_argument, 0, 'x' },
 	  { "gui",               optional_argument, 0, 'g' },
 	  { "help",              no_argument,       0, 'h' },
 	  { "direct-output",     no_argument,       0, 'i' },
+	  { "dpi",               required_argument, 0, 'D' },
 	  { "online-mode",       no_argument,       0, 'j' },
+	  { "record",            required_argument, 0, 'k' },
+	  { "capture",           required_argument, 0, 'u' },
+	  { "online-statistics", required_argument, 0, 'l' },
+	  { "replay",            required_argument, 0, 'y' },
+	  { "replay-speed",      required_argument, 0, 'z' },
 	  { "merge",             required_argument, 0, 'm' },
 	  { "orientation",       required_argument, 0, 'o' },
 	  { "pressure-factor",   required_argument, 0, 'p' },
+	  { "region",            required_argument, 0, 'r' },
+	  { "serve",             required_argument, 0, 's' },
+	  { "stats",             optional_argument, 0, 'q' },
 	  { "to",                required_argument, 0, 't' },
+	  { "trace",             required_argument, 0, 'T' },
 	  { "version",           no_argument,       0, 'v' },
+	  { "watch",             required_argument, 0, 'w' },
 	  { 0,                   0,                 0, 0   }
 	};
 
       while ( arg != -1 )
 	{
 	  /* Make sure to list all short options in the string below. */
-	  arg = getopt_long (argc, argv, "a:b:c:d:s:f:m:p:t:g:jvh", options, &index);
+	  arg = getopt_long (argc, argv, "a:b:B:c:d:D:s:f:k:l:m:n:p:q::r:t:T:g:u:w:x:y:z:jvh", options, &index);
 
 	  switch (arg)
 	    {
@@ -218,8 +267,8 @@ main (int argc, char** argv)
 	       '--------------------------------------------------------------*/
 	    case 'd':
 	      {
-		if (optarg)
-		  high_convert_directory (optarg, &settings);
+		if (optarg && high_convert_directory (optarg, &settings) != 0)
+		  status = 1;
 		launch_gui = 0;
 	      }
 	      break;
@@ -246,6 +295,151 @@ main (int argc, char** argv)
 	      }
 	      break;
 
+	      /*--------------------------------------------------------------.
+	       | OPTION: RECORD                                               |
+	       | Use before ONLINE_MODE to keep the pen data in a file.       |
+	       '--------------------------------------------------------------*/
+	    case 'k':
+	      {
+		if (optarg)
+		  online_options.record_to = optarg;
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: CAPTURE                                              |
+	       | Use before ONLINE_MODE to store the raw reports.             |
+	       '--------------------------------------------------------------*/
+	    case 'u':
+	      {
+		if (optarg)
+		  online_options.capture_to = optarg;
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: ONLINE-STATISTICS                                    |
+	       | Use before ONLINE_MODE or REPLAY to see how it performs.     |
+	       '--------------------------------------------------------------*/
+	    case 'l':
+	      {
+		if (optarg)
+		  online_options.statistics_to = optarg;
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: STATS                                                |
+	       | Use before the conversions to measure.                       |
+	       '--------------------------------------------------------------*/
+	    case 'q':
+	      {
+		if (optarg && !strcmp (optarg, "json"))
+		  stats_format = DT_STATS_JSON;
+		else if (optarg && strcmp (optarg, "text"))
+		  printf ("Unknown statistics format '%s'.\n", optarg);
+
+		if (settings.stats == NULL)
+		  settings.stats = dt_stats_new ();
+		if (settings.stats != NULL)
+		  settings.stats->report = 1;
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: TRACE                                                |
+	       | Use before the conversions to trace.                         |
+	       '--------------------------------------------------------------*/
+	    case 'T':
+	      {
+		if (settings.stats == NULL)
+		  settings.stats = dt_stats_new ();
+		if (optarg && settings.stats != NULL)
+		  dt_stats_trace_to (settings.stats, optarg);
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: REPLAY-SPEED                                         |
+	       | Use before REPLAY to replay faster or slower.                |
+	       '--------------------------------------------------------------*/
+	    case 'z':
+	      {
+		if (optarg)
+		  replay_speed = atof (optarg);
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: REPLAY                                               |
+	       | Feed captured reports through the online mode.               |
+	       '--------------------------------------------------------------*/
+	    case 'y':
+	      {
+		if (optarg
+		    && usb_online_mode_replay (optarg, replay_speed,
+					       &online_options, &settings) != 0)
+		  status = 1;
+		launch_gui = 0;
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: WATCH                                                |
+	       | Convert WPI files as soon as they land in a directory.       |
+	       '--------------------------------------------------------------*/
+	    case 'w':
+	      {
+		if (optarg && high_watch_directory (optarg, &settings) != 0)
+		  status = 1;
+		launch_gui = 0;
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: BATCH                                                |
+	       | Run many conversions listed in a manifest.                   |
+	       '--------------------------------------------------------------*/
+	    case 'n':
+	      {
+		if (optarg && high_run_batch (optarg, &settings) != 0)
+		  status = 1;
+		launch_gui = 0;
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: SERVE                                                |
+	       | Convert WPI data for other programs over a local socket.     |
+	       '--------------------------------------------------------------*/
+	    case 's':
+	      {
+		if (optarg && high_serve (optarg, &settings) != 0)
+		  status = 1;
+		launch_gui = 0;
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: FORMATS                                              |
+	       | Choose the formats to write when converting a directory.     |
+	       '--------------------------------------------------------------*/
+	    case 'x':
+	      {
+		if (optarg)
+		  dt_configuration_parse_formats (optarg, &settings);
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: DPI                                                  |
+	       | Draw PNG images at this resolution.                          |
+	       '--------------------------------------------------------------*/
+	    case 'D':
+	      if (optarg && dt_configuration_set_option ("dpi", optarg, &settings) != 0)
+		puts ("Please specify the resolution as a positive number.");
+	      break;
+
 	      /*--------------------------------------------------------------.
 	       | OPTION: MERGE                                                |
 	       | Use with TO to merge two files.                              |
@@ -253,7 +447,19 @@ main (int argc, char** argv)
 	    case 'm':
 	      {
 		if (optarg)
-		  merge_val = optarg;
+		  merge_files = g_slist_append (merge_files, optarg);
+		launch_gui = 0;
+	      }
+	      break;
+
+	      /*--------------------------------------------------------------.
+	       | OPTION: BOOK                                                 |
+	       | Use with TO to draw WPI files as the pages of a PDF file.    |
+	       '--------------------------------------------------------------*/
+	    case 'B':
+	      {
+		if (optarg)
+		  book_inputs = g_slist_append (book_inputs, optarg);
 		launch_gui = 0;
 	      }
 	      break;
@@ -286,6 +492,27 @@ main (int argc, char** argv)
 	      }
 	      break;
 
+	      /*--------------------------------------------------------------.
+	       | OPTION: REGION                                               |
+	       | Only export a part of the page to PNG.                       |
+	       '--------------------------------------------------------------*/
+	    case 'r':
+	      {
+		double x, y, width, height;
+		if (optarg && sscanf (optarg, "%lf,%lf,%lf,%lf", &x, &y, &width, &height) == 4
+		    && width > 0 && height > 0)
+		  {
+		    region_data.x1 = x;
+		    region_data.y1 = y;
+		    region_data.x2 = x + width;
+		    region_data.y2 = y + height;
+		    region = &region_data;
+		  }
+		else
+		  puts ("Please specify the region as X,Y,WIDTH,HEIGHT.");
+	      }
+	      break;
+
 	      /*--------------------------------------------------------------.
 	       | OPTION: TO                                                   |
 	       | Use with FILE to convert a file.                             |
@@ -294,12 +521,63 @@ main (int argc, char** argv)
 	      {
 		if (optarg)
 		  {
-		    if (merge_val)
-		      high_merge_wpi_files (merge_val, optarg);
+		    if (merge_files)
+		      {
+			/* With a single --merge, the file given to --to is
+			 * both the second input and the output. */
+			if (g_slist_length (merge_files) == 1)
+			  merge_files = g_slist_append (merge_files, optarg);
+
+			int num_inputs = g_slist_length (merge_files);
+			const char** inputs = malloc (num_inputs * sizeof (char*));
+			if (inputs != NULL)
+			  {
+			    int position = 0;
+			    GSList* item = merge_files;
+			    for (; item != NULL; item = item->next)
+			      inputs[position++] = (const char*)item->data;
+
+			    if (high_merge_wpi_files (inputs, num_inputs, optarg) != 0)
+			      status = 1;
+			    free (inputs);
+			  }
+			else
+			  status = 1;
+
+			g_slist_free (merge_files), merge_files = NULL;
+		      }
+		    else if (book_inputs)
+		      {
+			int num_inputs = g_slist_length (book_inputs);
+			const char** inputs = malloc (num_inputs * sizeof (char*));
+			if (inputs != NULL)
+			  {
+			    int position = 0;
+			    GSList* item = book_inputs;
+			    for (; item != NULL; item = item->next)
+			      inputs[position++] = (const char*)item->data;
+
+			    if (high_export_pages_to_pdf (inputs, num_inputs, optarg,
+							  &settings) != 0)
+			      status = 1;
+			    free (inputs);
+			  }
+			else
+			  status = 1;
+
+			g_slist_free (book_inputs), book_inputs = NULL;
+		      }
 		    else
 		      {
+			dt_stats_mark mark;
+			dt_stats_start (settings.stats, &mark);
 			coordinates = p_wpi_parse (filename, &settings.process_until);
-			high_export_to_file (coordinates, NULL, optarg, &settings);
+			dt_stats_stop_data (settings.stats, "parse", &mark, coordinates);
+
+			if (region != NULL)
+			  high_export_region_to_file (coordinates, optarg, &settings, region);
+			else
+			  high_export_to_file (coordinates, NULL, optarg, &settings);
 		      }
 		  }
 		launch_gui = 0;
@@ -314,8 +592,14 @@ main (int argc, char** argv)
 	      {
 		if (filename)
 		  {
+		    dt_stats_mark mark;
+		    dt_stats_start (settings.stats, &mark);
 		    coordinates = p_wpi_parse (filename, &settings.process_until);
+		    dt_stats_stop_data (settings.stats, "parse", &mark, coordinates);
+
+		    dt_stats_start (settings.stats, &mark);
 		    char* svg_data = co_svg_create (coordinates, NULL, &settings);
+		    dt_stats_stop_data (settings.stats, "svg", &mark, coordinates);
 		    puts (svg_data);
 		    free (svg_data);
 		  }
@@ -338,7 +622,7 @@ main (int argc, char** argv)
 	       | Try to get the device to behave like a mouse.                |
 	       '--------------------------------------------------------------*/
 	    case 'j':
-	      usb_online_mode_init ();
+	      usb_online_mode_init (&online_options, &settings);
 	      usb_online_mode_exit ();
 	      launch_gui = 0;
 	      break;
@@ -368,6 +652,12 @@ main (int argc, char** argv)
 	}
 
       p_wpi_cleanup (coordinates);
+      g_slist_free (merge_files);
+      g_slist_free (book_inputs);
+
+      /* The graphical user interface shows the statistics by itself. */
+      if (settings.stats != NULL && settings.stats->report && launch_gui == 0)
+	dt_stats_write (settings.stats, stats_format, stderr);
     }
   else
     launch_gui = 1;
@@ -391,5 +681,5 @@ main (int argc, char** argv)
       gui_mainwindow_init (argc, argv, filename);
     }
 
-  return 0;
+  return status;
 }
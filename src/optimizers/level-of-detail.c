@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "level-of-detail.h"
+
+#include <string.h>
+
+/* The distance that is left out by the first reduced level. A unit is about
+ * a tenth of a millimeter on paper. */
+#define BASE_TOLERANCE 0.25
+
+/* Every level leaves out twice the distance of the level before it, so
+ * eight levels go up to about three centimeters on paper. */
+#define MAX_LEVELS 8
+
+/*----------------------------------------------------------------------------.
+ | OPT_LEVEL_OF_DETAIL_REDUCE                                                 |
+ | This function keeps the points of 'from' that are further away than       |
+ | 'tolerance' from the point that was kept before. Points that are left out  |
+ | hand their pressure over to the next point that is kept, so the stroke     |
+ | doesn't get thinner when zoomed out.                                       |
+ '----------------------------------------------------------------------------*/
+static unsigned int
+opt_level_of_detail_reduce (const dt_stroke_level* from, float tolerance,
+			    dt_point* to)
+{
+  float squared_tolerance = tolerance * tolerance;
+  float pressure = 0;
+  unsigned int kept = 1;
+  unsigned int index = 1;
+
+  to[0] = from->points[0];
+
+  for (; index < from->num_points; index++)
+    {
+      const dt_point* point = &from->points[index];
+      const dt_point* previous = &to[kept - 1];
+      float delta_x = point->x - previous->x;
+      float delta_y = point->y - previous->y;
+
+      if (point->pressure > pressure) pressure = point->pressure;
+
+      if (index == from->num_points - 1
+	  || delta_x * delta_x + delta_y * delta_y > squared_tolerance)
+	{
+	  to[kept] = *point;
+	  to[kept].pressure = pressure;
+	  pressure = 0;
+	  kept++;
+	}
+    }
+
+  return kept;
+}
+
+/*----------------------------------------------------------------------------.
+ | OPT_LEVEL_OF_DETAIL_BUILD                                                  |
+ '----------------------------------------------------------------------------*/
+int
+opt_level_of_detail_build (dt_document* document)
+{
+  if (document == NULL) return 0;
+
+  dt_stroke_level levels[MAX_LEVELS];
+  unsigned int index = 0;
+  int result = 0;
+
+  for (; index < document->num_strokes; index++)
+    {
+      dt_document_stroke* stroke = &document->strokes[index];
+      if (stroke->levels != NULL) continue;
+
+      levels[0].tolerance = 0;
+      levels[0].num_points = stroke->num_points;
+      levels[0].points = stroke->points;
+
+      unsigned int num_levels = 1;
+      float tolerance = BASE_TOLERANCE;
+
+      /* Stop when a level doesn't get much smaller than the one before it,
+       * or when only the endpoints are left. */
+      while (num_levels < MAX_LEVELS && levels[num_levels - 1].num_points > 2)
+	{
+	  dt_stroke_level* previous = &levels[num_levels - 1];
+	  dt_point* points = g_try_new (dt_point, previous->num_points);
+	  if (points == NULL)
+	    {
+	      result = 1;
+	      break;
+	    }
+
+	  unsigned int kept = opt_level_of_detail_reduce (previous, tolerance, points);
+	  if (kept > previous->num_points - previous->num_points / 4)
+	    {
+	      /* Try again with a larger distance, without adding a level. */
+	      g_free (points);
+	      tolerance *= 2;
+	      if (tolerance > BASE_TOLERANCE * (1 << MAX_LEVELS)) break;
+	      continue;
+	    }
+
+	  levels[num_levels].tolerance = tolerance;
+	  levels[num_levels].num_points = kept;
+	  levels[num_levels].points = g_renew (dt_point, points, kept);
+	  num_levels++;
+	  tolerance *= 2;
+	}
+
+      stroke->levels = g_new (dt_stroke_level, num_levels);
+      memcpy (stroke->levels, levels, num_levels * sizeof (dt_stroke_level));
+      stroke->num_levels = num_levels;
+    }
+
+  return result;
+}
+
+/*----------------------------------------------------------------------------.
+ | OPT_LEVEL_OF_DETAIL_SELECT                                                 |
+ '----------------------------------------------------------------------------*/
+const dt_stroke_level*
+opt_level_of_detail_select (const dt_document_stroke* stroke, float tolerance)
+{
+  if (stroke->num_levels == 0) return NULL;
+
+  unsigned int level = stroke->num_levels - 1;
+  while (level > 0 && stroke->levels[level].tolerance > tolerance)
+    level--;
+
+  return &stroke->levels[level];
+}
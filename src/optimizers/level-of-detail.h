@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   optimizers/level-of-detail.h
+ * @brief  Reduced versions of strokes to draw when zoomed out.
+ * @author Roel Janssen
+ */
+
+#ifndef OPTIMIZERS_LEVEL_OF_DETAIL_H
+#define OPTIMIZERS_LEVEL_OF_DETAIL_H
+
+#include "../datatypes/document.h"
+
+/**
+ * This function adds levels of detail to each stroke of a document. The
+ * first level is the stroke itself. Each following level is made from the
+ * one before it, and leaves out the points that are closer than twice the
+ * distance of that level to the last point that was kept. The first and
+ * last point of a stroke are always kept.
+ *
+ * @param document The document to add levels of detail to.
+ * @return 0 when all levels were added, 1 when memory ran out. In that case
+ *         some strokes have fewer levels, but the document can still be used.
+ */
+int opt_level_of_detail_build (dt_document* document);
+
+/**
+ * This function returns the level of a stroke with the fewest points in
+ * which no point is left out that is further away than 'tolerance' from the
+ * points that were kept.
+ *
+ * @param stroke    The stroke to find a level of.
+ * @param tolerance The largest distance that may be left out, in the units of
+ *                  the points (see dt_point).
+ * @return The level to draw, or NULL when the levels of the stroke haven't
+ *         been built.
+ */
+const dt_stroke_level* opt_level_of_detail_select (const dt_document_stroke* stroke,
+						   float tolerance);
+
+#endif//OPTIMIZERS_LEVEL_OF_DETAIL_H
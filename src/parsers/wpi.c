@@ -21,12 +21,28 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include "../datatypes/element.h"
 #include "../datatypes/stroke.h"
 #include "../datatypes/clock.h"
 
-#define FILE_HEADER_LEN 322
+/* The largest number of bytes a block is read ahead. */
+#define BLOCK_PADDING 8
+
+/* The clock only wraps around when it goes from within this many seconds
+ * of its maximum to within this many seconds of 0. */
+#define WRAP_WINDOW 3600
+
+/* The state needed to turn 16-bit clock values into a continuous time. */
+typedef struct
+{
+  unsigned short last_counter;
+  unsigned char has_counter;
+  unsigned char new_layer;
+  double offset;
+  double time;
+} p_wpi_timeline;
 
 /*----------------------------------------------------------------------------.
  | BLOCK DESCRIPTORS                                                          |
@@ -43,72 +59,141 @@
  '----------------------------------------------------------------------------*/
 
 /*----------------------------------------------------------------------------.
- | WPI_PARSE:                                                                 |
- | This function reads the data and tries to get useful data out of it.       |
+ | WPI_HAS_VALID_HEADER:                                                      |
+ | This function compares the first bytes of a file to the known WPI header.  |
  '----------------------------------------------------------------------------*/
-GSList*
-p_wpi_parse (const char* filename, unsigned short* seconds)
+static int
+p_wpi_has_valid_header (const unsigned char* file_header)
 {
-  /* Create a GSList (singly-linked list) that will be the return value of 
-   * this function. */
-  GSList* list = NULL;
+  /* The first 322 bytes seem to be equal for every WPI file. I've encoded 
+   * these 322 bytes using the base64 encoding algorithm. The result of this
+   * encoding can be found in WPI_HEADER_BASE64. Comparing the first 322
+   * bytes from the loaded file can filter out malformed WPI files. */
+  gchar* base64_header = g_base64_encode (file_header, WPI_HEADER_LEN);
+  int is_valid = !strcmp (base64_header, WPI_HEADER_BASE64);
+  g_free (base64_header);
 
-  /* Open the file read-only in binary mode. The binary mode is important 
-   * because ftell() will only correctly return the length when in this mode */
-  FILE* file = fopen (filename, "rb");
+  return is_valid;
+}
 
-  if (file == NULL)
-    goto io_error;
+/*----------------------------------------------------------------------------.
+ | WPI_SPREAD_TIMES:                                                          |
+ | This function gives the 'count' coordinates starting at 'first' a time    |
+ | between 'from' and 'until'. The pen sends a coordinate every               |
+ | CLOCK_FREQUENCY seconds, unless more coordinates arrived between the two   |
+ | clock blocks than fit in that time.                                        |
+ '----------------------------------------------------------------------------*/
+static void
+p_wpi_spread_times (GSList* first, unsigned int count, double from, double until)
+{
+  double step = CLOCK_FREQUENCY;
+  if (until > from && count * CLOCK_FREQUENCY > until - from)
+    step = (until - from) / count;
 
-  /* Read the file header into memory. */
-  unsigned char *file_header = calloc (1, FILE_HEADER_LEN);
-  if (file_header == NULL)
-    goto io_error;
+  unsigned int index = 0;
+  for (; first != NULL && index < count; first = first->next)
+    {
+      dt_element* e = (dt_element*)first->data;
+      if (e->type != TYPE_COORDINATE) continue;
 
-  if (fread (file_header, 1, FILE_HEADER_LEN, file) != FILE_HEADER_LEN)
-    goto io_error;
+      ((dt_coordinate*)e)->time = from + index * step;
+      index++;
+    }
+}
 
-  /* The first 322 bytes seem to be equal for every WPI file. I've encoded 
-   * these 322 bytes using the base64 encoding algorithm. The result of this
-   * encoding can be found in the variable 'header'. Comparing the first 322
-   * bytes from the loaded file can filter out malformed WPI files. */
-  char* header = 
-    "AQbwAh4AEQk10/Kz8hcAIQ8AAmJaCQAAYQcAAAAAJiQAAAAAAAAAAAAAAcvr//+UATud///GAU"
-    "Yw//+0ATEj///9IyTyLIA/7ax2tjxZCjsLFaI/R55iOkhvmbWb1oA/EwieQAAAJy0AAAAH///l"
-    "+hjdFX0L6vfWCFey/odHABikBnMS616JF2Qd9ZlzAflX/92H8QOAJQ8AAgIBAAADAAACAAAA8Q"
-    "MAKLQBAAAAzwEAAAAQAAADAAAAAAAAAQARAAADAAAAekLSLAAgAAADAAAAAAAAAAAhAAADAAAA"
-    "rQAAAAAkAAADAAAAAgAAAAAlAAADAAAAWgAAAAAmAAADAAAAQQAAAAAnAAADAAAAZHS8ygAwAA"
-    "AFAAAA1P7//wAAAAAUAAAAATAAAAUAAAAsAQAAAAAAABQAAAAAMwAAAwAAAA==";
-
-  gchar* base64_header = g_base64_encode (file_header, FILE_HEADER_LEN);
-  if (strcmp (base64_header, header))
+/*----------------------------------------------------------------------------.
+ | WPI_TIMELINE_UPDATE:                                                       |
+ | This function returns the time in seconds since the start of the           |
+ | recording for a clock value. When the clock goes down, it has either       |
+ | wrapped around, or it has been restarted. The latter happens in merged     |
+ | files, where each file starts a new layer with its own clock. The time     |
+ | then continues from 'earliest'.                                            |
+ '----------------------------------------------------------------------------*/
+static double
+p_wpi_timeline_update (p_wpi_timeline* timeline, unsigned short counter,
+		       double earliest)
+{
+  if (timeline->has_counter && counter < timeline->last_counter)
     {
-      free (file_header);
-      g_free (base64_header);
-      goto io_error;
+      if (!timeline->new_layer
+	  && timeline->last_counter >= 0xFFFF - WRAP_WINDOW
+	  && counter < WRAP_WINDOW)
+	timeline->offset += 65536;
+      else
+	timeline->offset = earliest - counter;
     }
 
-  g_free (base64_header);
-  free (file_header);
-  file_header = NULL;
+  timeline->last_counter = counter;
+  timeline->has_counter = 1;
+  timeline->new_layer = 0;
+  timeline->time = timeline->offset + counter;
 
-  /* Determine the size of the file. */
-  fseek (file, 0L, SEEK_END);
-  size_t data_len = ftell (file) - 2040;
+  return timeline->time;
+}
 
-  /* Set up an array that can keep the entire file in memory. */
-  unsigned char *data = calloc (1, data_len);
+/*----------------------------------------------------------------------------.
+ | WPI_ASSIGN_TIMES:                                                          |
+ | The clock blocks count whole seconds in 16 bits. This function gives each |
+ | coordinate a time in seconds since the start of the recording, and keeps   |
+ | counting up when the clock wraps around or restarts. 'seconds' is set to   |
+ | the time of the last clock block.                                          |
+ '----------------------------------------------------------------------------*/
+static GSList*
+p_wpi_assign_times (GSList* list, unsigned short* seconds)
+{
+  GSList* first = NULL;
+  unsigned int count = 0;
+  p_wpi_timeline timeline;
+  double from = 0;
 
-  /* Read the relevant data in the file to memory. The first 2040 bytes can be
-   * skipped (according to the PaperInkConverter program). This data seems to
-   * tell something about the Inkling device (this could be firmware versions,
-   * or a unique identifier for each Inkling device. */ 
-  fseek (file, 2040, SEEK_SET);
-  unsigned int read_len = fread (data, 1, data_len, file);
-  if (read_len != data_len)
-    goto io_error;
+  memset (&timeline, 0, sizeof (p_wpi_timeline));
+
+  GSList* item = list;
+  for (; item != NULL; item = item->next)
+    {
+      dt_element* e = (dt_element*)item->data;
+      if (e->type == TYPE_COORDINATE)
+	{
+	  if (count == 0) first = item;
+	  count++;
+	}
+      else if (e->type == TYPE_STROKE && ((dt_stroke*)e)->value == NEW_LAYER)
+	timeline.new_layer = 1;
+      else if (e->type == TYPE_CLOCK)
+	{
+	  /* After a restart, give the coordinates before this clock block
+	   * their usual pace. */
+	  double until = p_wpi_timeline_update (&timeline, ((dt_clock*)e)->counter,
+						from + count * CLOCK_FREQUENCY);
+	  p_wpi_spread_times (first, count, from, until);
+
+	  if (until > from) from = until;
+	  count = 0;
+	}
+    }
+
+  /* There's no clock block after the last coordinates. */
+  p_wpi_spread_times (first, count, from, from);
+
+  if (timeline.has_counter)
+    *seconds = (timeline.time < USHRT_MAX) ? timeline.time : USHRT_MAX;
+
+  return list;
+}
+
+/*----------------------------------------------------------------------------.
+ | WPI_PARSE_BLOCKS:                                                          |
+ | This function turns the data after the preamble into a list of elements.   |
+ | 'data' must be followed by at least BLOCK_PADDING zero bytes, because the  |
+ | blocks are read without checking whether they are cut off.                 |
+ '----------------------------------------------------------------------------*/
+static GSList*
+p_wpi_parse_blocks (const unsigned char* data, size_t data_len, unsigned short* seconds)
+{
+  /* Create a GSList (singly-linked list) that will be the return value of 
+   * this function. */
+  GSList* list = NULL;
 
-  /* Parse the data in the file. */
   unsigned int count;
   for (count = 0; count < data_len; count++)
     switch (data[count])
@@ -258,26 +343,107 @@ p_wpi_parse (const char* filename, unsigned short* seconds)
 
 	      clock->type = TYPE_CLOCK;
 	      clock->counter = (data[count + 4] << 8) | (data[count + 5]);
-	      *seconds = clock->counter;
 	      list = g_slist_prepend (list, clock);
 	    }
 	}
       }
 
+
+  return p_wpi_assign_times (g_slist_reverse (list), seconds);
+}
+
+/*----------------------------------------------------------------------------.
+ | WPI_PARSE:                                                                 |
+ | This function reads the data and tries to get useful data out of it.       |
+ '----------------------------------------------------------------------------*/
+GSList*
+p_wpi_parse (const char* filename, unsigned short* seconds)
+{
+  GSList* list = NULL;
+  unsigned char* data = NULL;
+
+  /* Open the file read-only in binary mode. The binary mode is important 
+   * because ftell() will only correctly return the length when in this mode */
+  FILE* file = fopen (filename, "rb");
+
+  if (file == NULL)
+    goto io_error;
+
+  /* Read the file header into memory. */
+  unsigned char file_header[WPI_HEADER_LEN];
+  if (fread (file_header, 1, WPI_HEADER_LEN, file) != WPI_HEADER_LEN)
+    goto io_error;
+
+  if (!p_wpi_has_valid_header (file_header))
+    goto io_error;
+
+  /* Determine the size of the file. */
+  fseek (file, 0L, SEEK_END);
+  long file_len = ftell (file);
+  if (file_len < WPI_PREAMBLE_LEN)
+    goto io_error;
+
+  size_t data_len = file_len - WPI_PREAMBLE_LEN;
+
+  /* Set up an array that can keep the entire file in memory. */
+  data = calloc (1, data_len + BLOCK_PADDING);
+  if (data == NULL)
+    goto io_error;
+
+  /* Read the relevant data in the file to memory. The first 2040 bytes can be
+   * skipped (according to the PaperInkConverter program). This data seems to
+   * tell something about the Inkling device (this could be firmware versions,
+   * or a unique identifier for each Inkling device. */ 
+  fseek (file, WPI_PREAMBLE_LEN, SEEK_SET);
+  size_t read_len = fread (data, 1, data_len, file);
+  if (read_len != data_len)
+    goto io_error;
+
+  list = p_wpi_parse_blocks (data, data_len, seconds);
+
   free (data);
-  list = g_slist_reverse (list);
   fclose (file);
   return list;
 
  io_error:
   puts ("An error occurred when reading the file.");
-  fclose (file);
+  free (data);
+  if (file != NULL)
+    fclose (file);
   return NULL;
 }
 
+/*----------------------------------------------------------------------------.
+ | WPI_PARSE_DATA:                                                            |
+ | This function does the same as p_wpi_parse(), on the contents of a file    |
+ | that is already in memory.                                                 |
+ '----------------------------------------------------------------------------*/
+GSList*
+p_wpi_parse_data (const unsigned char* contents, size_t length, unsigned short* seconds)
+{
+  if (contents == NULL || length < WPI_PREAMBLE_LEN
+      || !p_wpi_has_valid_header (contents))
+    {
+      puts ("The data is not in the WPI format.");
+      return NULL;
+    }
+
+  /* The data is copied so it can be padded (see p_wpi_parse_blocks()). */
+  size_t data_len = length - WPI_PREAMBLE_LEN;
+  unsigned char* data = calloc (1, data_len + BLOCK_PADDING);
+  if (data == NULL) return NULL;
+
+  memcpy (data, contents + WPI_PREAMBLE_LEN, data_len);
+  GSList* list = p_wpi_parse_blocks (data, data_len, seconds);
+  free (data);
+
+  return list;
+}
+
 /*----------------------------------------------------------------------------.
  | WPI_GET_METADATA:                                                          |
- | This function gathers metadata from a parsed file.                         |
+ | This function gathers metadata from a parsed file. The layer times use the |
+ | same continuous time as the coordinates (see p_wpi_assign_times()).        |
  '----------------------------------------------------------------------------*/
 dt_metadata*
 p_wpi_get_metadata (GSList* data)
@@ -287,9 +453,17 @@ p_wpi_get_metadata (GSList* data)
   dt_metadata* metadata = calloc (1, sizeof (dt_metadata));
   if (metadata == NULL) return NULL;
 
-  metadata->num_layers = 1;
   metadata->num_seconds = 0;
-  
+
+  /* The first layer starts at the beginning. Every following layer starts
+   * where the one before it ends. */
+  GArray* layers = g_array_new (FALSE, FALSE, sizeof (dt_layer_timing));
+  dt_layer_timing layer = { 0, 0 };
+
+  p_wpi_timeline timeline;
+  memset (&timeline, 0, sizeof (p_wpi_timeline));
+  unsigned int count = 0;
+
   while (item != NULL)
     {
       dt_element* e = (dt_element *)item->data;
@@ -297,23 +471,37 @@ p_wpi_get_metadata (GSList* data)
 	{
 	case TYPE_STROKE:
 	  if (((dt_stroke *)e)->value == BEGIN_STROKE) has_stroke_data = 1;
-	  if (((dt_stroke *)e)->value == NEW_LAYER && has_stroke_data)
+	  if (((dt_stroke *)e)->value == NEW_LAYER)
 	    {
-	      int* point_in_time = calloc (1, sizeof (int));
-	      if (point_in_time == NULL) break;
-	      *point_in_time = metadata->num_seconds;
-	      metadata->layer_timings = g_slist_prepend (metadata->layer_timings, point_in_time);
-	      metadata->num_layers++;
-	      has_stroke_data = 0;
+	      timeline.new_layer = 1;
+	      if (has_stroke_data)
+		{
+		  layer.end = timeline.time;
+		  g_array_append_val (layers, layer);
+		  layer.start = timeline.time;
+		  has_stroke_data = 0;
+		}
 	    }
 	  break;
+	case TYPE_COORDINATE:
+	  count++;
+	  break;
 	case TYPE_CLOCK:
-	  metadata->num_seconds = ((dt_clock *)e)->counter;
+	  p_wpi_timeline_update (&timeline, ((dt_clock *)e)->counter,
+				 timeline.time + count * CLOCK_FREQUENCY);
+	  count = 0;
 	  break;
 	}
       item = item->next;
     }
 
+  metadata->num_seconds = timeline.time;
+  layer.end = timeline.time;
+  g_array_append_val (layers, layer);
+
+  metadata->num_layers = layers->len;
+  metadata->layers = (dt_layer_timing*)g_array_free (layers, FALSE);
+
   return metadata;
 }
 
@@ -338,6 +526,8 @@ p_wpi_cleanup (GSList* data)
 void
 p_wpi_metadata_cleanup (dt_metadata* data)
 {
-  g_slist_free_full (data->layer_timings, free);
+  if (data == NULL) return;
+
+  g_free (data->layers);
   free (data);
 }
@@ -36,15 +36,52 @@
 #include <glib.h>
 #include "../datatypes/metadata.h"
 
+/**
+ * The length of the preamble of a WPI file. The pen data starts right after
+ * it.
+ */
+#define WPI_PREAMBLE_LEN 2040
+
+/**
+ * The length of the part of the preamble that seems to be equal for every
+ * WPI file.
+ */
+#define WPI_HEADER_LEN 322
+
+/**
+ * The first WPI_HEADER_LEN bytes of every WPI file, encoded in base64.
+ */
+#define WPI_HEADER_BASE64 \
+  "AQbwAh4AEQk10/Kz8hcAIQ8AAmJaCQAAYQcAAAAAJiQAAAAAAAAAAAAAAcvr//+UATud///GAU" \
+  "Yw//+0ATEj///9IyTyLIA/7ax2tjxZCjsLFaI/R55iOkhvmbWb1oA/EwieQAAAJy0AAAAH///l" \
+  "+hjdFX0L6vfWCFey/odHABikBnMS616JF2Qd9ZlzAflX/92H8QOAJQ8AAgIBAAADAAACAAAA8Q" \
+  "MAKLQBAAAAzwEAAAAQAAADAAAAAAAAAQARAAADAAAAekLSLAAgAAADAAAAAAAAAAAhAAADAAAA" \
+  "rQAAAAAkAAADAAAAAgAAAAAlAAADAAAAWgAAAAAmAAADAAAAQQAAAAAnAAADAAAAZHS8ygAwAA" \
+  "AFAAAA1P7//wAAAAAUAAAAATAAAAUAAAAsAQAAAAAAABQAAAAAMwAAAwAAAA=="
+
 /**
  * This function decodes the WPI format and creates a list of the data using
  * the available datatypes.
  *
  * @param filename The filename to parse.
+ * @param seconds  Is set to the length of the recording, in seconds since
+ *                 its start (see dt_coordinate). This is the time at which
+ *                 dt_configuration's 'process_until' includes everything.
  * @return A pointer to a GSList containing the parsed data.
  */
 GSList* p_wpi_parse (const char* filename, unsigned short* seconds);
 
+/**
+ * This function does the same as p_wpi_parse(), but on the contents of a WPI
+ * file that has already been loaded into memory.
+ *
+ * @param contents The contents of a WPI file.
+ * @param length   The number of bytes in 'contents'.
+ * @param seconds  Is set to the length of the recording (see p_wpi_parse()).
+ * @return A pointer to a GSList containing the parsed data.
+ */
+GSList* p_wpi_parse_data (const unsigned char* contents, size_t length, unsigned short* seconds);
+
 /**
  * This function gathers various statistics on the parsed file.
  * @param data The parsed data.
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "capture.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* The number of bytes each report takes in the file. */
+#define RECORD_LEN (8 + USB_REPORT_SIZE)
+
+/*----------------------------------------------------------------------------.
+ | USB_CAPTURE_CREATE                                                         |
+ '----------------------------------------------------------------------------*/
+usb_capture*
+usb_capture_create (const char* filename)
+{
+  FILE* file = fopen (filename, "wb");
+  if (file == NULL || fwrite (USB_CAPTURE_MAGIC, 1, USB_CAPTURE_MAGIC_LEN, file)
+      != USB_CAPTURE_MAGIC_LEN)
+    {
+      printf ("Couldn't write to '%s'.\n", filename);
+      if (file != NULL) fclose (file);
+      return NULL;
+    }
+
+  usb_capture* capture = calloc (1, sizeof (usb_capture));
+  if (capture == NULL)
+    {
+      fclose (file);
+      return NULL;
+    }
+
+  capture->file = file;
+  capture->start = -1;
+  return capture;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_CAPTURE_OPEN                                                           |
+ '----------------------------------------------------------------------------*/
+usb_capture*
+usb_capture_open (const char* filename)
+{
+  char magic[USB_CAPTURE_MAGIC_LEN];
+  FILE* file = fopen (filename, "rb");
+
+  if (file == NULL
+      || fread (magic, 1, USB_CAPTURE_MAGIC_LEN, file) != USB_CAPTURE_MAGIC_LEN
+      || memcmp (magic, USB_CAPTURE_MAGIC, USB_CAPTURE_MAGIC_LEN))
+    {
+      printf ("'%s' is not a capture file.\n", filename);
+      if (file != NULL) fclose (file);
+      return NULL;
+    }
+
+  usb_capture* capture = calloc (1, sizeof (usb_capture));
+  if (capture == NULL)
+    {
+      fclose (file);
+      return NULL;
+    }
+
+  capture->file = file;
+  capture->start = 0;
+  return capture;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_CAPTURE_WRITE                                                          |
+ '----------------------------------------------------------------------------*/
+int
+usb_capture_write (usb_capture* capture, const usb_report* report)
+{
+  if (capture->start < 0)
+    capture->start = report->time;
+
+  guint64 offset = report->time - capture->start;
+  unsigned char record[RECORD_LEN];
+  int index;
+
+  for (index = 0; index < 8; index++)
+    record[index] = (offset >> (index * 8)) & 0xff;
+
+  memcpy (record + 8, report->data, USB_REPORT_SIZE);
+  return (fwrite (record, 1, RECORD_LEN, capture->file) != RECORD_LEN);
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_CAPTURE_READ                                                           |
+ '----------------------------------------------------------------------------*/
+int
+usb_capture_read (usb_capture* capture, usb_report* report)
+{
+  unsigned char record[RECORD_LEN];
+  if (fread (record, 1, RECORD_LEN, capture->file) != RECORD_LEN)
+    return 0;
+
+  guint64 offset = 0;
+  int index;
+  for (index = 7; index >= 0; index--)
+    offset = (offset << 8) | record[index];
+
+  report->time = (gint64)offset;
+  memcpy (report->data, record + 8, USB_REPORT_SIZE);
+  return 1;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_CAPTURE_CLOSE                                                          |
+ '----------------------------------------------------------------------------*/
+void
+usb_capture_close (usb_capture* capture)
+{
+  if (capture == NULL) return;
+
+  fclose (capture->file);
+  free (capture);
+}
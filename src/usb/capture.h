@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   usb/capture.h
+ * @brief  Store the raw reports of online mode, so they can be replayed.
+ * @author Roel Janssen
+ */
+
+#ifndef USB_CAPTURE_H
+#define USB_CAPTURE_H
+
+#include <stdio.h>
+#include "ring-buffer.h"
+
+/**
+ * A capture file starts with these eight bytes. After that, each report is
+ * stored as a 64-bit little-endian number of microseconds since the first
+ * report, followed by the USB_REPORT_SIZE bytes of the report.
+ */
+#define USB_CAPTURE_MAGIC "INKCAP01"
+#define USB_CAPTURE_MAGIC_LEN 8
+
+/**
+ * This struct describes a capture file that is being written or read.
+ */
+typedef struct
+{
+  FILE* file;
+
+  /* The time of the first report that was written, or -1. */
+  gint64 start;
+} usb_capture;
+
+/**
+ * This function creates a new capture file.
+ * @param filename The file to write to.
+ * @return A capture to pass to usb_capture_write(), or NULL.
+ */
+usb_capture* usb_capture_create (const char* filename);
+
+/**
+ * This function opens a capture file for reading.
+ * @param filename The file to read.
+ * @return A capture to pass to usb_capture_read(), or NULL.
+ */
+usb_capture* usb_capture_open (const char* filename);
+
+/**
+ * This function adds a report to a capture file.
+ * @param capture The capture to write to.
+ * @param report  The report and the time it was received.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int usb_capture_write (usb_capture* capture, const usb_report* report);
+
+/**
+ * This function reads the next report from a capture file.
+ * @param capture The capture to read from.
+ * @param report  Is set to the report. Its time is the number of
+ *                microseconds since the first report.
+ * @return 1 when a report was read, 0 at the end of the file.
+ */
+int usb_capture_read (usb_capture* capture, usb_report* report);
+
+/**
+ * This function closes a capture file.
+ * @param capture The capture to close.
+ */
+void usb_capture_close (usb_capture* capture);
+
+#endif//USB_CAPTURE_H
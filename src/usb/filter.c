@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "filter.h"
+
+#include <string.h>
+
+/* The number of bits below the unit of the device, to keep precision while
+ * filtering. */
+#define FRACTION_BITS 8
+
+/* Smoothing factors are fractions of this. */
+#define FIXED_ONE 65536
+
+/* The cutoff frequency of the speed, in millihertz. */
+#define VELOCITY_CUTOFF 1000
+
+/* 10^9 / (2 * pi), which turns a cutoff frequency in millihertz into a time
+ * constant in microseconds. */
+#define TIME_CONSTANT_FACTOR 159154943
+
+/* After a gap this long (the pen left the paper's range, or online mode
+ * paused) the filter starts over instead of sliding from the old position. */
+#define RESET_GAP (G_USEC_PER_SEC / 10)
+
+/* Reports that arrive closer together than this were queued up on the way,
+ * so the time between them says nothing about the speed of the pen. */
+#define MIN_INTERVAL 1000
+
+/*----------------------------------------------------------------------------.
+ | USB_FILTER_SMOOTHING_FACTOR                                                |
+ | This function returns how much of a new value passes a low-pass filter     |
+ | with the given cutoff frequency, as a fraction of FIXED_ONE.               |
+ '----------------------------------------------------------------------------*/
+static gint64
+usb_filter_smoothing_factor (gint64 interval, gint64 cutoff)
+{
+  if (cutoff <= 0) return FIXED_ONE;
+
+  gint64 time_constant = TIME_CONSTANT_FACTOR / cutoff;
+  return interval * FIXED_ONE / (interval + time_constant);
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_FILTER_RESET_AXIS                                                      |
+ '----------------------------------------------------------------------------*/
+static void
+usb_filter_reset_axis (usb_filter_axis* axis, int value)
+{
+  axis->position = (gint64)value << FRACTION_BITS;
+  axis->velocity = 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_FILTER_AXIS_APPLY                                                      |
+ | This function runs the One Euro filter on one axis: the faster the pen     |
+ | moves, the higher the cutoff frequency, so slow movements lose their       |
+ | jitter while fast movements don't lag behind. The result is moved ahead   |
+ | along the filtered speed to make up for the latency.                       |
+ '----------------------------------------------------------------------------*/
+static int
+usb_filter_axis_apply (const usb_filter* filter, usb_filter_axis* axis,
+		       int value, gint64 interval)
+{
+  gint64 target = (gint64)value << FRACTION_BITS;
+
+  gint64 velocity = (target - axis->position) * G_USEC_PER_SEC / interval;
+  gint64 factor = usb_filter_smoothing_factor (interval, VELOCITY_CUTOFF);
+  axis->velocity += (velocity - axis->velocity) * factor / FIXED_ONE;
+
+  if (filter->min_cutoff > 0)
+    {
+      gint64 speed = ABS (axis->velocity) >> FRACTION_BITS;
+      gint64 cutoff = filter->min_cutoff + filter->beta * speed / 1000;
+      factor = usb_filter_smoothing_factor (interval, cutoff);
+      axis->position += (target - axis->position) * factor / FIXED_ONE;
+    }
+  else
+    axis->position = target;
+
+  gint64 result = axis->position
+    + axis->velocity * filter->prediction / G_USEC_PER_SEC;
+
+  result = (result + (1 << (FRACTION_BITS - 1))) >> FRACTION_BITS;
+  return (result < 0) ? 0 : (int)result;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_FILTER_INIT                                                            |
+ '----------------------------------------------------------------------------*/
+void
+usb_filter_init (usb_filter* filter, const dt_configuration* settings)
+{
+  memset (filter, 0, sizeof (usb_filter));
+
+  filter->min_cutoff = (gint64)(settings->filter_min_cutoff * 1000);
+  filter->beta = (gint64)(settings->filter_beta * 1000000);
+  filter->prediction = (gint64)settings->filter_prediction * 1000;
+  filter->enabled = (filter->min_cutoff > 0 || filter->prediction > 0);
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_FILTER_APPLY                                                           |
+ '----------------------------------------------------------------------------*/
+void
+usb_filter_apply (usb_filter* filter, usb_pen_sample* sample)
+{
+  if (!filter->enabled) return;
+
+  gint64 interval = sample->time - filter->previous_time;
+  filter->previous_time = sample->time;
+
+  if (!filter->has_previous || interval > RESET_GAP)
+    {
+      usb_filter_reset_axis (&filter->x, sample->x);
+      usb_filter_reset_axis (&filter->y, sample->y);
+      filter->has_previous = 1;
+      return;
+    }
+
+  if (interval < MIN_INTERVAL)
+    interval = MIN_INTERVAL;
+
+  sample->x = usb_filter_axis_apply (filter, &filter->x, sample->x, interval);
+  sample->y = usb_filter_axis_apply (filter, &filter->y, sample->y, interval);
+}
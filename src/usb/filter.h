@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file   usb/filter.h
+ * @brief  Smooth and predict the pen position in online mode.
+ * @author Roel Janssen
+ */
+
+#ifndef USB_FILTER_H
+#define USB_FILTER_H
+
+#include <glib.h>
+#include "recording.h"
+#include "../datatypes/configuration.h"
+
+/**
+ * This struct holds the state of the filter of a single axis. The position
+ * and velocity are kept with a few extra bits of precision.
+ */
+typedef struct
+{
+  gint64 position;
+
+  /* The filtered speed of the axis, per second. */
+  gint64 velocity;
+} usb_filter_axis;
+
+/**
+ * This struct holds the state of a One Euro filter for the X and Y axes,
+ * followed by a linear prediction. Everything is done with integers, and
+ * nothing is allocated after usb_filter_init().
+ */
+typedef struct
+{
+  /* The cutoff frequency when the pen stands still, in millihertz. */
+  gint64 min_cutoff;
+
+  /* How much the cutoff frequency rises with the speed of the pen, in
+   * microhertz per unit per second. */
+  gint64 beta;
+
+  /* How far ahead to predict the position, in microseconds. */
+  gint64 prediction;
+
+  int enabled;
+  int has_previous;
+  gint64 previous_time;
+  usb_filter_axis x;
+  usb_filter_axis y;
+} usb_filter;
+
+/**
+ * This function prepares a filter from the settings 'filter-min-cutoff',
+ * 'filter-beta' and 'filter-prediction'. The filter is disabled when the
+ * cutoff and the prediction are both 0.
+ * @param filter   The filter to prepare.
+ * @param settings The settings to read.
+ */
+void usb_filter_init (usb_filter* filter, const dt_configuration* settings);
+
+/**
+ * This function replaces the position of a sample by its filtered and
+ * predicted position. The other values are left alone.
+ * @param filter The filter to use.
+ * @param sample The sample to filter.
+ */
+void usb_filter_apply (usb_filter* filter, usb_pen_sample* sample);
+
+#endif//USB_FILTER_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "histogram.h"
+
+/*----------------------------------------------------------------------------.
+ | USB_HISTOGRAM_BUCKET                                                       |
+ | This function returns the bucket a value belongs to.                       |
+ '----------------------------------------------------------------------------*/
+static int
+usb_histogram_bucket (gint64 value)
+{
+  int bucket = 0;
+  while (value > 0 && bucket < USB_HISTOGRAM_BUCKETS - 1)
+    {
+      value >>= 1;
+      bucket++;
+    }
+
+  return bucket;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_HISTOGRAM_ADD                                                          |
+ '----------------------------------------------------------------------------*/
+void
+usb_histogram_add (usb_histogram* histogram, gint64 value)
+{
+  if (value < 0) value = 0;
+
+  histogram->buckets[usb_histogram_bucket (value)]++;
+  histogram->count++;
+  histogram->total += value;
+  if (value > histogram->max)
+    histogram->max = value;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_HISTOGRAM_PERCENTILE                                                   |
+ '----------------------------------------------------------------------------*/
+gint64
+usb_histogram_percentile (const usb_histogram* histogram, double fraction)
+{
+  if (histogram->count == 0) return 0;
+
+  guint64 wanted = (guint64)(fraction * histogram->count);
+  guint64 seen = 0;
+  int bucket;
+
+  for (bucket = 0; bucket < USB_HISTOGRAM_BUCKETS - 1; bucket++)
+    {
+      seen += histogram->buckets[bucket];
+      if (seen > wanted) break;
+    }
+
+  /* Don't report more than was actually measured. The last bucket has no
+   * upper bound. */
+  gint64 bound = ((gint64)1 << bucket) - 1;
+  if (bucket == USB_HISTOGRAM_BUCKETS - 1 || bound > histogram->max)
+    bound = histogram->max;
+
+  return bound;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_HISTOGRAM_PRINT                                                        |
+ '----------------------------------------------------------------------------*/
+void
+usb_histogram_print (const usb_histogram* histogram, const char* title, FILE* stream)
+{
+  fprintf (stream, "%s (%llu reports):\n", title,
+	   (unsigned long long)histogram->count);
+  if (histogram->count == 0) return;
+
+  fprintf (stream, "  mean %lld us, p50 %lld us, p99 %lld us, max %lld us\n",
+	   (long long)(histogram->total / (gint64)histogram->count),
+	   (long long)usb_histogram_percentile (histogram, 0.50),
+	   (long long)usb_histogram_percentile (histogram, 0.99),
+	   (long long)histogram->max);
+
+  int bucket;
+  for (bucket = 0; bucket < USB_HISTOGRAM_BUCKETS; bucket++)
+    {
+      if (histogram->buckets[bucket] == 0) continue;
+
+      const char* below = (bucket < USB_HISTOGRAM_BUCKETS - 1) ? "< " : ">=";
+      long long bound = (long long)1 << bucket;
+      if (bucket == USB_HISTOGRAM_BUCKETS - 1) bound >>= 1;
+
+      fprintf (stream, "  %s %8lld us  %llu\n", below, bound,
+	       (unsigned long long)histogram->buckets[bucket]);
+    }
+}
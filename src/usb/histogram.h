@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   usb/histogram.h
+ * @brief  A histogram of latencies in microseconds.
+ * @author Roel Janssen
+ */
+
+#ifndef USB_HISTOGRAM_H
+#define USB_HISTOGRAM_H
+
+#include <glib.h>
+#include <stdio.h>
+
+/**
+ * The number of buckets. Bucket N counts values below 2^N microseconds, so
+ * the last bucket holds everything from about 4 seconds.
+ */
+#define USB_HISTOGRAM_BUCKETS 24
+
+/**
+ * This struct counts latencies in buckets that double in size.
+ */
+typedef struct
+{
+  guint64 buckets[USB_HISTOGRAM_BUCKETS];
+  guint64 count;
+  gint64 total;
+  gint64 max;
+} usb_histogram;
+
+/**
+ * This function adds a value to a histogram.
+ * @param histogram The histogram to add the value to.
+ * @param value     The latency in microseconds.
+ */
+void usb_histogram_add (usb_histogram* histogram, gint64 value);
+
+/**
+ * This function estimates a percentile from the histogram.
+ * @param histogram The histogram to look at.
+ * @param fraction  The fraction of values that should be below the result
+ *                  (for example 0.99).
+ * @return The upper bound of the bucket the percentile falls in, in
+ *         microseconds.
+ */
+gint64 usb_histogram_percentile (const usb_histogram* histogram, double fraction);
+
+/**
+ * This function writes a human-readable summary of a histogram.
+ * @param histogram The histogram to write.
+ * @param title     The name of what was measured.
+ * @param stream    The stream to write to.
+ */
+void usb_histogram_print (const usb_histogram* histogram, const char* title, FILE* stream);
+
+#endif//USB_HISTOGRAM_H
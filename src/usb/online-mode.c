@@ -1,4 +1,9 @@
 #include "online-mode.h"
+#include "ring-buffer.h"
+#include "recording.h"
+#include "capture.h"
+#include "statistics.h"
+#include "filter.h"
 #include <libusb.h>
 #include <stdio.h>
 #include <string.h>
@@ -12,6 +17,8 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <sys/time.h>
 
 /*----------------------------------------------------------------------------.
  | READ ME                                                                    |
@@ -50,269 +57,1124 @@ usb_online_mode_mouse_enable_feature (int virtual_mouse_desc, int bit, int featu
 }
 
 
-void
-usb_online_mode_init ()
+/*----------------------------------------------------------------------------.
+ | PIPELINE                                                                   |
+ | -------------------------------------------------------------------------- |
+ |                                                                            |
+ | Pen data is received with several asynchronous transfers queued at once.  |
+ | The libusb callbacks only copy each report into a ring buffer. A separate |
+ | thread decodes the reports and moves the virtual mouse, so that a slow     |
+ | write to uinput never keeps the next report from being received.          |
+ '----------------------------------------------------------------------------*/
+
+/* The number of interrupt transfers that are queued at the same time. */
+#define NUM_TRANSFERS 8
+
+/* How often a sleeping consumer wakes up to see whether the statistics
+ * were asked for, in microseconds. */
+#define STATISTICS_POLL_INTERVAL (G_USEC_PER_SEC / 4)
+
+typedef struct
 {
-  if (libusb_init (NULL))
-    puts ("Initializing libUSB failed.");
+  usb_ring_buffer ring;
+  int virtual_mouse_desc;
 
-  // Traverse the list of connected USB devices. We are only interested in the
-  // Inkling which has the vendor ID "0x056a" and the product ID "0x0221".
-  libusb_device **list;
-  libusb_device *found = NULL;
-  ssize_t device_count = libusb_get_device_list (NULL, &list);
-  ssize_t iterator = 0;
-  int error = 0;
-  libusb_device *device;
-  if (device_count < 0)
-    puts ("Cannot get the USB device list. Did you plug in your Inkling?");
+  /* The recording to add the pen data to, or NULL. */
+  usb_recording* recording;
+
+  /* The file to store the raw reports in, or NULL. */
+  usb_capture* capture;
+
+  usb_statistics statistics;
+  usb_filter filter;
+
+  /* Where to write the statistics to, or NULL. */
+  FILE* statistics_output;
+  gint64 statistics_interval;
+  const char* name;
+
+  /* Set to 0 to make both threads stop. */
+  volatile gint running;
+
+  /* Set by the consumer while it waits for the ring buffer to fill up. */
+  volatile gint waiting;
+  GMutex lock;
+  GCond wake;
+
+  /* Only used from the thread that produces the reports. */
+  int pending;
+} usb_online_mode_pipeline;
+
+/* The absolute axes of the virtual mouse, in the order they are sent. */
+#define NUM_AXES 5
+static const unsigned short usb_online_mode_axes[NUM_AXES] = {
+  ABS_X, ABS_Y, ABS_PRESSURE, ABS_TILT_X, ABS_TILT_Y
+};
+
+/* What the virtual mouse last reported, so that unchanged values can be
+ * left out. An axis value of -1 means nothing was sent yet. */
+typedef struct
+{
+  int axes[NUM_AXES];
+  int button;
+} usb_online_mode_pen_state;
 
-  for (iterator = 0; iterator < device_count; iterator++)
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_DECODE_REPORT                                              |
+ | This function decodes a report. Returns 0 when it isn't a pen report.      |
+ '----------------------------------------------------------------------------*/
+static int
+usb_online_mode_decode_report (const usb_report* report, usb_pen_sample* sample)
+{
+  const unsigned char* data = report->data;
+
+  // Only process "Pen" packets.
+  if (data[0] != 0x02) return 0;
+
+  // The coordinates are segmented in 7 pieces of 1 byte.
+  // An extra byte indicates which in which segment the pen is.
+  // Thus, the right value can be obtained by this formula:
+  // segment * 2^8 + x
+  int x = data[2] * 256 + data[1];
+  int y = (data[4] * 256 + data[3]) * -1;
+
+  // Same formula applies to pressure data.
+  // segment * 2^8 + pressure
+  // "segment" can vary between 0 and 3, giving us values
+  // between 0 and 1024.
+  int pressure = data[6];
+  pressure = pressure + 256 * data[7];
+
+  sample->x = abs (x);
+  sample->y = abs (y);
+  sample->pressure = pressure;
+  sample->tilt_x = data[8];
+  sample->tilt_y = data[9];
+  sample->time = report->time;
+
+  return 1;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_EMIT_SAMPLE                                                |
+ | This function moves the virtual mouse to a decoded sample. All changes are |
+ | written at once as a single frame, closed by SYN_REPORT.                   |
+ '----------------------------------------------------------------------------*/
+static int
+usb_online_mode_emit_sample (int virtual_mouse_desc, const usb_pen_sample* sample,
+			     usb_online_mode_pen_state* state)
+{
+  int values[NUM_AXES] = {
+    sample->x, sample->y, sample->pressure, sample->tilt_x, sample->tilt_y
+  };
+
+  // Do a mouse click when needed.
+  int button = (sample->pressure > USB_PEN_DOWN_PRESSURE);
+
+  // The frame holds every axis, the button and the synchronization event.
+  struct input_event frame[NUM_AXES + 2];
+  memset (frame, 0, sizeof (frame));
+
+  int count = 0;
+  int index;
+  for (index = 0; index < NUM_AXES; index++)
     {
-      device = list[iterator];
-      struct libusb_device_descriptor descriptor;
-      libusb_get_device_descriptor (device, &descriptor);
-      if (descriptor.idVendor == 0x056a && descriptor.idProduct == 0x0221)
-	{
-	  found = device;
-	  break;
-	}
-      device = NULL;
+      if (values[index] == state->axes[index]) continue;
+
+      frame[count].type = EV_ABS;
+      frame[count].code = usb_online_mode_axes[index];
+      frame[count].value = values[index];
+      state->axes[index] = values[index];
+      count++;
+    }
+
+  if (button != state->button)
+    {
+      frame[count].type = EV_KEY;
+      frame[count].code = BTN_LEFT;
+      frame[count].value = button;
+      state->button = button;
+      count++;
+    }
+
+  if (count == 0) return 0;
+
+  frame[count].type = EV_SYN;
+  frame[count].code = SYN_REPORT;
+  frame[count].value = 0;
+  count++;
+
+  size_t length = count * sizeof (struct input_event);
+  if (write (virtual_mouse_desc, frame, length) != (ssize_t)length)
+    {
+      puts ("Failed to move the mouse pointer.");
+      return 1;
     }
 
-  if (found)
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_WRITE_STATISTICS                                           |
+ | This function writes the statistics when they were asked for, or when the |
+ | interval has passed. It runs in the consumer thread.                       |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_write_statistics (usb_online_mode_pipeline* pipeline,
+				  int* requests_seen, gint64* next_write)
+{
+  int requests = usb_statistics_requested ();
+  gint64 now = g_get_monotonic_time ();
+
+  if (requests == *requests_seen && now < *next_write) return;
+
+  usb_statistics_write_json (&pipeline->statistics, pipeline->name,
+			     pipeline->statistics_output);
+
+  *requests_seen = requests;
+  if (pipeline->statistics_interval > 0)
+    *next_write = now + pipeline->statistics_interval;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_CONSUMER                                                   |
+ | This function runs in its own thread and handles the reports in the ring  |
+ | buffer until the pipeline is stopped.                                      |
+ '----------------------------------------------------------------------------*/
+static gpointer
+usb_online_mode_consumer (gpointer data)
+{
+  usb_online_mode_pipeline* pipeline = (usb_online_mode_pipeline*)data;
+  usb_report report;
+  usb_pen_sample sample;
+  usb_pen_sample filtered;
+  usb_online_mode_pen_state state;
+  memset (&state, 0, sizeof (state));
+  memset (state.axes, -1, sizeof (state.axes));
+
+  usb_statistics* statistics = &pipeline->statistics;
+  int requests_seen = usb_statistics_requested ();
+  gint64 next_write = G_MAXINT64;
+  if (pipeline->statistics_interval > 0)
+    next_write = g_get_monotonic_time () + pipeline->statistics_interval;
+
+  while (1)
     {
-      libusb_device_handle* handle;
-      error = libusb_open (found, &handle);
-      if (error || handle == NULL)
+      if (pipeline->statistics_output != NULL)
+	usb_online_mode_write_statistics (pipeline, &requests_seen, &next_write);
+
+      if (usb_ring_buffer_pop (&pipeline->ring, &report))
 	{
-	  puts ("Opening the USB device failed. You might need super user "
-		"permissions.");
-	  goto free_device_list;
+	  // Write the capture here rather than in the libusb callback, so a
+	  // slow disk can't hold up the transfers.
+	  if (pipeline->capture != NULL)
+	    usb_capture_write (pipeline->capture, &report);
+
+	  gint64 begin = g_get_monotonic_time ();
+	  if (!usb_online_mode_decode_report (&report, &sample))
+	    {
+	      usb_statistics_count (&statistics->other_reports);
+	      continue;
+	    }
+
+	  // The pointer follows the filtered position, while the recording
+	  // keeps what the device reported.
+	  usb_statistics_count (&statistics->pen_reports);
+	  filtered = sample;
+	  usb_filter_apply (&pipeline->filter, &filtered);
+
+	  if (usb_online_mode_emit_sample (pipeline->virtual_mouse_desc, &filtered,
+					   &state))
+	    usb_statistics_count (&statistics->write_failures);
+
+	  gint64 end = g_get_monotonic_time ();
+	  usb_histogram_add (&statistics->processing, end - begin);
+	  usb_histogram_add (&statistics->latency, end - report.time);
+
+	  usb_recording_add_sample (pipeline->recording, &sample);
+	  continue;
 	}
 
-      // Reset the device so we have a predictable state.
-      libusb_reset_device (handle);
+      if (!g_atomic_int_get (&pipeline->running)) break;
 
-      // Check whether the kernel has assigned a driver to it.
-      if (libusb_kernel_driver_active (handle, 0))
+      // Announce that we are going to sleep before looking at the ring
+      // buffer once more, so the producer can't miss us. When statistics
+      // are written, wake up every now and then to look for requests.
+      g_mutex_lock (&pipeline->lock);
+      g_atomic_int_set (&pipeline->waiting, 1);
+      while (usb_ring_buffer_is_empty (&pipeline->ring)
+	     && g_atomic_int_get (&pipeline->running))
 	{
-	  printf ("Detaching kernel driver..\t");
-	  (libusb_detach_kernel_driver (handle, 0) == 0)
-	    ? puts ("OK")
-	    : puts ("FAILED");
+	  if (pipeline->statistics_output == NULL)
+	    g_cond_wait (&pipeline->wake, &pipeline->lock);
+	  else if (!g_cond_wait_until (&pipeline->wake, &pipeline->lock,
+				       g_get_monotonic_time ()
+				       + STATISTICS_POLL_INTERVAL))
+	    break;
 	}
+      g_atomic_int_set (&pipeline->waiting, 0);
+      g_mutex_unlock (&pipeline->lock);
+    }
 
-      // Set the one and only configuration on the device (to be sure).
-      libusb_set_configuration (handle, 1);
+  if (pipeline->statistics_output != NULL)
+    usb_statistics_write_json (statistics, pipeline->name,
+			       pipeline->statistics_output);
 
-      // Claim the HID interface.
-      if (!(libusb_claim_interface (handle, 0) == 0))
-	puts ("Failed to claim HID interface.");
+  return NULL;
+}
 
-      // Some kind of handshaking.
-      // Values obtained by sniffing the USB connection between SketchManager and the device.
-      unsigned char usb_data[33];
-      memset (&usb_data, '\0', 33);
-      memcpy (&usb_data, "\x80\x01\x03\x01\x02\x00\x00\x00", 8);
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_STOP_CONSUMER                                              |
+ | This function makes the consumer thread return once the ring buffer is    |
+ | empty.                                                                     |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_stop_consumer (usb_online_mode_pipeline* pipeline)
+{
+  g_mutex_lock (&pipeline->lock);
+  g_atomic_int_set (&pipeline->running, 0);
+  g_cond_signal (&pipeline->wake);
+  g_mutex_unlock (&pipeline->lock);
+}
 
-      int bytes = 0;
-      bytes += libusb_control_transfer (handle, 0x21, 9, 0x0380, 0, usb_data, 33, 0);
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_PUSH_REPORT                                                |
+ | This function hands a report over to the consumer thread. Returns 0 when   |
+ | the ring buffer is full.                                                   |
+ '----------------------------------------------------------------------------*/
+static int
+usb_online_mode_push_report (usb_online_mode_pipeline* pipeline,
+			     const usb_report* report)
+{
+  if (!usb_ring_buffer_push (&pipeline->ring, report))
+    return 0;
 
-      memcpy (&usb_data, "\x80\x01\x0a\x01\x01\x0b\x01\x00", 8);	
-      bytes += libusb_control_transfer (handle, 0x21, 9, 0x0380, 0, usb_data, 33, 0);
+  if (g_atomic_int_get (&pipeline->waiting))
+    {
+      g_mutex_lock (&pipeline->lock);
+      g_cond_signal (&pipeline->wake);
+      g_mutex_unlock (&pipeline->lock);
+    }
 
-      memset (&usb_data, '\0', 33);
-      bytes += libusb_control_transfer (handle, 0xa1, 1, 0x0380, 0, usb_data, 33, 0);
+  return 1;
+}
 
-      memcpy (&usb_data, "\x80\x01\x0b\x01\x00\x00\x00\x00", 8);
-      bytes += libusb_control_transfer (handle, 0x21, 9, 0x0380, 0, usb_data, 33, 0);
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_TRANSFER_DONE                                              |
+ | This function is called by libusb when an interrupt transfer completes.    |
+ | It hands the report over to the consumer and queues the transfer again.    |
+ '----------------------------------------------------------------------------*/
+static void LIBUSB_CALL
+usb_online_mode_transfer_done (struct libusb_transfer* transfer)
+{
+  usb_online_mode_pipeline* pipeline = (usb_online_mode_pipeline*)transfer->user_data;
 
-      memcpy (&usb_data, "\x80\x01\x02\x01\x01\x00\x00\x00", 8);
-      bytes += libusb_control_transfer (handle, 0x21, 9, 0x0380, 0, usb_data, 33, 0);
+  switch (transfer->status)
+    {
+    case LIBUSB_TRANSFER_COMPLETED:
+      {
+	usb_statistics_count (&pipeline->statistics.received);
 
-      memcpy (&usb_data, "\x80\x01\x0a\x01\x01\x02\x01\x00", 8);
-      bytes += libusb_control_transfer (handle, 0x21, 9, 0x0380, 0, usb_data, 33, 0);
+	// Only process complete packets.
+	if (transfer->actual_length != USB_REPORT_SIZE)
+	  {
+	    usb_statistics_count (&pipeline->statistics.incomplete);
+	    break;
+	  }
 
-      memset (&usb_data, '\0', 33);
-      bytes += libusb_control_transfer (handle, 0xa1, 1, 0x0380, 0, usb_data, 33, 0);
+	usb_report report;
+	report.time = g_get_monotonic_time ();
+	memcpy (report.data, transfer->buffer, USB_REPORT_SIZE);
 
-      // Assume that the incorrect amount of bytes returned indicates a
-      // handshake failure. 
-      if (bytes != 231)
-	{
-	  puts ("Device handshake failed.");
-	  goto device_release;
-	}
+	if (!usb_online_mode_push_report (pipeline, &report))
+	  usb_statistics_count (&pipeline->statistics.dropped);
+      }
+      break;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+      if (g_atomic_int_get (&pipeline->running))
+	printf ("%s disconnected.\n", pipeline->name);
+      g_atomic_int_set (&pipeline->running, 0);
+      break;
+    case LIBUSB_TRANSFER_CANCELLED:
+      break;
+    default:
+      usb_statistics_count (&pipeline->statistics.transfer_errors);
+      break;
+    }
 
-      /*----------------------------------------------------------------------.
-       | SET UP A VIRTUAL MOUSE DEVICE USING UINPUT.                          |
-       '----------------------------------------------------------------------*/
+  if (g_atomic_int_get (&pipeline->running)
+      && libusb_submit_transfer (transfer) == 0)
+    return;
 
-      int virtual_mouse_desc;
-      virtual_mouse_desc = open ("/dev/uinput", O_WRONLY | O_NONBLOCK);
+  pipeline->pending--;
+}
 
-      // Enable the virtual mouse device features we need.
-      if (virtual_mouse_desc < 0
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_REQUEST_STATISTICS                                         |
+ | This signal handler asks the consumer thread to write its statistics.      |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_request_statistics (int signal_number)
+{
+  (void)signal_number;
+  usb_statistics_request ();
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_OPEN_STATISTICS                                            |
+ | This function opens the stream to write the statistics to. "-" stands for |
+ | the standard output. It also makes SIGUSR1 ask for the statistics.         |
+ '----------------------------------------------------------------------------*/
+static FILE*
+usb_online_mode_open_statistics (const char* statistics_to)
+{
+  FILE* stream = stdout;
+  if (strcmp (statistics_to, "-") != 0)
+    stream = fopen (statistics_to, "a");
 
-	  // Key events are the base for the rest.
-	  || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_EVBIT, EV_KEY) == 0
+  if (stream == NULL)
+    {
+      printf ("Couldn't open '%s' to write the statistics to.\n", statistics_to);
+      return NULL;
+    }
 
-	  // Enable support for mouse buttons.
-	  || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_KEYBIT, BTN_MOUSE) == 0
-	  || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_KEYBIT, BTN_LEFT) == 0
-	  || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_KEYBIT, BTN_RIGHT) == 0
+  struct sigaction action;
+  memset (&action, 0, sizeof (action));
+  action.sa_handler = usb_online_mode_request_statistics;
+  action.sa_flags = SA_RESTART;
+  sigemptyset (&action.sa_mask);
+  sigaction (SIGUSR1, &action, NULL);
 
-	  // Enable absolute coordinate positioning.
-	  || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_EVBIT, EV_ABS) == 0
-	  || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_ABSBIT, ABS_X) == 0
-	  || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_ABSBIT, ABS_Y) == 0
+  return stream;
+}
 
-	  // Enable tilt features.
-	  || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_ABSBIT, ABS_TILT_X) == 0
-	  || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_ABSBIT, ABS_TILT_Y) == 0
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_CLOSE_STATISTICS                                           |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_close_statistics (FILE* stream)
+{
+  if (stream == NULL) return;
 
-	  // Enable pressure features.
-	  || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_ABSBIT, ABS_PRESSURE) == 0)
-	goto device_release;
+  signal (SIGUSR1, SIG_DFL);
+  if (stream != stdout)
+    fclose (stream);
+}
 
-      struct uinput_user_dev uidev;
-      memset (&uidev, 0, sizeof (uidev));
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_START_PIPELINE                                             |
+ | This function starts the consumer thread. The statistics are written to   |
+ | 'statistics_output' when it isn't NULL. Returns NULL when the recording or |
+ | capture file couldn't be created.                                          |
+ '----------------------------------------------------------------------------*/
+static GThread*
+usb_online_mode_start_pipeline (usb_online_mode_pipeline* pipeline,
+				int virtual_mouse_desc, const char* name,
+				const char* record_to, const char* capture_to,
+				FILE* statistics_output, dt_configuration* settings)
+{
+  memset (pipeline, 0, sizeof (usb_online_mode_pipeline));
 
-      snprintf (uidev.name, UINPUT_MAX_NAME_SIZE, "inkling-virtual");
-      uidev.id.bustype = BUS_USB;
-      uidev.id.vendor  = 0x1;//0x056a;
-      uidev.id.product = 0x1;//0x0221;
-      uidev.id.version = 1;
+  if (record_to != NULL)
+    {
+      pipeline->recording = usb_recording_new (record_to, settings);
+      if (pipeline->recording == NULL) return NULL;
+    }
 
-      if (write (virtual_mouse_desc, &uidev, sizeof (uidev)) < 0)
+  if (capture_to != NULL)
+    {
+      pipeline->capture = usb_capture_create (capture_to);
+      if (pipeline->capture == NULL)
 	{
-	  puts ("Failed to set up the virtual mouse device");
-	  goto device_release;
+	  usb_recording_free (pipeline->recording);
+	  return NULL;
 	}
+    }
 
-      if (ioctl (virtual_mouse_desc, UI_DEV_CREATE) < 0)
-	{
-	  puts ("Failed to register the virtual mouse device");
-	  goto device_release;
-	}
+  pipeline->statistics_output = statistics_output;
+  pipeline->statistics_interval
+    = (gint64)settings->statistics_interval * G_USEC_PER_SEC;
 
-      // Define the device ranges.
-      uidev.absmin[ABS_X] = 0;
-      uidev.absmax[ABS_X] = 1920;
-      uidev.absmin[ABS_Y] = 0;
-      uidev.absmax[ABS_Y] = 1920;
-      uidev.absmin[ABS_PRESSURE] = 0;
-      uidev.absmax[ABS_PRESSURE] = 1024;
-      uidev.absmin[ABS_TILT_X] = 0; 
-      uidev.absmax[ABS_TILT_X] = 255;
-      uidev.absmin[ABS_TILT_Y] = 0; 
-      uidev.absmax[ABS_TILT_Y] = 255;
-
-      int click_state = 0;
-
-      while (1)
-	{
-	  // Allocate some space for receiving data.
-	  unsigned char data[10];
-	  memset (&data, '\0', 10);
+  pipeline->name = name;
+  usb_filter_init (&pipeline->filter, settings);
 
-	  int transferred;
-	  int inter_status;
+  usb_ring_buffer_init (&pipeline->ring);
+  g_mutex_init (&pipeline->lock);
+  g_cond_init (&pipeline->wake);
+  pipeline->virtual_mouse_desc = virtual_mouse_desc;
+  pipeline->running = 1;
 
-	  // Request coordinate and pressure data.
-	  inter_status = libusb_interrupt_transfer (handle, 0x83, data, 10, &transferred, 0);
-	  if (inter_status == LIBUSB_ERROR_NO_DEVICE)
-	    {
-	      puts ("Device disconnected.");
-	      goto device_release;
-	    }
+  return g_thread_new ("online-mode", usb_online_mode_consumer, pipeline);
+}
 
-	  // Only process complete packets.
-	  if (transferred != 10) continue;
-
-	  // Only process "Pen" packets.
-	  if (data[0] != 0x02) continue;
-
-	  // The coordinates are segmented in 7 pieces of 1 byte.
-	  // An extra byte indicates which in which segment the pen is.
-	  // Thus, the right value can be obtained by this formula:
-	  // segment * 2^8 + x
-	  int x = data[2] * 256 + data[1];
-	  int y = (data[4] * 256 + data[3]) * -1;
-
-	  int tilt_x = data[8];
-	  int tilt_y = data[9];
-
-	  // Same formula applies to pressure data.
-	  // segment * 2^8 + pressure
-	  // "segment" can vary between 0 and 3, giving us values
-	  // between 0 and 1024.
-	  int pressure = data[6];
-	  pressure = pressure + 256 * data[7];
-	  
-	  //printf ("%-5d %-5d %-5d %-5d %-5d %-5d\n", data[5], x, y, pressure, tilt_x, tilt_y);
-
-	  // Move the mouse pointer with our virtual mouse device.
-	  struct input_event ev[5];
-	  memset (ev, 0, sizeof (ev));
-
-	  ev[0].type = EV_ABS;
-	  ev[0].code = ABS_X;
-	  ev[0].value = abs (x);
-	  ev[1].type = EV_ABS;
-	  ev[1].code = ABS_Y;
-	  ev[1].value = abs (y);
-	  ev[2].type = EV_ABS;
-	  ev[2].code = ABS_PRESSURE;
-	  ev[2].value = pressure;
-	  ev[3].type = EV_ABS;
-	  ev[3].code = ABS_TILT_X;
-	  ev[3].value = tilt_x;
-	  ev[4].type = EV_ABS;
-	  ev[4].code = ABS_TILT_Y;
-	  ev[4].value = tilt_y;
-
-	  if (write (virtual_mouse_desc, ev, sizeof (ev)) < 1)
-	    puts ("Failed to move the mouse pointer.");
-
-	  // Do a mouse click when needed.
-	  if (pressure > 5)
-	    {
-	      click_state = 1;
-	      struct input_event click;
-	      click.type = EV_KEY;
-	      click.code = BTN_LEFT;
-	      click.value = 1;
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_FINISH_PIPELINE                                            |
+ | This function waits for the consumer thread to handle the reports that    |
+ | are left, and writes the recording.                                        |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_finish_pipeline (usb_online_mode_pipeline* pipeline,
+				 GThread* consumer)
+{
+  usb_online_mode_stop_consumer (pipeline);
+  g_thread_join (consumer);
 
-	      if (write (virtual_mouse_desc, &click, sizeof (click)) < 1)
-		puts ("Failed to do a click event.");
+  usb_recording_free (pipeline->recording), pipeline->recording = NULL;
+  usb_capture_close (pipeline->capture), pipeline->capture = NULL;
+  g_mutex_clear (&pipeline->lock);
+  g_cond_clear (&pipeline->wake);
 
-	    }
-	  else if (click_state == 1)
-	    {
-	      click_state = 0;
-	      struct input_event click;
-	      click.type = EV_KEY;
-	      click.code = BTN_LEFT;
-	      click.value = 0;
-
-	      if (write (virtual_mouse_desc, &click, sizeof (click)) < 1)
-		puts ("Failed to do a click event.");
-	    }
-	}
+  if (pipeline->statistics.dropped > 0)
+    printf ("%s: Dropped %d reports because they could not be handled in "
+	    "time.\n", pipeline->name, pipeline->statistics.dropped);
+}
 
-    device_release:
-      libusb_release_interface (handle, 0);
-      libusb_reset_device (handle);
-      ioctl (virtual_mouse_desc, UI_DEV_DESTROY);
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_CREATE_VIRTUAL_MOUSE                                       |
+ | This function sets up a virtual mouse device using uinput. Returns its     |
+ | file descriptor, or -1 when it couldn't be created.                        |
+ '----------------------------------------------------------------------------*/
+static int
+usb_online_mode_create_virtual_mouse (int number)
+{
+  int virtual_mouse_desc;
+  virtual_mouse_desc = open ("/dev/uinput", O_WRONLY | O_NONBLOCK);
+  if (virtual_mouse_desc < 0) return -1;
+
+  // Enable the virtual mouse device features we need.
+  if (// Key events are the base for the rest.
+      usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_EVBIT, EV_KEY) == 0
+
+      // Enable support for mouse buttons.
+      || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_KEYBIT, BTN_MOUSE) == 0
+      || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_KEYBIT, BTN_LEFT) == 0
+      || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_KEYBIT, BTN_RIGHT) == 0
+
+      // Enable absolute coordinate positioning.
+      || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_EVBIT, EV_ABS) == 0
+      || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_ABSBIT, ABS_X) == 0
+      || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_ABSBIT, ABS_Y) == 0
+
+      // Enable tilt features.
+      || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_ABSBIT, ABS_TILT_X) == 0
+      || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_ABSBIT, ABS_TILT_Y) == 0
+
+      // Enable pressure features.
+      || usb_online_mode_mouse_enable_feature (virtual_mouse_desc, UI_SET_ABSBIT, ABS_PRESSURE) == 0)
+    {
+      close (virtual_mouse_desc);
+      return -1;
+    }
+
+  struct uinput_user_dev uidev;
+  memset (&uidev, 0, sizeof (uidev));
+
+  // The first device keeps the name it always had, so that existing input
+  // configurations keep matching it.
+  if (number > 1)
+    snprintf (uidev.name, UINPUT_MAX_NAME_SIZE, "inkling-virtual-%d", number);
+  else
+    snprintf (uidev.name, UINPUT_MAX_NAME_SIZE, "inkling-virtual");
+  uidev.id.bustype = BUS_USB;
+  uidev.id.vendor  = 0x1;//0x056a;
+  uidev.id.product = 0x1;//0x0221;
+  uidev.id.version = 1;
+
+  if (write (virtual_mouse_desc, &uidev, sizeof (uidev)) < 0)
+    {
+      puts ("Failed to set up the virtual mouse device");
+      close (virtual_mouse_desc);
+      return -1;
+    }
+
+  if (ioctl (virtual_mouse_desc, UI_DEV_CREATE) < 0)
+    {
+      puts ("Failed to register the virtual mouse device");
       close (virtual_mouse_desc);
+      return -1;
+    }
+
+  // Define the device ranges.
+  uidev.absmin[ABS_X] = 0;
+  uidev.absmax[ABS_X] = 1920;
+  uidev.absmin[ABS_Y] = 0;
+  uidev.absmax[ABS_Y] = 1920;
+  uidev.absmin[ABS_PRESSURE] = 0;
+  uidev.absmax[ABS_PRESSURE] = 1024;
+  uidev.absmin[ABS_TILT_X] = 0; 
+  uidev.absmax[ABS_TILT_X] = 255;
+  uidev.absmin[ABS_TILT_Y] = 0; 
+  uidev.absmax[ABS_TILT_Y] = 255;
+
+  return virtual_mouse_desc;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_DESTROY_VIRTUAL_MOUSE                                      |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_destroy_virtual_mouse (int virtual_mouse_desc)
+{
+  if (virtual_mouse_desc < 0) return;
+
+  ioctl (virtual_mouse_desc, UI_DEV_DESTROY);
+  close (virtual_mouse_desc);
+}
+
+/*----------------------------------------------------------------------------.
+ | DEVICES                                                                    |
+ | -------------------------------------------------------------------------- |
+ |                                                                            |
+ | Every connected Inkling gets its own virtual mouse, consumer thread and    |
+ | statistics. The libusb events of all devices are handled by the calling   |
+ | thread. When libusb supports it, devices that are plugged in or pulled    |
+ | out while online mode runs are picked up as well.                          |
+ '----------------------------------------------------------------------------*/
+
+#define INKLING_VENDOR_ID  0x056a
+#define INKLING_PRODUCT_ID 0x0221
+
+/* How long to wait for USB events before looking at new devices again. */
+#define EVENT_TIMEOUT 250000
+
+typedef struct
+{
+  libusb_device* device;
+  libusb_device_handle* handle;
+  int virtual_mouse_desc;
+  char name[64];
+
+  /* The files of this device, which differ per device. */
+  char* record_to;
+  char* capture_to;
+
+  usb_online_mode_pipeline pipeline;
+  GThread* consumer;
+  struct libusb_transfer* transfers[NUM_TRANSFERS];
+  unsigned char buffers[NUM_TRANSFERS][USB_REPORT_SIZE];
+} usb_online_mode_device;
+
+/* The devices that are being served, and those that were plugged in but
+ * haven't been opened yet. Both are only used from the calling thread. */
+static GSList* devices = NULL;
+static GSList* arrived = NULL;
+
+/* Counts the devices that were opened, to give each a different name. */
+static int device_count = 0;
+
+static volatile sig_atomic_t stop_online_mode = 0;
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_STOP                                                       |
+ | This signal handler makes online mode stop.                                |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_stop (int signal_number)
+{
+  (void)signal_number;
+  stop_online_mode = 1;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_DEVICE_FILE                                                |
+ | This function returns the file a device should write to. The first device |
+ | uses 'filename' as is, the others get their number added before the file  |
+ | extension, so that the format stays the same.                              |
+ '----------------------------------------------------------------------------*/
+static char*
+usb_online_mode_device_file (const char* filename, int number)
+{
+  if (filename == NULL) return NULL;
+  if (number == 1) return g_strdup (filename);
+
+  const char* extension = strrchr (filename, '.');
+  const char* directory = strrchr (filename, '/');
+  if (extension == NULL || (directory != NULL && extension < directory))
+    return g_strdup_printf ("%s-%d", filename, number);
+
+  return g_strdup_printf ("%.*s-%d%s", (int)(extension - filename), filename,
+			  number, extension);
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_HANDSHAKE                                                  |
+ | This function puts the device in online mode. Returns 0 on success.        |
+ '----------------------------------------------------------------------------*/
+static int
+usb_online_mode_handshake (libusb_device_handle* handle)
+{
+  // Reset the device so we have a predictable state.
+  libusb_reset_device (handle);
+
+  // Check whether the kernel has assigned a driver to it.
+  if (libusb_kernel_driver_active (handle, 0))
+    {
+      printf ("Detaching kernel driver..\t");
+      (libusb_detach_kernel_driver (handle, 0) == 0)
+	? puts ("OK")
+	: puts ("FAILED");
+    }
+
+  // Set the one and only configuration on the device (to be sure).
+  libusb_set_configuration (handle, 1);
+
+  // Claim the HID interface.
+  if (!(libusb_claim_interface (handle, 0) == 0))
+    puts ("Failed to claim HID interface.");
+
+  // Some kind of handshaking.
+  // Values obtained by sniffing the USB connection between SketchManager and the device.
+  unsigned char usb_data[33];
+  memset (&usb_data, '\0', 33);
+  memcpy (&usb_data, "\x80\x01\x03\x01\x02\x00\x00\x00", 8);
+
+  int bytes = 0;
+  bytes += libusb_control_transfer (handle, 0x21, 9, 0x0380, 0, usb_data, 33, 0);
+
+  memcpy (&usb_data, "\x80\x01\x0a\x01\x01\x0b\x01\x00", 8);
+  bytes += libusb_control_transfer (handle, 0x21, 9, 0x0380, 0, usb_data, 33, 0);
+
+  memset (&usb_data, '\0', 33);
+  bytes += libusb_control_transfer (handle, 0xa1, 1, 0x0380, 0, usb_data, 33, 0);
+
+  memcpy (&usb_data, "\x80\x01\x0b\x01\x00\x00\x00\x00", 8);
+  bytes += libusb_control_transfer (handle, 0x21, 9, 0x0380, 0, usb_data, 33, 0);
+
+  memcpy (&usb_data, "\x80\x01\x02\x01\x01\x00\x00\x00", 8);
+  bytes += libusb_control_transfer (handle, 0x21, 9, 0x0380, 0, usb_data, 33, 0);
+
+  memcpy (&usb_data, "\x80\x01\x0a\x01\x01\x02\x01\x00", 8);
+  bytes += libusb_control_transfer (handle, 0x21, 9, 0x0380, 0, usb_data, 33, 0);
+
+  memset (&usb_data, '\0', 33);
+  bytes += libusb_control_transfer (handle, 0xa1, 1, 0x0380, 0, usb_data, 33, 0);
+
+  // Assume that the incorrect amount of bytes returned indicates a
+  // handshake failure.
+  if (bytes != 231)
+    {
+      puts ("Device handshake failed.");
+      return 1;
+    }
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_FREE_DEVICE                                                |
+ | This function releases everything of a device. Its transfers must have    |
+ | stopped already.                                                           |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_free_device (usb_online_mode_device* device)
+{
+  int index;
+  for (index = 0; index < NUM_TRANSFERS; index++)
+    if (device->transfers[index] != NULL)
+      libusb_free_transfer (device->transfers[index]);
+
+  if (device->consumer != NULL)
+    usb_online_mode_finish_pipeline (&device->pipeline, device->consumer);
+
+  if (device->handle != NULL)
+    {
+      libusb_release_interface (device->handle, 0);
+      libusb_reset_device (device->handle);
+      libusb_close (device->handle);
+    }
+
+  usb_online_mode_destroy_virtual_mouse (device->virtual_mouse_desc);
+  libusb_unref_device (device->device);
+  g_free (device->record_to);
+  g_free (device->capture_to);
+  g_free (device);
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_OPEN_DEVICE                                                |
+ | This function puts a device in online mode and starts receiving its pen   |
+ | data. Returns NULL when that didn't work out.                              |
+ '----------------------------------------------------------------------------*/
+static usb_online_mode_device*
+usb_online_mode_open_device (libusb_device* found,
+			     const usb_online_mode_options* options,
+			     FILE* statistics_output, dt_configuration* settings)
+{
+  usb_online_mode_device* device = g_new0 (usb_online_mode_device, 1);
+  device->device = libusb_ref_device (found);
+  device->virtual_mouse_desc = -1;
+
+  int error = libusb_open (found, &device->handle);
+  if (error || device->handle == NULL)
+    {
+      puts ("Opening the USB device failed. You might need super user "
+	    "permissions.");
+      device->handle = NULL;
+      usb_online_mode_free_device (device);
+      return NULL;
+    }
+
+  if (usb_online_mode_handshake (device->handle))
+    {
+      usb_online_mode_free_device (device);
+      return NULL;
+    }
+
+  int number = ++device_count;
+  snprintf (device->name, sizeof (device->name), "Inkling %d (bus %d, port %d)",
+	    number, libusb_get_bus_number (found), libusb_get_port_number (found));
+
+  device->virtual_mouse_desc = usb_online_mode_create_virtual_mouse (number);
+  if (device->virtual_mouse_desc < 0)
+    {
+      usb_online_mode_free_device (device);
+      return NULL;
+    }
+
+  device->record_to = usb_online_mode_device_file (options->record_to, number);
+  device->capture_to = usb_online_mode_device_file (options->capture_to, number);
+  device->consumer = usb_online_mode_start_pipeline (&device->pipeline,
+						     device->virtual_mouse_desc,
+						     device->name,
+						     device->record_to,
+						     device->capture_to,
+						     statistics_output, settings);
+  if (device->consumer == NULL)
+    {
+      usb_online_mode_free_device (device);
+      return NULL;
+    }
+
+  // Keep several transfers queued, so the device always has somewhere
+  // to put its next report while we handle the previous one.
+  int index;
+  for (index = 0; index < NUM_TRANSFERS; index++)
+    {
+      device->transfers[index] = libusb_alloc_transfer (0);
+      if (device->transfers[index] == NULL) continue;
+
+      libusb_fill_interrupt_transfer (device->transfers[index], device->handle,
+				      0x83, device->buffers[index],
+				      USB_REPORT_SIZE,
+				      usb_online_mode_transfer_done,
+				      &device->pipeline, 0);
+
+      if (libusb_submit_transfer (device->transfers[index]) == 0)
+	device->pipeline.pending++;
+    }
+
+  if (device->pipeline.pending == 0)
+    {
+      puts ("Failed to request pen data from the device.");
+      usb_online_mode_free_device (device);
+      return NULL;
+    }
+
+  printf ("%s is in online mode.\n", device->name);
+  return device;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_STOP_DEVICE                                                |
+ | This function stops queuing transfers for a device and cancels the ones   |
+ | that are queued. The device can be freed once they all came back.         |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_stop_device (usb_online_mode_device* device)
+{
+  g_atomic_int_set (&device->pipeline.running, 0);
+
+  int index;
+  for (index = 0; index < NUM_TRANSFERS; index++)
+    if (device->transfers[index] != NULL)
+      libusb_cancel_transfer (device->transfers[index]);
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_HOTPLUG                                                    |
+ | This function is called by libusb when an Inkling is plugged in or pulled  |
+ | out. Devices can't be opened from here, so they are opened later on.      |
+ '----------------------------------------------------------------------------*/
+static int LIBUSB_CALL
+usb_online_mode_hotplug (libusb_context* context, libusb_device* found,
+			 libusb_hotplug_event event, void* user_data)
+{
+  (void)context;
+  (void)user_data;
+
+  if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+    {
+      arrived = g_slist_append (arrived, libusb_ref_device (found));
+      return 0;
+    }
+
+  // The device may have left before it was opened.
+  if (g_slist_find (arrived, found) != NULL)
+    {
+      arrived = g_slist_remove (arrived, found);
+      libusb_unref_device (found);
+    }
+
+  GSList* iterator;
+  for (iterator = devices; iterator != NULL; iterator = iterator->next)
+    {
+      usb_online_mode_device* device = iterator->data;
+      if (device->device == found)
+	usb_online_mode_stop_device (device);
+    }
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_FIND_DEVICES                                               |
+ | This function looks for the devices that are connected right now. It is  |
+ | used when libusb can't tell when devices are plugged in.                   |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_find_devices ()
+{
+  // Traverse the list of connected USB devices. We are only interested in the
+  // Inkling which has the vendor ID "0x056a" and the product ID "0x0221".
+  libusb_device **list;
+  ssize_t count = libusb_get_device_list (NULL, &list);
+  ssize_t iterator = 0;
+
+  if (count < 0)
+    {
+      puts ("Cannot get the USB device list. Did you plug in your Inkling?");
+      return;
+    }
+
+  for (iterator = 0; iterator < count; iterator++)
+    {
+      struct libusb_device_descriptor descriptor;
+      libusb_get_device_descriptor (list[iterator], &descriptor);
+      if (descriptor.idVendor == INKLING_VENDOR_ID
+	  && descriptor.idProduct == INKLING_PRODUCT_ID)
+	arrived = g_slist_append (arrived, libusb_ref_device (list[iterator]));
     }
 
- free_device_list:
   libusb_free_device_list (list, 1);
 }
 
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_FREE_STOPPED_DEVICES                                       |
+ | This function frees the devices that have no transfers left.               |
+ '----------------------------------------------------------------------------*/
+static void
+usb_online_mode_free_stopped_devices ()
+{
+  GSList* iterator = devices;
+  while (iterator != NULL)
+    {
+      usb_online_mode_device* device = iterator->data;
+      iterator = iterator->next;
+
+      if (device->pipeline.pending > 0) continue;
+
+      devices = g_slist_remove (devices, device);
+      usb_online_mode_free_device (device);
+    }
+}
+
+void
+usb_online_mode_init (const usb_online_mode_options* options,
+		      dt_configuration* settings)
+{
+  if (libusb_init (NULL))
+    {
+      puts ("Initializing libUSB failed.");
+      return;
+    }
+
+  FILE* statistics_output = NULL;
+  if (options->statistics_to != NULL)
+    {
+      statistics_output = usb_online_mode_open_statistics (options->statistics_to);
+      if (statistics_output == NULL) return;
+    }
+
+  // Stop gracefully on Ctrl+C or when the service is stopped. The handler is
+  // installed without SA_RESTART so waiting for events returns at once.
+  struct sigaction action;
+  memset (&action, 0, sizeof (action));
+  action.sa_handler = usb_online_mode_stop;
+  sigemptyset (&action.sa_mask);
+  sigaction (SIGINT, &action, NULL);
+  sigaction (SIGTERM, &action, NULL);
+  stop_online_mode = 0;
+
+  // With hot-plug support, the devices that are connected already are
+  // announced right away as well.
+  libusb_hotplug_callback_handle callback;
+  int hotplug = libusb_has_capability (LIBUSB_CAP_HAS_HOTPLUG)
+    && libusb_hotplug_register_callback (NULL,
+					 LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+					 | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+					 LIBUSB_HOTPLUG_ENUMERATE,
+					 INKLING_VENDOR_ID, INKLING_PRODUCT_ID,
+					 LIBUSB_HOTPLUG_MATCH_ANY,
+					 usb_online_mode_hotplug, NULL,
+					 &callback) == LIBUSB_SUCCESS;
+  if (!hotplug)
+    usb_online_mode_find_devices ();
+
+  if (arrived == NULL)
+    {
+      if (hotplug)
+	puts ("Waiting for an Inkling to be plugged in. Press Ctrl+C to stop.");
+      else
+	puts ("Cannot find an Inkling. Did you plug in your Inkling?");
+    }
+
+  while (!stop_online_mode)
+    {
+      while (arrived != NULL)
+	{
+	  libusb_device* found = arrived->data;
+	  arrived = g_slist_remove (arrived, found);
+
+	  usb_online_mode_device* device;
+	  device = usb_online_mode_open_device (found, options,
+						statistics_output, settings);
+	  if (device != NULL)
+	    devices = g_slist_append (devices, device);
+
+	  libusb_unref_device (found);
+	}
+
+      // Without hot-plug support, nothing is left to do once the devices
+      // are gone.
+      if (!hotplug && devices == NULL) break;
+
+      struct timeval timeout = { 0, EVENT_TIMEOUT };
+      int error = libusb_handle_events_timeout_completed (NULL, &timeout, NULL);
+      if (error < 0 && error != LIBUSB_ERROR_INTERRUPTED) break;
+
+      usb_online_mode_free_stopped_devices ();
+    }
+
+  if (hotplug)
+    libusb_hotplug_deregister_callback (NULL, callback);
+
+  // Wait for the outstanding transfers to be cancelled before freeing them.
+  GSList* iterator;
+  for (iterator = devices; iterator != NULL; iterator = iterator->next)
+    usb_online_mode_stop_device (iterator->data);
+
+  while (devices != NULL)
+    {
+      struct timeval timeout = { 0, EVENT_TIMEOUT };
+      int error = libusb_handle_events_timeout_completed (NULL, &timeout, NULL);
+      if (error < 0 && error != LIBUSB_ERROR_INTERRUPTED) break;
+
+      usb_online_mode_free_stopped_devices ();
+    }
+
+  g_slist_free_full (arrived, (GDestroyNotify)libusb_unref_device);
+  arrived = NULL;
+
+  signal (SIGINT, SIG_DFL);
+  signal (SIGTERM, SIG_DFL);
+  usb_online_mode_close_statistics (statistics_output);
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_ONLINE_MODE_REPLAY                                                     |
+ | This function feeds the reports in a capture file through the same decode  |
+ | and uinput path as online mode, and measures how long each report takes.   |
+ '----------------------------------------------------------------------------*/
+int
+usb_online_mode_replay (const char* filename, double speed,
+			const usb_online_mode_options* options,
+			dt_configuration* settings)
+{
+  usb_capture* capture = usb_capture_open (filename);
+  if (capture == NULL) return 1;
+
+  // Without uinput (for example on a build machine), the frames are written
+  // to /dev/null so that the same work is done.
+  int virtual_mouse_desc = usb_online_mode_create_virtual_mouse (1);
+  int has_virtual_mouse = (virtual_mouse_desc >= 0);
+  if (!has_virtual_mouse)
+    {
+      puts ("Couldn't create the virtual mouse device. The events are discarded.");
+      virtual_mouse_desc = open ("/dev/null", O_WRONLY);
+    }
+
+  FILE* statistics_output = NULL;
+  if (options->statistics_to != NULL)
+    statistics_output = usb_online_mode_open_statistics (options->statistics_to);
+
+  // Replaying into the capture file that is being read makes no sense.
+  usb_online_mode_pipeline pipeline;
+  GThread* consumer = NULL;
+  if (options->statistics_to == NULL || statistics_output != NULL)
+    consumer = usb_online_mode_start_pipeline (&pipeline, virtual_mouse_desc,
+					       filename, options->record_to, NULL,
+					       statistics_output, settings);
+  if (consumer == NULL)
+    {
+      usb_online_mode_close_statistics (statistics_output);
+
+      if (has_virtual_mouse)
+	usb_online_mode_destroy_virtual_mouse (virtual_mouse_desc);
+      else if (virtual_mouse_desc >= 0)
+	close (virtual_mouse_desc);
+
+      usb_capture_close (capture);
+      return 1;
+    }
+
+  usb_report report;
+  unsigned int count = 0;
+  gint64 start = g_get_monotonic_time ();
+
+  while (usb_capture_read (capture, &report))
+    {
+      // Wait until the report is due. A speed of 0 replays the reports as
+      // fast as the consumer can handle them.
+      if (speed > 0)
+	{
+	  gint64 due = start + (gint64)(report.time / speed);
+	  gint64 now = g_get_monotonic_time ();
+	  if (due > now) g_usleep (due - now);
+	}
+
+      report.time = g_get_monotonic_time ();
+      if (speed > 0)
+	{
+	  // Like the device, don't wait when the consumer falls behind.
+	  if (!usb_online_mode_push_report (&pipeline, &report))
+	    usb_statistics_count (&pipeline.statistics.dropped);
+	}
+      else
+	while (!usb_online_mode_push_report (&pipeline, &report))
+	  g_thread_yield ();
+
+      count++;
+    }
+
+  gint64 duration = g_get_monotonic_time () - start;
+  usb_online_mode_finish_pipeline (&pipeline, consumer);
+  usb_online_mode_close_statistics (statistics_output);
+
+  printf ("Replayed %u reports in %.3f seconds.\n", count,
+	  duration / (double)G_USEC_PER_SEC);
+  usb_histogram_print (&pipeline.statistics.latency, "Time from receiving a "
+		       "report to moving the mouse", stdout);
+  usb_histogram_print (&pipeline.statistics.processing, "Time to decode a "
+		       "report and move the mouse", stdout);
+
+  if (has_virtual_mouse)
+    usb_online_mode_destroy_virtual_mouse (virtual_mouse_desc);
+  else if (virtual_mouse_desc >= 0)
+    close (virtual_mouse_desc);
+
+  usb_capture_close (capture);
+  return 0;
+}
 
 void
 usb_online_mode_exit ()
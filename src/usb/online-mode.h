@@ -1,10 +1,53 @@
 #ifndef USB_ONLINE_MODE_H
 #define USB_ONLINE_MODE_H
 
+#include "../datatypes/configuration.h"
+
+/**
+ * The files that online mode writes to besides moving the mouse pointer.
+ * Each of them may be NULL.
+ */
+typedef struct
+{
+  /* The file to record the pen data to. */
+  const char* record_to;
+
+  /* The file to store the raw reports in (see usb_online_mode_replay()). */
+  const char* capture_to;
+
+  /* The file to write the statistics to as JSON lines, or "-" for the
+   * standard output. */
+  const char* statistics_to;
+} usb_online_mode_options;
+
+/**
+ * This function initializes the "online mode" of every connected device,
+ * and of devices that are plugged in later on. Each device gets its own
+ * virtual mouse, thread and statistics. The function returns when the
+ * program receives SIGINT or SIGTERM, or when all devices are gone and
+ * libusb can't tell when new ones are plugged in.
+ * @param options  The files to write to besides moving the mouse pointer.
+ *                 The second device writes to files with "-2" added before
+ *                 the extension, and so on.
+ * @param settings The settings to write the recording with.
+ */
+void usb_online_mode_init (const usb_online_mode_options* options,
+			   dt_configuration* settings);
+
 /**
- * This function initializes the "online mode" of the device.
+ * This function replays the reports of a capture file as if they came from
+ * the device, and prints how long it took to handle them. It doesn't need a
+ * device to be connected.
+ * @param filename The capture file to replay.
+ * @param speed    How many times faster than recorded to replay, or 0 to
+ *                 replay as fast as possible.
+ * @param options  The files to write to. The capture file is ignored.
+ * @param settings The settings to write the recording with.
+ * @return 0 when the file was replayed, 1 when something went wrong.
  */
-void usb_online_mode_init ();
+int usb_online_mode_replay (const char* filename, double speed,
+			    const usb_online_mode_options* options,
+			    dt_configuration* settings);
 
 /**
  * This function stops the "online mode" of the device.
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "recording.h"
+#include "../datatypes/element.h"
+#include "../datatypes/clock.h"
+#include "../high/conversion.h"
+#include "../parsers/wpi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+/*----------------------------------------------------------------------------.
+ | USB_RECORDING_APPEND                                                       |
+ | This function adds an element to the end of the recording.                 |
+ '----------------------------------------------------------------------------*/
+static void
+usb_recording_append (usb_recording* recording, void* element)
+{
+  if (element == NULL) return;
+
+  GSList* item = g_slist_prepend (NULL, element);
+  if (recording->last == NULL)
+    recording->data = item;
+  else
+    recording->last->next = item;
+
+  recording->last = item;
+  recording->changed = 1;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_RECORDING_APPEND_STROKE                                                |
+ '----------------------------------------------------------------------------*/
+static void
+usb_recording_append_stroke (usb_recording* recording, unsigned char value)
+{
+  dt_stroke* stroke = calloc (1, sizeof (dt_stroke));
+  if (stroke == NULL) return;
+
+  stroke->type = TYPE_STROKE;
+  stroke->value = value;
+  usb_recording_append (recording, stroke);
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_RECORDING_NEW                                                          |
+ '----------------------------------------------------------------------------*/
+usb_recording*
+usb_recording_new (const char* filename, dt_configuration* settings)
+{
+  unsigned int format = high_format_from_name (filename);
+  if (format == 0)
+    {
+      printf ("Cannot record to '%s', because its format is unknown.\n", filename);
+      return NULL;
+    }
+
+  usb_recording* recording = calloc (1, sizeof (usb_recording));
+  if (recording == NULL) return NULL;
+
+  recording->filename = strdup (filename);
+  recording->format = format;
+  recording->settings = settings;
+  recording->start = g_get_monotonic_time ();
+  recording->last_flush = recording->start;
+
+  return recording;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_RECORDING_ADD_SAMPLE                                                   |
+ '----------------------------------------------------------------------------*/
+void
+usb_recording_add_sample (usb_recording* recording, const usb_pen_sample* sample)
+{
+  if (recording == NULL) return;
+
+  double time = (sample->time - recording->start) / (double)G_USEC_PER_SEC;
+  int pen_down = (sample->pressure > USB_PEN_DOWN_PRESSURE);
+
+  /* Add a clock block for each second that passed, like the device does. */
+  unsigned short seconds = (unsigned short)time;
+  if (seconds != recording->seconds)
+    {
+      dt_clock* clock = calloc (1, sizeof (dt_clock));
+      if (clock != NULL)
+	{
+	  clock->type = TYPE_CLOCK;
+	  clock->counter = seconds;
+	  usb_recording_append (recording, clock);
+	}
+      recording->seconds = seconds;
+    }
+
+  if (pen_down && !recording->pen_down)
+    usb_recording_append_stroke (recording, BEGIN_STROKE);
+
+  if (pen_down)
+    {
+      dt_coordinate* coordinate = calloc (1, sizeof (dt_coordinate));
+      if (coordinate != NULL)
+	{
+	  /* Use the same units as p_wpi_parse(), so that the recording can be
+	   * drawn and written like a file from the device. */
+	  coordinate->type = TYPE_COORDINATE;
+	  coordinate->x = (short)sample->x + 5;
+	  coordinate->y = ((short)sample->y << 1) + 5;
+	  coordinate->time = time;
+	  usb_recording_append (recording, coordinate);
+	}
+
+      dt_pressure* pressure = calloc (1, sizeof (dt_pressure));
+      if (pressure != NULL)
+	{
+	  pressure->type = TYPE_PRESSURE;
+	  pressure->pressure = sample->pressure;
+	  usb_recording_append (recording, pressure);
+	}
+
+      if (sample->tilt_x + sample->tilt_y != 0)
+	{
+	  dt_tilt* tilt = calloc (1, sizeof (dt_tilt));
+	  if (tilt != NULL)
+	    {
+	      tilt->type = TYPE_TILT;
+	      tilt->x = sample->tilt_x;
+	      tilt->y = sample->tilt_y;
+	      usb_recording_append (recording, tilt);
+	    }
+	}
+    }
+  else if (recording->pen_down)
+    {
+      usb_recording_append_stroke (recording, END_STROKE);
+
+      /* Only write the file between strokes, so that the pointer doesn't
+       * lag behind the pen while it's drawing. */
+      unsigned int interval = recording->settings->record_interval;
+      if (interval > 0 && sample->time - recording->last_flush
+	  >= (gint64)interval * G_USEC_PER_SEC)
+	usb_recording_flush (recording);
+    }
+
+  recording->pen_down = pen_down;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_RECORDING_FLUSH                                                        |
+ '----------------------------------------------------------------------------*/
+int
+usb_recording_flush (usb_recording* recording)
+{
+  if (recording == NULL) return 1;
+
+  recording->last_flush = g_get_monotonic_time ();
+  if (!recording->changed) return 0;
+
+  /* Write to a temporary file first, so that a program that reads the
+   * recording never sees a partially written file. */
+  char* temporary = g_strconcat (recording->filename, ".XXXXXX", NULL);
+  int descriptor = g_mkstemp (temporary);
+  if (descriptor < 0)
+    {
+      printf ("Couldn't write to '%s'.\n", recording->filename);
+      g_free (temporary);
+      return 1;
+    }
+  close (descriptor);
+
+  /* Draw everything that was recorded so far. */
+  recording->settings->process_until = USHRT_MAX;
+
+  int status = high_export_format_to_file (recording->data, recording->format,
+					   temporary, recording->settings);
+  if (status == 0)
+    {
+#ifdef _WIN32
+      /* On Windows, rename() doesn't replace existing files. */
+      remove (recording->filename);
+#endif
+      status = (rename (temporary, recording->filename) != 0);
+    }
+
+  if (status != 0)
+    {
+      printf ("Couldn't write to '%s'.\n", recording->filename);
+      remove (temporary);
+    }
+  else
+    recording->changed = 0;
+
+  g_free (temporary);
+  return status;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_RECORDING_FREE                                                         |
+ '----------------------------------------------------------------------------*/
+void
+usb_recording_free (usb_recording* recording)
+{
+  if (recording == NULL) return;
+
+  /* Finish a stroke that is still going on. */
+  if (recording->pen_down)
+    usb_recording_append_stroke (recording, END_STROKE);
+
+  usb_recording_flush (recording);
+
+  p_wpi_cleanup (recording->data);
+  free (recording->filename);
+  free (recording);
+}
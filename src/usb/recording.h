@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   usb/recording.h
+ * @brief  Keep the pen data that arrives in online mode.
+ * @author Roel Janssen
+ */
+
+#ifndef USB_RECORDING_H
+#define USB_RECORDING_H
+
+#include <glib.h>
+#include "../datatypes/configuration.h"
+
+/**
+ * The pressure above which the pen is considered to touch the paper.
+ */
+#define USB_PEN_DOWN_PRESSURE 5
+
+/**
+ * This struct describes a single decoded pen report.
+ */
+typedef struct
+{
+  int x;
+  int y;
+  int pressure;
+  int tilt_x;
+  int tilt_y;
+
+  /* The monotonic time at which the report was handled, in microseconds. */
+  gint64 time;
+} usb_pen_sample;
+
+/**
+ * This struct holds a recording in the same form as p_wpi_parse() returns
+ * it, so that the converters can be used on it.
+ */
+typedef struct
+{
+  char* filename;
+  unsigned int format;
+  dt_configuration* settings;
+
+  /* The parsed data, and its last item so samples can be appended quickly. */
+  GSList* data;
+  GSList* last;
+
+  gint64 start;
+  gint64 last_flush;
+  unsigned short seconds;
+  int pen_down;
+  int changed;
+} usb_recording;
+
+/**
+ * This function starts a new recording.
+ * @param filename The file to write the recording to. Its extension decides
+ *                 the format (see high_format_from_name()).
+ * @param settings The settings to write the file with. The recording is
+ *                 written every 'record_interval' seconds, or only when
+ *                 the recording stops when it is 0.
+ * @return A new recording, or NULL when the format is unknown.
+ */
+usb_recording* usb_recording_new (const char* filename, dt_configuration* settings);
+
+/**
+ * This function adds a pen report to the recording. Strokes are started and
+ * ended by the pressure crossing USB_PEN_DOWN_PRESSURE. When the pen is
+ * lifted and the interval has passed, the recording is written to its file.
+ * @param recording The recording to add the sample to.
+ * @param sample    The decoded pen report.
+ */
+void usb_recording_add_sample (usb_recording* recording, const usb_pen_sample* sample);
+
+/**
+ * This function writes the recording to its file. The file is replaced at
+ * once, so it never contains a partial recording.
+ * @param recording The recording to write.
+ * @return 0 when everything went fine, 1 when something went wrong.
+ */
+int usb_recording_flush (usb_recording* recording);
+
+/**
+ * This function writes the recording one last time and frees it.
+ * @param recording The recording to stop.
+ */
+void usb_recording_free (usb_recording* recording);
+
+#endif//USB_RECORDING_H
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   usb/ring-buffer.h
+ * @brief  A lock-free queue to pass USB reports from one thread to another.
+ * @author Roel Janssen
+ */
+
+#ifndef USB_RING_BUFFER_H
+#define USB_RING_BUFFER_H
+
+#include <glib.h>
+
+/**
+ * The size of an interrupt report from the Inkling.
+ */
+#define USB_REPORT_SIZE 10
+
+/**
+ * This struct holds a report together with the monotonic time (in
+ * microseconds) at which it was received.
+ */
+typedef struct
+{
+  gint64 time;
+  unsigned char data[USB_REPORT_SIZE];
+} usb_report;
+
+/**
+ * The number of reports the ring buffer can hold. This must be a power of
+ * two. At roughly 200 reports per second, this is over a second of pen data.
+ */
+#define USB_RING_BUFFER_CAPACITY 256
+
+/**
+ * This is a single-producer, single-consumer queue of fixed-size reports.
+ * The producer only writes 'head' and the consumer only writes 'tail', so
+ * neither side needs a lock. Both counters run freely and wrap around.
+ */
+typedef struct
+{
+  volatile gint head;
+  volatile gint tail;
+  usb_report reports[USB_RING_BUFFER_CAPACITY];
+} usb_ring_buffer;
+
+/**
+ * This function empties a ring buffer.
+ * @param ring The ring buffer to reset.
+ */
+static inline void
+usb_ring_buffer_init (usb_ring_buffer* ring)
+{
+  g_atomic_int_set (&ring->head, 0);
+  g_atomic_int_set (&ring->tail, 0);
+}
+
+/**
+ * This function adds a report to the ring buffer. It may only be called
+ * from the producing thread.
+ * @param ring   The ring buffer to add the report to.
+ * @param report The report to copy into the buffer.
+ * @return 1 when the report was added, 0 when the buffer is full.
+ */
+static inline int
+usb_ring_buffer_push (usb_ring_buffer* ring, const usb_report* report)
+{
+  guint head = (guint)g_atomic_int_get (&ring->head);
+  guint tail = (guint)g_atomic_int_get (&ring->tail);
+
+  if (head - tail >= USB_RING_BUFFER_CAPACITY) return 0;
+
+  ring->reports[head & (USB_RING_BUFFER_CAPACITY - 1)] = *report;
+
+  /* Only publish the report after it has been copied. */
+  g_atomic_int_set (&ring->head, (gint)(head + 1));
+  return 1;
+}
+
+/**
+ * This function takes the oldest report from the ring buffer. It may only
+ * be called from the consuming thread.
+ * @param ring   The ring buffer to take the report from.
+ * @param report Where to copy the report to.
+ * @return 1 when a report was taken, 0 when the buffer is empty.
+ */
+static inline int
+usb_ring_buffer_pop (usb_ring_buffer* ring, usb_report* report)
+{
+  guint tail = (guint)g_atomic_int_get (&ring->tail);
+  guint head = (guint)g_atomic_int_get (&ring->head);
+
+  if (head == tail) return 0;
+
+  *report = ring->reports[tail & (USB_RING_BUFFER_CAPACITY - 1)];
+
+  /* Only hand the slot back after the report has been copied out. */
+  g_atomic_int_set (&ring->tail, (gint)(tail + 1));
+  return 1;
+}
+
+/**
+ * This function tells whether the ring buffer holds any reports.
+ * @param ring The ring buffer to look at.
+ * @return 1 when the buffer is empty, 0 otherwise.
+ */
+static inline int
+usb_ring_buffer_is_empty (usb_ring_buffer* ring)
+{
+  return g_atomic_int_get (&ring->head) == g_atomic_int_get (&ring->tail);
+}
+
+#endif//USB_RING_BUFFER_H
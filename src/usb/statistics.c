@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "statistics.h"
+
+#include <signal.h>
+
+static volatile sig_atomic_t requests = 0;
+
+/*----------------------------------------------------------------------------.
+ | USB_STATISTICS_REQUEST                                                     |
+ '----------------------------------------------------------------------------*/
+void
+usb_statistics_request ()
+{
+  requests++;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_STATISTICS_REQUESTED                                                   |
+ '----------------------------------------------------------------------------*/
+int
+usb_statistics_requested ()
+{
+  return requests;
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_STATISTICS_APPEND_HISTOGRAM                                            |
+ | This function appends a histogram as a JSON object to 'output'.           |
+ '----------------------------------------------------------------------------*/
+static void
+usb_statistics_append_histogram (GString* output, const char* name,
+				 const usb_histogram* histogram)
+{
+  gint64 mean = 0;
+  if (histogram->count > 0)
+    mean = histogram->total / (gint64)histogram->count;
+
+  g_string_append_printf (output, "\"%s\": { \"count\": %llu, \"mean_us\": %lld, "
+			  "\"p50_us\": %lld, \"p99_us\": %lld, \"max_us\": %lld, "
+			  "\"buckets\": [", name,
+			  (unsigned long long)histogram->count, (long long)mean,
+			  (long long)usb_histogram_percentile (histogram, 0.50),
+			  (long long)usb_histogram_percentile (histogram, 0.99),
+			  (long long)histogram->max);
+
+  int bucket;
+  for (bucket = 0; bucket < USB_HISTOGRAM_BUCKETS; bucket++)
+    g_string_append_printf (output, (bucket > 0) ? ", %llu" : "%llu",
+			    (unsigned long long)histogram->buckets[bucket]);
+
+  g_string_append (output, "] }");
+}
+
+/*----------------------------------------------------------------------------.
+ | USB_STATISTICS_WRITE_JSON                                                  |
+ '----------------------------------------------------------------------------*/
+void
+usb_statistics_write_json (const usb_statistics* statistics, const char* device,
+			   FILE* stream)
+{
+  /* The line is put together first, so that the lines of several devices
+   * written to the same stream don't get mixed up. */
+  GString* output = g_string_new (NULL);
+  char* name = g_strescape (device, NULL);
+
+  g_string_append_printf (output, "{ \"time_us\": %lld, \"device\": \"%s\", "
+			  "\"received\": %d, \"incomplete\": %d, \"dropped\": %d, "
+			  "\"transfer_errors\": %d, \"pen_reports\": %d, "
+			  "\"other_reports\": %d, \"write_failures\": %d, ",
+			  (long long)g_get_real_time (), name,
+			  g_atomic_int_get (&statistics->received),
+			  g_atomic_int_get (&statistics->incomplete),
+			  g_atomic_int_get (&statistics->dropped),
+			  g_atomic_int_get (&statistics->transfer_errors),
+			  g_atomic_int_get (&statistics->pen_reports),
+			  g_atomic_int_get (&statistics->other_reports),
+			  g_atomic_int_get (&statistics->write_failures));
+
+  usb_statistics_append_histogram (output, "latency", &statistics->latency);
+  g_string_append (output, ", ");
+  usb_statistics_append_histogram (output, "processing", &statistics->processing);
+  g_string_append (output, " }\n");
+
+  fputs (output->str, stream);
+  fflush (stream);
+  g_string_free (output, TRUE);
+  g_free (name);
+}
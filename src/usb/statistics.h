@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2013  Roel Janssen <roel@moefel.org>
+ *
+ * This file is part of InklingReader
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   usb/statistics.h
+ * @brief  Counters and latencies that show how online mode performs.
+ * @author Roel Janssen
+ */
+
+#ifndef USB_STATISTICS_H
+#define USB_STATISTICS_H
+
+#include <glib.h>
+#include <stdio.h>
+#include "histogram.h"
+
+/**
+ * This struct holds the statistics of a single device. Every field is only
+ * written by one thread, so no locks are needed. The counters of the
+ * producing thread are read by the consuming thread, which writes the
+ * statistics out. The histograms are only touched by the consuming thread.
+ */
+typedef struct
+{
+  /* Written by the thread that receives the reports. */
+  volatile gint received;
+  volatile gint incomplete;
+  volatile gint dropped;
+  volatile gint transfer_errors;
+
+  /* Written by the thread that handles the reports. */
+  volatile gint pen_reports;
+  volatile gint other_reports;
+  volatile gint write_failures;
+
+  /* The time from receiving a report until the virtual mouse moved. */
+  usb_histogram latency;
+
+  /* The time it took to decode a report and move the virtual mouse. */
+  usb_histogram processing;
+} usb_statistics;
+
+/**
+ * This function adds one to a counter. It may only be called from the
+ * thread that owns the counter.
+ * @param counter The counter to increment.
+ */
+static inline void
+usb_statistics_count (volatile gint* counter)
+{
+  g_atomic_int_set (counter, g_atomic_int_get (counter) + 1);
+}
+
+/**
+ * This function makes usb_statistics_requested() return a new value. It is
+ * safe to call from a signal handler.
+ */
+void usb_statistics_request (void);
+
+/**
+ * This function tells how often the statistics were requested, for example
+ * by sending SIGUSR1. A thread can compare the result to the value it saw
+ * last time to know whether it should write its statistics.
+ * @return The number of requests so far.
+ */
+int usb_statistics_requested (void);
+
+/**
+ * This function writes the statistics as a single line of JSON. It may only
+ * be called from the thread that handles the reports.
+ * @param statistics The statistics to write.
+ * @param device     A name for the device the statistics belong to.
+ * @param stream     The stream to write to.
+ */
+void usb_statistics_write_json (const usb_statistics* statistics,
+				const char* device, FILE* stream);
+
+#endif//USB_STATISTICS_H